@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "apple_disk.h"
+
+#define ERROR 1
+#define OK    0
+
+#define NB_GROUPS   342         // 86 groups of 2 bits and 256 groups of 6 bits, then the XOR check
+#define INVALID     0x80
+
+// GCR 6-and-2 encoding table of $BA29
+static const uint8_t gcr_encode[64] = {
+    0x96, 0x97, 0x9A, 0x9B, 0x9D, 0x9E, 0x9F, 0xA6, 0xA7, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF, 0xB2, 0xB3,
+    0xB4, 0xB5, 0xB6, 0xB7, 0xB9, 0xBA, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF, 0xCB, 0xCD, 0xCE, 0xCF, 0xD3,
+    0xD6, 0xD7, 0xD9, 0xDA, 0xDB, 0xDC, 0xDD, 0xDE, 0xDF, 0xE5, 0xE6, 0xE7, 0xE9, 0xEA, 0xEB, 0xEC,
+    0xED, 0xEE, 0xEF, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF
+};
+
+// physical sector of each DOS sector ($BFB8)
+static const uint8_t interleave[NB_SECTORS] = {
+    0x00, 0x0D, 0x0B, 0x09, 0x07, 0x05, 0x03, 0x01, 0x0E, 0x0C, 0x0A, 0x08, 0x06, 0x04, 0x02, 0x0F
+};
+
+static uint8_t gcr_decode[256];         // the values of LBA00 for the valid nibbles, INVALID for the others
+static uint8_t dos_sector[NB_SECTORS];  // inverse of the interleave
+static const uint8_t low_bits[4] = { 0, 2, 1, 3 };    // the 2 bits of a group are put back swapped (LSR, ROL)
+
+static bool initialized;
+
+static void init_disk_tables(void) {
+    initialized = true;
+    memset(gcr_decode, INVALID, sizeof gcr_decode);
+    for (int i = 0; i < 64; i++) gcr_decode[gcr_encode[i]] = i;
+    for (int i = 0; i < NB_SECTORS; i++) dos_sector[interleave[i]] = i;
+}
+
+bool is_disk_image(const char *name) {
+    const char *extension = strrchr(name, '.');
+    return extension && (strcasecmp(extension, ".dsk") == 0 || strcasecmp(extension, ".do") == 0
+                      || strcasecmp(extension, ".nib") == 0);
+}
+
+// the 343 nibbles of a data field: all the groups through the table first, each one XORed with
+// the previous one (LB8DC), then the bytes are rebuilt from the two buffers (LB8C2)
+static int decode_sector(const uint8_t *nibbles, uint8_t *sector) {
+    uint8_t groups[NB_GROUPS];
+    uint8_t value = 0, check = 0;
+    for (int i = 0; i < NB_GROUPS; i++) {
+        uint8_t v = gcr_decode[nibbles[i]];
+        check |= v;
+        groups[i] = value ^= v;
+    }
+    if ((check & INVALID) || gcr_decode[nibbles[NB_GROUPS]] != value) return ERROR;
+
+    const uint8_t *twos = groups, *sixes = groups + 86;
+    for (int i = 0; i < 86; i++)             sector[i] = sixes[i] << 2 | low_bits[twos[i] & 3];
+    for (int i = 86; i < 172; i++)           sector[i] = sixes[i] << 2 | low_bits[twos[i - 86] >> 2 & 3];
+    for (int i = 172; i < SECTOR_SIZE; i++)  sector[i] = sixes[i] << 2 | low_bits[twos[i - 172] >> 4 & 3];
+    return OK;
+}
+
+// the nibbles of one turn of the track, a field can go on at the start
+int decode_track(Disk *disk, const uint8_t *nibbles, int size) {
+    enum { WINDOW = 512 };      // more than an address field, the gap and a data field
+    if (size <= 0 || size > NIB_TRACK_SIZE) return 0;
+    uint8_t ring[NIB_TRACK_SIZE + WINDOW];
+    memcpy(ring, nibbles, size);
+    for (int i = 0; i < WINDOW; i++) ring[size + i] = nibbles[i % size];
+
+    int nb_sectors = 0;
+    for (int i = 0; i < size; i++) {
+        if (ring[i] != 0xD5 || ring[i+1] != 0xAA || ring[i+2] != 0x96) continue;
+        uint8_t field[4];       // volume, track, sector, check, in 4-and-4 (LB96F)
+        for (int k = 0; k < 4; k++) field[k] = ((ring[i+3+2*k] << 1) | 1) & ring[i+4+2*k];
+        int track = field[1], sector = field[2];
+        if ((field[0] ^ field[1] ^ field[2] ^ field[3]) || track >= NB_TRACKS || sector >= NB_SECTORS) continue;
+
+        int data = i + 11, limit = data + 64;
+        while (data < limit && (ring[data] != 0xD5 || ring[data+1] != 0xAA || ring[data+2] != 0xAD)) data++;
+        if (data == limit) continue;
+        int logical = dos_sector[sector];
+        if (!disk->found[track][logical] && decode_sector(ring + data + 3, disk->sectors[track][logical]) == OK) {
+            disk->found[track][logical] = true;
+            nb_sectors++;
+        }
+        i = data + 3 + NB_GROUPS;
+    }
+    return nb_sectors;
+}
+
+int load_disk(Disk *disk, const char *name) {
+    if (!initialized) init_disk_tables();
+    memset(disk, 0, sizeof *disk);
+    Book_file f;
+    if (map_book(&f, name) != OK) return ERROR;
+
+    int status = OK;
+    if (f.size == sizeof disk->sectors) {
+        memcpy(disk->sectors, f.data, f.size);
+        memset(disk->found, true, sizeof disk->found);
+    }
+    else if (f.size == NB_TRACKS * NIB_TRACK_SIZE) {
+        for (int track = 0; track < NB_TRACKS; track++)
+            decode_track(disk, f.data + track * NIB_TRACK_SIZE, NIB_TRACK_SIZE);
+        for (int track = 0; track < NB_TRACKS; track++)
+            for (int sector = 0; sector < NB_SECTORS; sector++)
+                disk->nb_errors += !disk->found[track][sector];
+    }
+    else status = ERROR;
+    unmap_book(&f);
+    return status;
+}
+
+static const uint8_t *sector_at(const Disk *disk, int track, int sector) {
+    if (track >= NB_TRACKS || sector >= NB_SECTORS || !disk->found[track][sector]) return NULL;
+    return disk->sectors[track][sector];
+}
+
+int read_catalog(const Disk *disk, Dos_file *files, int max_files) {
+    const uint8_t *vtoc = sector_at(disk, 0x11, 0);
+    if (!vtoc) return -1;
+    int nb_files = 0;
+    const uint8_t *s = sector_at(disk, vtoc[1], vtoc[2]);
+    for (int visited = 0; s && visited < NB_TRACKS * NB_SECTORS; visited++) {
+        for (int e = 0; e < 7; e++) {     // 7 entries of 35 bytes from offset $0B
+            const uint8_t *entry = s + 0x0B + 35 * e;
+            if (entry[0] == 0 || entry[0] == 0xFF || nb_files == max_files) continue;  // free or deleted
+            Dos_file *f = &files[nb_files++];
+            f->track  = entry[0];
+            f->sector = entry[1];
+            f->type   = entry[2] & 0x7F;
+            f->locked = entry[2] & 0x80;
+            int length = 30;
+            while (length > 0 && (entry[2 + length] & 0x7F) == ' ') length--;
+            for (int i = 0; i < length; i++) f->name[i] = entry[3 + i] & 0x7F;
+            f->name[length] = '\0';
+            f->nb_sectors = entry[33] | entry[34] << 8;
+        }
+        s = s[1] ? sector_at(disk, s[1], s[2]) : NULL;
+    }
+    return nb_files;
+}
+
+// the sectors of the track/sector lists up to the first null one; a binary file is given
+// without its address and length (like LB221 loading at $3000), as in the files extracted usually
+int read_file(const Disk *disk, const Dos_file *f, Book_file *contents) {
+    *contents = (Book_file){ NULL, 0, false };
+    uint8_t *data = malloc(NB_TRACKS * NB_SECTORS * SECTOR_SIZE);
+    size_t size = 0;
+    const uint8_t *list = sector_at(disk, f->track, f->sector);
+    if (!list) { free(data); return ERROR; }
+    for (int visited = 0; list && visited < NB_TRACKS * NB_SECTORS; visited++) {
+        for (int i = 0x0C; i < SECTOR_SIZE; i += 2) {    // 122 track/sector pairs
+            if (list[i] == 0 && list[i+1] == 0) { list = NULL; break; }
+            const uint8_t *sector = sector_at(disk, list[i], list[i+1]);
+            if (!sector || size == NB_TRACKS * NB_SECTORS * SECTOR_SIZE) { free(data); return ERROR; }
+            memcpy(data + size, sector, SECTOR_SIZE);
+            size += SECTOR_SIZE;
+        }
+        if (list) list = list[1] ? sector_at(disk, list[1], list[2]) : NULL;
+    }
+    if (f->type == BINARY_FILE) {
+        if (size < 4) { free(data); return ERROR; }
+        size_t length = data[2] | data[3] << 8;
+        if (length > size - 4) length = size - 4;
+        memmove(data, data + 4, length);
+        size = length;
+    }
+    contents->data = data;
+    contents->size = size;
+    return OK;
+}
@@ -0,0 +1,46 @@
+#ifndef APPLE_DISK_H
+#define APPLE_DISK_H
+
+/*
+ * Apple II DOS 3.3 disk images (.dsk/.do in DOS order, or .nib with the nibbles of each track),
+ * so that the book files can be read from the Sargon III disks without extracting them first.
+ *
+ * The nibbles are decoded like the RWTS of the listing: the address fields D5 AA 96 (LB944),
+ * the data fields D5 AA AD of 342 GCR 6-and-2 groups and the XOR check (LB8DC, with the decoding
+ * table of LBA00), then the 86 groups of 2 bits put back under the 256 groups of 6 bits (LB8C2).
+ * The physical sectors are put in DOS order with the interleave table of $BFB8.
+ * The catalog is read like LAE56: the VTOC at track $11 sector 0, then the chain of catalog sectors.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "book_file.h"
+
+#define NB_TRACKS   35
+#define NB_SECTORS  16
+#define SECTOR_SIZE 256
+#define NIB_TRACK_SIZE 6656     // nibbles of a track in a .nib image
+
+enum Dos_types { TEXT_FILE = 0, INTEGER_FILE = 1, APPLESOFT_FILE = 2, BINARY_FILE = 4 };
+
+typedef struct {
+    uint8_t sectors[NB_TRACKS][NB_SECTORS][SECTOR_SIZE];   // in DOS order, as in a .dsk image
+    bool    found[NB_TRACKS][NB_SECTORS];                  // always for a .dsk image
+    int     nb_errors;          // sectors of a .nib image not found, or with a bad check
+} Disk;
+
+typedef struct {                // catalog entry
+    char    name[31];           // without the high bits and the trailing spaces
+    int     type;               // enum Dos_types
+    bool    locked;
+    uint8_t track, sector;      // first track/sector list
+    int     nb_sectors;
+} Dos_file;
+
+int  load_disk(Disk *disk, const char *name);  // OK, or ERROR if it can't be read or isn't a disk image
+int  decode_track(Disk *disk, const uint8_t *nibbles, int size);   // number of sectors decoded
+int  read_catalog(const Disk *disk, Dos_file *files, int max_files);   // number of files, -1 without a VTOC
+int  read_file(const Disk *disk, const Dos_file *f, Book_file *contents);  // OK, or ERROR
+bool is_disk_image(const char *name);           // by the extension
+
+#endif
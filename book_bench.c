@@ -0,0 +1,215 @@
+/*
+ * Speed of the move generator: perft on test positions, micro-benchmarks of search_moves(),
+ * is_threaten() and do_move()/undo_move() on some kinds of positions, and replay of book files.
+ *
+ * One tab separated line per result (bench, backend, case, count, seconds, count per second),
+ * so that the results of two versions can be compared with the usual tools.
+ * The perft counts are the ones of the Sargon generator (pseudo-legal moves, filtered
+ * with is_check()): it only promotes to queens (registered 4 times) and doesn't know
+ * whether the king and rooks have moved, so they only match the usual counts without these
+ * in the tree (e.g. initial position up to depth 5, kiwipete up to depth 4).
+ *
+ *   cc -O2 -o book_bench book_bench.c sargon.c book_file.c trace.c
+ *   book_bench [-b|-r] [-t seconds] [perft [depth] | micro | book file...]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sargon.h"
+#include "trace.h"
+
+typedef struct { const char *name, *fen; } Position;
+
+Position perft_positions[] = {
+    { "initial",  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1" },
+    { "kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1" },
+    { "endgame",  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1" },
+    { "promote",  "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1" },
+    { "middle",   "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8" },
+};
+
+Position micro_positions[] = {
+    { "quiet",        "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4" },
+    { "single_check", "rnbqkbnr/ppp2ppp/8/1B1pp3/4P3/8/PPPP1PPP/RNBQK1NR b KQkq - 1 3" },
+    { "double_check", "4k3/8/3N4/8/8/8/8/4RK2 b - - 0 1" },
+    { "en_passant",   "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3" },
+    { "promotion",    "8/1P4k1/8/8/8/8/5Kp1/8 w - - 0 1" },
+    { "castling",     "r3k2r/pppq1ppp/2npbn2/2b1p3/2B1P3/2NPBN2/PPPQ1PPP/R3K2R w KQkq - 0 1" },
+};
+
+#define NB(array) (int)(sizeof array / sizeof array[0])
+
+double min_time = 0.5;          // each micro-benchmark is repeated at least that long
+long   book_nodes;
+bool   lazy;                   // book replay with generate_moves()
+
+void report(const char *bench, Decoder *d, const char *name, long count, double seconds) {
+    printf("%s\t%s\t%s\t%ld\t%.6f\t%.0f\n", bench, d->use_bitboards ? "bitboards" : "reference",
+           name, count, seconds, seconds > 0 ? count / seconds : 0);
+    fflush(stdout);
+}
+
+long perft(Decoder *d, int depth, int turn, Move last) {
+    search_moves(d, turn, last);
+    int nb_moves = d->nb_moves;
+    Moves moves;
+    memcpy(moves, d->moves, nb_moves * sizeof *moves);
+
+    long nodes = 0;
+    for (int i = 0; i < nb_moves; i++) {
+        Undo undo = do_move(d, moves[i]);
+        if (!is_check(d, turn))
+            nodes += depth == 1 ? 1 : perft(d, depth-1, turn ^ BLACK, moves[i]);
+        undo_move(d, undo);
+    }
+    return nodes;
+}
+
+void bench_perft(Decoder *d, int max_depth) {
+    for (int i = 0; i < NB(perft_positions); i++)
+        for (int depth = 1; depth <= max_depth; depth++) {
+            int turn;
+            Move last;
+            if (init_fen(d, perft_positions[i].fen, &turn, &last) != OK) {
+                fprintf(stderr, "bad position %s\n", perft_positions[i].name);
+                break;
+            }
+            char name[64];
+            snprintf(name, sizeof name, "%s/%d", perft_positions[i].name, depth);
+            double start = trace_now();
+            long nodes = perft(d, depth, turn, last);
+            report("perft", d, name, nodes, trace_now() - start);
+        }
+}
+
+void bench_micro(Decoder *d) {
+    for (int i = 0; i < NB(micro_positions); i++) {
+        const char *name = micro_positions[i].name;
+        int turn;
+        Move last;
+        if (init_fen(d, micro_positions[i].fen, &turn, &last) != OK) {
+            fprintf(stderr, "bad position %s\n", name);
+            continue;
+        }
+        long count = 0;
+        double start = trace_now(), seconds;
+        do {
+            for (int n = 0; n < 1000; n++) search_moves(d, turn, last);
+            count += 1000;
+        } while ((seconds = trace_now() - start) < min_time);
+        report("search_moves", d, name, count, seconds);
+
+        count = 0;
+        int threats = 0;
+        start = trace_now();
+        do {
+            for (int n = 0; n < 100; n++)
+                for (int pos = 0; pos < 64; pos++)
+                    threats += is_threaten(d, pos, WHITE) + is_threaten(d, pos, BLACK);
+            count += 100 * 128;
+        } while ((seconds = trace_now() - start) < min_time);
+        if (threats < 0) printf("\n");  // keeps the calls
+        report("is_threaten", d, name, count, seconds);
+
+        search_moves(d, turn, last);
+        Moves moves;
+        int nb_moves = d->nb_moves;
+        memcpy(moves, d->moves, nb_moves * sizeof *moves);
+        count = 0;
+        start = trace_now();
+        do {
+            for (int n = 0; n < 100; n++)
+                for (int m = 0; m < nb_moves; m++) undo_move(d, do_move(d, moves[m]));
+            count += 100 * nb_moves;
+        } while ((seconds = trace_now() - start) < min_time);
+        report("do_undo_move", d, name, count, seconds);
+    }
+}
+
+// same walk as decode_variations(), without printing
+void replay_variations(Decoder *d, int depth, Move last) {
+    int turn = depth % 2 ? BLACK : WHITE;
+    int flags;
+    do {
+        flags = byte_at(&d->book, d->book_indx) & 0xC0;
+        if (flags == 0xC0) {
+            if (byte_at(&d->book, d->book_indx) & 7) { d->book_indx += 5; break; } // sub-book name
+            d->book_indx += 1;
+        }
+        int move_indx = byte_at(&d->book, d->book_indx) & 0x3F;
+        if (lazy) generate_moves(d, turn, last, move_indx);
+        else      search_moves(d, turn, last);
+        if (move_indx == 0 || move_indx > d->nb_moves) break;
+
+        Move m = d->moves[move_indx-1];
+        Undo undo = do_move(d, m);
+        book_nodes++;
+        d->book_indx++;
+        if (flags != 0x40) replay_variations(d, depth + 1, m);
+        undo_move(d, undo);
+    } while (flags & 0x80);
+}
+
+// with all the moves of each position, then with the moves up to the book move only
+void bench_book(Decoder *d, const char *name) {
+    Move none = { 0, 0 };
+    for (lazy = false; ; lazy = true) {
+        long count = 0;
+        double start = trace_now(), seconds;
+        do {
+            init_board(d);
+            d->book_indx = 0;
+            book_nodes = 0;
+            replay_variations(d, 0, none);
+            count += book_nodes;
+        } while ((seconds = trace_now() - start) < min_time && book_nodes);
+        report(lazy ? "book_lazy" : "book", d, name, count, seconds);
+        if (lazy) break;
+    }
+}
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-b|-r] [-t seconds] [perft [depth] | micro | book opening_book_file...]\n", name);
+    fprintf(stderr, "  -b : bitboard move generator only\n");
+    fprintf(stderr, "  -r : reference move generator only\n");
+    fprintf(stderr, "  -t : minimum time of each micro-benchmark or book (default: 0.5)\n");
+    fprintf(stderr, "  default: perft 4 and micro\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    bool backends[2] = { true, true };  // reference, bitboards
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "-b") == 0) backends[0] = false;
+        else if (strcmp(argv[arg], "-r") == 0) backends[1] = false;
+        else if (strcmp(argv[arg], "-t") == 0 && arg+1 < argc) min_time = atof(argv[++arg]);
+        else usage(argv[0]);
+    }
+    const char *mode = arg < argc ? argv[arg++] : NULL;
+    if (mode && strcmp(mode, "perft") && strcmp(mode, "micro") && strcmp(mode, "book")) usage(argv[0]);
+    if (mode && strcmp(mode, "book") == 0 && arg == argc) usage(argv[0]);
+
+    init_tables();
+    Decoder decoder, *d = &decoder;
+    init_decoder(d);
+
+    printf("#bench\tbackend\tcase\tcount\tseconds\tper_second\n");
+    for (int backend = 0; backend < 2; backend++) {
+        if (!backends[backend]) continue;
+        d->use_bitboards = backend;
+        if (!mode || strcmp(mode, "perft") == 0) bench_perft(d, mode && arg < argc ? atoi(argv[arg]) : 4);
+        if (!mode || strcmp(mode, "micro") == 0) bench_micro(d);
+        if (mode && strcmp(mode, "book") == 0)
+            for (int i = arg; i < argc; i++) {
+                if (init_book(d, argv[i]) != OK) {
+                    fprintf(stderr, "%s not found\n", argv[i]);
+                    continue;
+                }
+                bench_book(d, argv[i]);
+                close_book(d);
+            }
+    }
+    return 0;
+}
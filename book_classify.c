@@ -0,0 +1,296 @@
+/*
+ * Classifies PGN games with the Openings Library: for each game, the deepest book position it
+ * reaches and the ECO file it lands in. The moves of the game are followed in the book with a
+ * cursor (book_cursor.h), through the C5 links of B000 to the ECO files.
+ *
+ * The PGN is read as a stream by the main thread and cut into batches of games, which the
+ * workers (one per processor by default) classify. Only NB_BATCHES batches are in memory, and the
+ * results are printed in the order of the games, whatever the size of the input. The books are
+ * loaded once and shared by the workers, each game has its own cursor.
+ *
+ *   cc -O2 -o book_classify book_classify.c book_cursor.c book_library.c sargon.c book_file.c trace.c -lpthread
+ *   book_classify [-j threads] [-q] b000#0x1000.BIN [games.pgn...]
+ *
+ * One tab separated line per game (not with -q): number, plies in the book, file of the last
+ * book move (or of the ECO file linked after it), offset of this move in the file, ECO tag.
+ * The number of games per file and the games per second are printed on stderr at the end.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "sargon.h"
+#include "book_cursor.h"
+#include "trace.h"
+
+#define BATCH_GAMES  256
+#define NB_BATCHES   64
+#define MAX_THREADS  64
+#define MAX_PLIES    256
+
+typedef struct {
+    int plies;                  // moves of the game found in the book
+    int book;                   // in library.books
+    int offset;                 // of the last one, -1 if none
+} Result;
+
+typedef struct {
+    char   *text;               // movetext of the games, each one ended with '\0'
+    size_t  size, capacity;
+    size_t  start[BATCH_GAMES];
+    char    eco[BATCH_GAMES][4];
+    bool    set_up[BATCH_GAMES];    // doesn't start from the initial position
+    Result  results[BATCH_GAMES];
+    int     nb_games;
+    bool    done;
+} Batch;
+
+Library  library;
+
+Batch    batches[NB_BATCHES];
+long     nb_filled, nb_taken;   // batches handed over to the workers, and taken by them
+bool     finished;
+pthread_mutex_t lock  = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  ready = PTHREAD_COND_INITIALIZER;     // a batch is filled, or the input is finished
+pthread_cond_t  done  = PTHREAD_COND_INITIALIZER;     // a batch is classified
+
+bool     quiet;
+long     nb_games, per_book[MAX_BOOKS];
+double   total_plies;
+
+/*
+ * Games
+ */
+
+// next SAN of the main line (comments, variations, NAGs and move numbers skipped), NULL at the end
+const char *next_san(const char **text, char *san) {
+    const char *s = *text;
+    int level = 0;
+    for (;;) {
+        while (isspace((unsigned char)*s)) s++;
+        if (!*s) break;
+        if (*s == '{') { while (*s && *s != '}') s++; if (*s) s++; continue; }
+        if (*s == ';') { while (*s && *s != '\n') s++; continue; }
+        if (*s == '(') { level++; s++; continue; }
+        if (*s == ')') { if (level > 0) level--; s++; continue; }
+
+        int len = 0;
+        while (*s && !isspace((unsigned char)*s) && !strchr("{}();", *s)) {
+            if (len < 15) san[len++] = *s;
+            s++;
+        }
+        san[len] = '\0';
+        if (level > 0) continue;
+        if (strcmp(san, "*") == 0 || strcmp(san, "1-0") == 0 || strcmp(san, "0-1") == 0 || strcmp(san, "1/2-1/2") == 0) break;
+        char *move = san;
+        while (isdigit((unsigned char)*move)) move++;
+        while (*move == '.') move++;
+        if (!*move || *move == '$') continue;
+        len = strlen(move);
+        while (len > 0 && strchr("!?+#", move[len-1])) move[--len] = '\0';
+        memmove(san, move, len + 1);
+        *text = s;
+        return san;
+    }
+    *text = s;
+    return NULL;
+}
+
+Result classify(Book_cursor *c, const char *text) {
+    Result r = { 0, 0, -1 };
+    char san[16];
+    Move m;
+    while (c->in_book && c->plies < MAX_PLIES && next_san(&text, san) && find_move(c, san, &m) == OK && play_move(c, m));
+    r.plies  = c->book_plies;
+    r.book   = c->book;
+    r.offset = c->offset;
+    return r;
+}
+
+void *worker(void *arg) {
+    Book_cursor *c = malloc(sizeof *c);
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        while (nb_taken == nb_filled && !finished) pthread_cond_wait(&ready, &lock);
+        if (nb_taken == nb_filled) {
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        Batch *b = &batches[nb_taken++ % NB_BATCHES];
+        pthread_mutex_unlock(&lock);
+
+        for (int i = 0; i < b->nb_games; i++) {
+            if (b->set_up[i]) { b->results[i] = (Result){ 0, 0, -1 }; continue; }
+            init_cursor(c, &library);
+            c->d.use_bitboards = *(bool *)arg;
+            b->results[i] = classify(c, b->text + b->start[i]);
+        }
+
+        pthread_mutex_lock(&lock);
+        b->done = true;
+        pthread_cond_broadcast(&done);
+        pthread_mutex_unlock(&lock);
+    }
+    free(c);
+    return NULL;
+}
+
+/*
+ * Input and output
+ */
+
+void append(Batch *b, int c) {
+    if (b->size == b->capacity) {
+        b->capacity = b->capacity ? 2 * b->capacity : 65536;
+        b->text = realloc(b->text, b->capacity);
+    }
+    b->text[b->size++] = c;
+}
+
+// a game: its tags (ECO and FEN are kept), then its movetext until the next tag at the start of a line
+bool read_game(FILE *in, Batch *b) {
+    int n = b->nb_games;
+    b->start[n] = b->size;
+    strcpy(b->eco[n], "");
+    b->set_up[n] = false;
+    bool moves = false, line_start = true;
+    int comment = 0, c;
+    while ((c = getc_unlocked(in)) != EOF) {
+        if (c == '[' && line_start && !comment) {
+            if (moves) { ungetc(c, in); break; }
+            char tag[256];
+            int len = 0;
+            while ((c = getc_unlocked(in)) != EOF && c != ']' && c != '\n')
+                if (len < 255) tag[len++] = c;
+            tag[len] = '\0';
+            char value[8];
+            if (sscanf(tag, "ECO \"%3[^\"]\"", value) == 1) strcpy(b->eco[n], value);
+            if (strncmp(tag, "FEN ", 4) == 0 && !strstr(tag, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w")) b->set_up[n] = true;
+            line_start = false;
+            continue;
+        }
+        if (c == '{') comment = 1;
+        if (c == '}') comment = 0;
+        line_start = c == '\n';
+        if (!isspace(c)) moves = true;
+        if (moves) append(b, c);
+    }
+    if (!moves) return false;
+    append(b, '\0');
+    b->nb_games++;
+    return true;
+}
+
+void print_batch(Batch *b, long first_game) {
+    for (int i = 0; i < b->nb_games; i++) {
+        Result *r = &b->results[i];
+        nb_games++;
+        if (r->plies) per_book[r->book]++;
+        total_plies += r->plies;
+        if (!quiet)
+            printf("%ld\t%d\t%s\t%d\t%s\n", first_game + i + 1, r->plies, r->plies ? library.books[r->book].name : "-",
+                   r->offset, b->eco[i]);
+    }
+}
+
+// prints the batches classified in the order of the games, waiting for them if wait
+void print_batches(long *nb_printed, bool wait) {
+    while (*nb_printed < nb_filled) {
+        Batch *b = &batches[*nb_printed % NB_BATCHES];
+        pthread_mutex_lock(&lock);
+        while (wait && !b->done) pthread_cond_wait(&done, &lock);
+        bool classified = b->done;
+        pthread_mutex_unlock(&lock);
+        if (!classified) break;
+        print_batch(b, *nb_printed * BATCH_GAMES);
+        ++*nb_printed;
+    }
+    fflush(stdout);
+}
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-j threads] [-q] b000_file [games.pgn...]\n", name);
+    fprintf(stderr, "  -j : number of threads (default: one per processor)\n");
+    fprintf(stderr, "  -q : only the summary\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool use_bitboards = BITBOARDS;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "-j") == 0 && arg+1 < argc) nb_threads = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-q") == 0) quiet = true;
+        else if (strcmp(argv[arg], "-b") == 0) use_bitboards = true;
+        else if (strcmp(argv[arg], "-r") == 0) use_bitboards = false;
+        else usage(argv[0]);
+    }
+    if (arg == argc) usage(argv[0]);
+    if (nb_threads < 1) nb_threads = 1;
+    if (nb_threads > MAX_THREADS) nb_threads = MAX_THREADS;
+
+    init_tables();
+    const char *b000 = argv[arg++];
+    if (open_library(&library, b000) != OK) {
+        fprintf(stderr, "%s not found\n", b000);
+        exit(1);
+    }
+
+    pthread_t threads[MAX_THREADS];
+    for (int i = 0; i < nb_threads; i++) pthread_create(&threads[i], NULL, worker, &use_bitboards);
+
+    double start = trace_now();
+    long nb_printed = 0;
+    int nb_inputs = argc - arg;
+    for (int input = 0; input < (nb_inputs ? nb_inputs : 1); input++) {
+        FILE *in = nb_inputs ? fopen(argv[arg + input], "r") : stdin;
+        if (!in) {
+            fprintf(stderr, "%s not found\n", argv[arg + input]);
+            continue;
+        }
+        for (bool more = true; more; ) {
+            // the next batch to fill must have been printed
+            print_batches(&nb_printed, false);
+            if (nb_filled - nb_printed == NB_BATCHES) {
+                Batch *b = &batches[nb_printed % NB_BATCHES];
+                pthread_mutex_lock(&lock);
+                while (!b->done) pthread_cond_wait(&done, &lock);
+                pthread_mutex_unlock(&lock);
+                print_batches(&nb_printed, false);
+            }
+            Batch *b = &batches[nb_filled % NB_BATCHES];
+            b->size = 0;
+            b->nb_games = 0;
+            b->done = false;
+            while (b->nb_games < BATCH_GAMES && (more = read_game(in, b)));
+            if (b->nb_games == 0) break;
+            pthread_mutex_lock(&lock);
+            nb_filled++;
+            pthread_cond_signal(&ready);
+            pthread_mutex_unlock(&lock);
+        }
+        if (in != stdin) fclose(in);
+    }
+    pthread_mutex_lock(&lock);
+    finished = true;
+    pthread_cond_broadcast(&ready);
+    pthread_mutex_unlock(&lock);
+
+    print_batches(&nb_printed, true);
+    for (int i = 0; i < nb_threads; i++) pthread_join(threads[i], NULL);
+    double seconds = trace_now() - start;
+
+    fprintf(stderr, "%ld games in %.3f s: %.0f games/s with %d threads, %.2f plies in the book on average\n",
+            nb_games, seconds, seconds > 0 ? nb_games / seconds : 0, nb_threads, nb_games ? total_plies / nb_games : 0);
+    long in_book = 0;
+    for (int i = 0; i < library.nb_books; i++) {
+        if (per_book[i]) fprintf(stderr, "%s\t%ld\n", library.books[i].name, per_book[i]);
+        in_book += per_book[i];
+    }
+    fprintf(stderr, "-\t%ld\n", nb_games - in_book);
+    return 0;
+}
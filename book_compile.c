@@ -0,0 +1,373 @@
+/*
+ * Openings Library compiler: the inverse of book_decoder. Reads a repertoire, as PGN games
+ * (with nested variations, "!" for recommended moves, "{=> BC40}" comments for sub-book links)
+ * or as the JSON lines of book_decoder -f json, and writes it in the Sargon format: move indexes
+ * in the generator order, 0x40/0x80/0xC0 flags, C5 links.
+ *
+ * With ECO tags in the games, the lines are split like the original disk: B000 keeps the moves
+ * until the lines of a position all belong to the same ECO file, and links to it there (C5),
+ * and every ECO file holds its lines from the initial position (see book_rebuild).
+ *
+ *   cc -O2 -o book_compile book_compile.c sargon.c book_file.c
+ *   book_compile [-o b000_file] [-n] repertoire.pgn|tree.json...
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include "sargon.h"
+
+#define ROOT 0                  // file index of B000
+#define MAX_FILES 64
+
+typedef struct Tree Tree;
+struct Tree {                   // a move of the repertoire, and the variations after it
+    char      san[16];          // PGN input
+    Move      move;             // JSON input, or found from the SAN
+    int       move_indx;        // in the generated moves, 0 if not found yet (or given by the JSON input)
+    bool      recommended;
+    char      sub_book[5];      // a link to a sub-book instead of a move
+    uint64_t  files;            // files of the lines going through this move
+    Tree     *first_child, *last_child, *next;
+};
+
+Tree     root;
+char     file_names[MAX_FILES][5] = { "B000" };
+int      nb_files = 1;
+bool     split = true;
+int      nb_errors, nb_dropped, nb_lines;
+
+int file_index(const char *eco) {
+    char name[5] = "B000";
+    if (eco && eco[0] >= 'A' && eco[0] <= 'E' && isdigit(eco[1]) && isdigit(eco[2])) {
+        // files of ten codes, except A45-A49
+        sprintf(name, "B%c%c%c", eco[0], eco[1], eco[0] == 'A' && eco[1] == '4' && eco[2] >= '5' ? '5' : '0');
+    }
+    for (int i = 0; i < nb_files; i++)
+        if (strcmp(file_names[i], name) == 0) return i;
+    if (nb_files == MAX_FILES) return ROOT;
+    strcpy(file_names[nb_files], name);
+    return nb_files++;
+}
+
+Tree *add_child(Tree *parent) {
+    Tree *t = calloc(1, sizeof *t);
+    if (parent->last_child) parent->last_child->next = t;
+    else                    parent->first_child = t;
+    parent->last_child = t;
+    return t;
+}
+
+Tree *add_move(Tree *parent, const char *san, Move m, bool recommended, uint64_t files) {
+    Tree *t;
+    for (t = parent->first_child; t; t = t->next)
+        if (!t->sub_book[0] && (san ? strcmp(t->san, san) == 0 : t->move.from == m.from && t->move.to == m.to)) break;
+    if (!t) {
+        t = add_child(parent);
+        if (san) snprintf(t->san, sizeof t->san, "%s", san);
+        t->move = m;
+    }
+    t->recommended |= recommended;
+    t->files |= files;
+    return t;
+}
+
+void add_sub_book(Tree *parent, const char *name, uint64_t files) {
+    for (Tree *t = parent->first_child; t; t = t->next)
+        if (strcmp(t->sub_book, name) == 0) { t->files |= files; return; }
+    Tree *t = add_child(parent);
+    snprintf(t->sub_book, sizeof t->sub_book, "%s", name);
+    t->files = files;
+}
+
+/*
+ * PGN: tags, comments, move numbers, NAGs and results are skipped, but ECO tags and "{=> name}" comments
+ */
+
+int next_char(FILE *in) {
+    int c = getc(in);
+    if (c == '\n') nb_lines++;
+    return c;
+}
+
+void read_pgn(FILE *in) {
+    Tree    *stack[256], *before[256];  // position, and position before the last move, at each level of variation
+    int      level = 0;
+    Tree    *position = &root, *previous = &root;
+    uint64_t files = 1ULL << ROOT;
+    bool     in_game = false;
+    int      c;
+
+    while ((c = next_char(in)) != EOF) {
+        if (isspace(c)) continue;
+        if (c == '[') {                 // tag
+            char tag[256] = "";
+            int len = 0;
+            while ((c = next_char(in)) != EOF && c != ']' && c != '\n')
+                if (len < 255) tag[len++] = c;
+            tag[len] = '\0';
+            if (in_game) { position = previous = &root; level = 0; in_game = false; files = 1ULL << ROOT; }
+            char eco[8];
+            if (sscanf(tag, "ECO \"%7[^\"]\"", eco) == 1 && split) files = 1ULL << file_index(eco);
+            continue;
+        }
+        in_game = true;
+        if (c == '{') {                 // comment
+            char comment[256] = "";
+            int len = 0;
+            while ((c = next_char(in)) != EOF && c != '}')
+                if (len < 255) comment[len++] = c;
+            comment[len] = '\0';
+            char name[5];
+            if (sscanf(comment, "=> %4s", name) == 1) add_sub_book(position, name, files);
+            continue;
+        }
+        if (c == ';') { while ((c = next_char(in)) != EOF && c != '\n'); continue; }
+        if (c == '(') {
+            if (level < 256) { stack[level] = position; before[level] = previous; level++; }
+            position = previous;
+            continue;
+        }
+        if (c == ')') {
+            if (level > 0) { level--; position = stack[level]; previous = before[level]; }
+            continue;
+        }
+
+        char token[64];
+        int len = 0;
+        do { if (len < 63) token[len++] = c; }
+        while ((c = next_char(in)) != EOF && !isspace(c) && !strchr("{}()[];", c));
+        token[len] = '\0';
+        if (c != EOF && !isspace(c)) ungetc(c, in);
+
+        if (strcmp(token, "*") == 0 || strcmp(token, "1-0") == 0 || strcmp(token, "0-1") == 0 || strcmp(token, "1/2-1/2") == 0) {
+            position = previous = &root; level = 0; in_game = false; files = 1ULL << ROOT;
+            continue;
+        }
+        char *san = token;
+        while (isdigit(*san)) san++;    // move number
+        while (*san == '.') san++;
+        if (!*san || *san == '$') continue;
+
+        len = strlen(san);
+        int suffix = len;
+        while (suffix > 0 && strchr("!?", san[suffix-1])) suffix--;
+        bool recommended = strcmp(san + suffix, "!") == 0;
+        san[len = suffix] = '\0';
+        while (len > 0 && strchr("+#", san[len-1])) san[--len] = '\0';
+        Move none = { 0, 0 };
+        previous = position;
+        position = add_move(position, san, none, recommended, files);
+    }
+}
+
+// the JSON lines written by book_decoder -f json
+void read_json(FILE *in) {
+    Tree *last[256] = { &root };
+    char  line[512];
+    while (fgets(line, sizeof line, in)) {
+        nb_lines++;
+        int ply;
+        char *field = strstr(line, "\"ply\":");
+        if (!field || sscanf(field, "\"ply\":%d", &ply) != 1 || ply < 1 || ply > 255 || !last[ply-1]) continue;
+        char name[5], from[3], to[3];
+        if ((field = strstr(line, "\"sub_book\":\"")) && sscanf(field, "\"sub_book\":\"%4[^\"]", name) == 1) {
+            add_sub_book(last[ply-1], name, 1ULL << ROOT);
+            continue;
+        }
+        if (!(field = strstr(line, "\"from\":\"")) || sscanf(field, "\"from\":\"%2s", from) != 1) continue;
+        if (!(field = strstr(line, "\"to\":\""))   || sscanf(field, "\"to\":\"%2s",   to)   != 1) continue;
+        Move m = { 8*(from[1]-'1') + from[0]-'a', 8*(to[1]-'1') + to[0]-'a' };
+        bool recommended = strstr(line, "\"recommended\":true") != NULL;
+        last[ply] = add_move(last[ply-1], NULL, m, recommended, 1ULL << ROOT);
+        if ((field = strstr(line, "\"index\":"))) sscanf(field, "\"index\":%d", &last[ply]->move_indx);
+        if (ply < 255) last[ply+1] = NULL;
+    }
+}
+
+/*
+ * Move indexes: the SAN (or the squares) is looked up in the generated moves,
+ * the first one is taken (promotions are generated 4 times)
+ */
+
+int find_move(Decoder *d, Tree *t, int turn) {
+    if (!t->san[0]) {
+        // the same index as in the original book, if it's the same move (promotions)
+        if (t->move_indx > 0 && t->move_indx <= d->nb_moves
+         && d->moves[t->move_indx-1].from == t->move.from && d->moves[t->move_indx-1].to == t->move.to) return t->move_indx;
+        for (int i = 0; i < d->nb_moves; i++)
+            if (d->moves[i].from == t->move.from && d->moves[i].to == t->move.to) return i+1;
+        return 0;
+    }
+    return find_san(d, t->san, turn);
+}
+
+// the same move can appear twice (Nd2 and Nbd2...): the variations are merged
+void merge(Tree *into, Tree *t) {
+    into->recommended |= t->recommended;
+    into->files |= t->files;
+    Tree *child = t->first_child;
+    while (child) {
+        Tree *next = child->next;
+        Tree *same = NULL;
+        for (Tree *c = into->first_child; c && !same; c = c->next)
+            if (!c->sub_book[0] && !child->sub_book[0] && c->move_indx && c->move_indx == child->move_indx) same = c;
+        if (same) { merge(same, child); free(child); }
+        else {
+            child->next = NULL;
+            if (into->last_child) into->last_child->next = child;
+            else                  into->first_child = child;
+            into->last_child = child;
+        }
+        child = next;
+    }
+}
+
+void resolve(Decoder *d, Tree *position, int depth, Move last) {
+    int turn = depth % 2 ? BLACK : WHITE;
+    search_moves(d, turn, last);
+    for (Tree *t = position->first_child, *prev = NULL; t; ) {
+        if (t->sub_book[0]) { prev = t; t = t->next; continue; }
+        t->move_indx = find_move(d, t, turn);
+        if (t->move_indx == 0 || t->move_indx > 0x3F) {
+            fprintf(stderr, "move %s at ply %d: %s, dropped\n", t->san[0] ? t->san : "?", depth + 1,
+                    t->move_indx ? "index too big" : "not found");
+            nb_errors++;
+            Tree *next = t->next;
+            if (prev) prev->next = next; else position->first_child = next;
+            if (position->last_child == t) position->last_child = prev;
+            t = next;
+            continue;
+        }
+        t->move = d->moves[t->move_indx-1];
+        Tree *same = NULL;
+        for (Tree *c = position->first_child; c != t && !same; c = c->next)
+            if (!c->sub_book[0] && c->move_indx == t->move_indx) same = c;
+        if (same) {
+            Tree *next = t->next;
+            prev->next = next;
+            if (position->last_child == t) position->last_child = prev;
+            t->next = NULL;
+            merge(same, t);
+            free(t);
+            t = next;
+            continue;
+        }
+        prev = t;
+        t = t->next;
+    }
+    for (Tree *t = position->first_child; t; t = t->next) {
+        if (t->sub_book[0] || !t->first_child) continue;
+        Undo undo = do_move(d, t->move);
+        resolve(d, t, depth + 1, t->move);
+        undo_move(d, undo);
+    }
+}
+
+/*
+ * Writing: a leaf or a sub-book link ends a list, so it is written last
+ * (and only one of them can be kept)
+ */
+
+bool in_file(Tree *t, int file) { return file == ROOT || (t->files >> file & 1); }
+
+bool has_children(Tree *t, int file) {
+    for (Tree *c = t->first_child; c; c = c->next)
+        if (in_file(c, file)) return true;
+    return false;
+}
+
+// the lines after this move all go to a single ECO file
+int linked_file(Tree *t) {
+    uint64_t files = 0;
+    for (Tree *c = t->first_child; c; c = c->next) files |= c->files;
+    if (!split || !files || (files & (files - 1)) || (files & 1ULL << ROOT)) return ROOT;
+    return __builtin_ctzll(files);
+}
+
+void write_variations(Tree *position, int file, FILE *out) {
+    Tree *entries[64], *last = NULL;
+    int n = 0;
+    for (Tree *t = position->first_child; t; t = t->next) {
+        if (!in_file(t, file)) continue;
+        if (t->sub_book[0] || !has_children(t, file)) {
+            if (last) nb_dropped++;
+            else last = t;
+        }
+        else if (n < 63) entries[n++] = t;
+        else nb_dropped++;
+    }
+    if (last) entries[n++] = last;
+
+    for (int i = 0; i < n; i++) {
+        Tree *t = entries[i];
+        bool more = i < n-1;
+        if (t->sub_book[0]) {
+            putc(0xC5, out);
+            fprintf(out, "%-4.4s", t->sub_book);
+            return;
+        }
+        if (!has_children(t, file)) { putc(0x40 | t->move_indx, out); return; }
+        if (more && t->recommended) { putc(0xC0, out); putc(t->move_indx, out); }
+        else putc((more ? 0x80 : 0x00) | t->move_indx, out);
+
+        int link = file == ROOT ? linked_file(t) : ROOT;
+        if (link != ROOT) { putc(0xC5, out); fprintf(out, "%s", file_names[link]); }
+        else write_variations(t, file, out);
+    }
+}
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-o b000_file] [-n] repertoire_file...\n", name);
+    fprintf(stderr, "  -o : root book (default: b000#0x1000.BIN), ECO files are written in the same directory\n");
+    fprintf(stderr, "  -n : don't split after the ECO tags, everything goes to the root book\n");
+    fprintf(stderr, "  files ending with .json are JSON lines (book_decoder -f json), the others PGN\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = "b000#0x1000.BIN";
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "-o") == 0 && arg+1 < argc) output = argv[++arg];
+        else if (strcmp(argv[arg], "-n") == 0) split = false;
+        else usage(argv[0]);
+    }
+    if (arg == argc) usage(argv[0]);
+
+    for (; arg < argc; arg++) {
+        FILE *in = fopen(argv[arg], "r");
+        if (!in) { fprintf(stderr, "%s not found\n", argv[arg]); exit(1); }
+        int len = strlen(argv[arg]);
+        if (len > 5 && strcmp(argv[arg] + len - 5, ".json") == 0) read_json(in);
+        else read_pgn(in);
+        fclose(in);
+    }
+
+    init_tables();
+    Decoder decoder, *d = &decoder;
+    init_decoder(d);
+    Move none = { 0, 0 };
+    resolve(d, &root, 0, none);
+
+    char directory[1024] = "";
+    const char *slash = strrchr(output, '/');
+    if (slash) snprintf(directory, sizeof directory, "%.*s", (int)(slash - output + 1), output);
+    for (int file = 0; file < nb_files; file++) {
+        char name[1100];
+        if (file == ROOT) snprintf(name, sizeof name, "%s", output);
+        else {
+            snprintf(name, sizeof name, "%s%s#0x1000.BIN", directory, file_names[file]);
+            for (char *c = name + strlen(directory); *c && *c != '#'; c++) *c = tolower(*c);
+        }
+        FILE *out = fopen(name, "wb");
+        if (!out) { fprintf(stderr, "can't create %s\n", name); exit(1); }
+        write_variations(&root, file, out);
+        printf("%s: %ld bytes\n", name, ftell(out));
+        fclose(out);
+    }
+    if (nb_dropped) fprintf(stderr, "%d leaves or links dropped (only one per position)\n", nb_dropped);
+    printf("%d lines read\n", nb_lines);
+    return nb_errors ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * Book cursors, see book_cursor.h
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "book_cursor.h"
+
+static void set_book(Book_cursor *c, int book) {
+    c->book = book;
+    c->d.book  = c->library->books[book].loader.book;
+    c->d.index = c->library->books[book].loader.index;
+}
+
+void init_cursor(Book_cursor *c, const Library *l) {
+    c->library = l;
+    init_decoder(&c->d);
+    c->turn = WHITE;
+    c->last = (Move){ 0, 0 };
+    c->plies = c->book_plies = 0;
+    c->found_indx = 0;
+    c->followed = 1;
+    c->offset = EMPTY;
+    c->in_book = l->nb_books > 0;
+    if (c->in_book) set_book(c, 0);
+    c->d.book_indx = 0;
+}
+
+// C5 entry among the variations of the position, or EMPTY (it is always the last one)
+static int find_link(Book_cursor *c) {
+    int entry = c->d.book_indx;
+    for (int n = c->d.index->nb_variations[entry]; n > 0; n--, entry = c->d.index->end[entry])
+        if (is_link(&c->d.book, entry)) return entry;
+    return EMPTY;
+}
+
+// the variations of the position are in an ECO file, which starts from the initial position:
+// the book moves of the game are followed there first
+static bool follow_link(Book_cursor *c, int link) {
+    char name[5];
+    link_name(&c->d.book, link, name);
+    int book = find_book(c->library, name), entry;
+    c->in_book = false;
+    if (book == EMPTY || book == c->book || follow_line(c->library, book, &c->d, c->path, c->book_plies, &entry, &c->followed) != OK)
+        return false;
+    c->book = book;
+    if (c->book_plies > 0) c->offset = entry;
+    c->in_book = c->d.book_indx != EMPTY;
+    return c->in_book;
+}
+
+bool play_move(Book_cursor *c, Move m) {
+    Decoder *d = &c->d;
+    bool book_move = false;
+    if (c->in_book && c->book_plies < MAX_BOOK_PLIES) {
+        bool found = c->found_indx && c->found.from == m.from && c->found.to == m.to;
+        int move_indx = found ? c->found_indx : move_index(d, c->turn, c->last, m);
+        int entry = move_indx ? find_variation(d, move_indx) : EMPTY;
+        if (entry == EMPTY) {   // maybe in the ECO file of the position
+            int link = find_link(c);
+            if (link != EMPTY && follow_link(c, link) && move_indx) entry = find_variation(d, move_indx);
+        }
+        if (entry != EMPTY) {
+            int flags = byte_at(&d->book, entry) & 0xC0;
+            if (flags == 0xC0) entry++;
+            c->path[c->book_plies++] = move_indx;
+            c->offset = entry;
+            c->in_book = flags != 0x40;
+            d->book_indx = entry + 1;
+            c->followed = 1ULL << c->book;
+            // LA49E: the variations of the new position are in another file
+            if (c->in_book && is_link(&d->book, d->book_indx)) follow_link(c, d->book_indx);
+            book_move = true;
+        }
+        else c->in_book = false;
+    }
+    else c->in_book = false;
+
+    do_move(d, m);
+    c->found_indx = 0;
+    c->last = m;
+    c->turn ^= BLACK;
+    c->plies++;
+    return book_move;
+}
+
+int find_move(Book_cursor *c, const char *san, Move *m) {
+    search_moves(&c->d, c->turn, c->last);
+    int move_indx = find_san(&c->d, san, c->turn);
+    if (!move_indx) return ERROR;
+    *m = c->found = c->d.moves[move_indx-1];
+    c->found_indx = move_indx;
+    return OK;
+}
+
+// the variation of choose_variation() (LA52E), in the ECO file if it is the C5 entry
+bool choose_book_move(Book_cursor *c, int random, bool all_variations, Move *m) {
+    Decoder *d = &c->d;
+    if (!c->in_book) return false;
+    int entry = choose_variation(d, random, all_variations);
+    if (is_link(&d->book, entry)) {
+        if (!follow_link(c, entry)) return false;
+        entry = choose_variation(d, random, all_variations);
+        if (is_link(&d->book, entry)) return false;
+    }
+    if ((byte_at(&d->book, entry) & 0xC0) == 0xC0) entry++;
+    int move_indx = byte_at(&d->book, entry) & 0x3F;
+    if (!move_indx || !generate_moves(d, c->turn, c->last, move_indx)) return false;
+    *m = d->moves[move_indx-1];
+    return true;
+}
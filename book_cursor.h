@@ -0,0 +1,45 @@
+#ifndef BOOK_CURSOR_H
+#define BOOK_CURSOR_H
+
+/*
+ * Following a game in the Openings Library move by move, like Sargon does with the pointer $16
+ * (set again from $BA after each move): the played move is looked up among the variations of
+ * the position (LA473, the other branches being skipped through the index like LA4CD), and when
+ * they go on in an ECO file (C5 entry, LA49E), the book moves of the game are followed again in
+ * this file from the initial position. A move costs the generation up to its index and the
+ * variations of the position, never a walk from the root of the book.
+ *
+ * The Library (book_library.h) is only read: any number of cursors, in any number of threads, can
+ * share it. A cursor is a plain value (the position, the book, the offset and the book moves of
+ * the game), so it is copied with an assignment to fork an analysis from a game.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sargon.h"
+#include "book_library.h"
+
+#define MAX_BOOK_PLIES  256
+
+typedef struct {
+    const Library *library;
+    Decoder   d;                // the position, and the variations of the book (d.book_indx)
+    int       turn;
+    Move      last;
+    int       plies;            // moves played
+    int       book;             // in library->books: where the last book move is (or the file it linked to)
+    int       offset;           // of the last book move in this book, EMPTY if none yet
+    bool      in_book;          // the position has variations in the book
+    int       book_plies;       // moves of the game found in the book
+    uint8_t   path[MAX_BOOK_PLIES];  // their indexes, to follow them in the ECO files
+    uint64_t  followed;         // the books they were followed in for this position (follow_line)
+    Move      found;            // the last move of find_move(), and its index, so that it isn't generated again
+    int       found_indx;
+} Book_cursor;
+
+void init_cursor(Book_cursor *c, const Library *l);    // initial position, at the root of B000
+bool play_move(Book_cursor *c, Move m);     // a legal move of the position, true if it is a book move
+int  find_move(Book_cursor *c, const char *san, Move *m);  // OK, or ERROR if the SAN isn't a move of the position
+bool choose_book_move(Book_cursor *c, int random, bool all_variations, Move *m);  // LA507, false if out of the book
+
+#endif
@@ -0,0 +1,406 @@
+/*
+ * Transposition-aware compaction of the Openings Library: B000 and every ECO file it refers to
+ * (C5 entries), loaded as a Library (book_library.h), are decoded into a single tree, as book_export
+ * walks them, and the tree is stored as a DAG: two subtrees are a single node if their positions
+ * have the same key (search.c) and their moves lead to the same nodes. The lines reached by several move orders, or copied in
+ * several ECO files, are thus stored once, and the whole library is held in a few arrays.
+ *
+ * The DAG file has the nodes sorted by key, so that the variations of a position are found
+ * with a binary search in the mapped file, without expanding anything:
+ *   "SDG1", number of nodes (4 bytes), of moves (4), root node (4), little endian
+ *   nodes: key (8), first move (4), number of moves (1)
+ *   moves: node after the move (4, 0 at the end of a line), from (1), to (1), move index (1, bit 7: recommended)
+ *
+ *   cc -O2 -o book_dag book_dag.c search.c book_library.c sargon.c book_file.c trace.c
+ *   book_dag [-o dag_file] b000#0x1000.BIN
+ *   book_dag -p dag_file [fen | moves...]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "search.h"
+#include "book_library.h"
+
+#define INITIAL_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define MAX_VARIATIONS 64       // 6 bit move indexes
+#define NODE_SIZE   13          // in the DAG file
+#define EDGE_SIZE   7
+#define HEADER_SIZE 16
+
+typedef struct {                // a move of the book, to the node of the position after it
+    uint32_t child;             // 0: end of the line
+    uint8_t  from, to;
+    uint8_t  move_indx;         // in the generator order, as in the book
+    uint8_t  recommended;
+} Edge;
+
+typedef struct {                // a position and its variations, shared by all the lines reaching it
+    uint64_t key;               // of the position, 0 for node 0 (no more moves)
+    uint32_t first_edge;
+    uint8_t  nb_edges;
+} Dag_node;
+
+Dag_node *nodes;
+Edge     *edges;
+int       nb_nodes, node_capacity, nb_edges, edge_capacity;
+uint32_t *table;                // open addressing on the nodes, 0 for a free slot
+uint64_t  table_mask;
+long      nb_positions, nb_moves, nb_shared, nb_errors;   // of the decoded tree
+
+Library   library;
+uint8_t   path[MAX_DEPTH];      // move indexes from the initial position, for the ECO files
+uint64_t  followed;             // ECO files the line of the position was followed in
+
+uint64_t node_hash(uint64_t key, const Edge *list, int nb) {
+    uint64_t h = key;
+    for (int i = 0; i < nb; i++) {
+        uint64_t e = list[i].child | (uint64_t)list[i].from << 32 | (uint64_t)list[i].to << 40
+                   | (uint64_t)list[i].move_indx << 48 | (uint64_t)list[i].recommended << 56;
+        h = (h ^ e) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+bool same_node(const Dag_node *n, uint64_t key, const Edge *list, int nb) {
+    return n->key == key && n->nb_edges == nb && memcmp(edges + n->first_edge, list, nb * sizeof *list) == 0;
+}
+
+void grow_table(void) {
+    uint64_t size = table_mask ? 2 * (table_mask + 1) : 1 << 16;
+    free(table);
+    table = calloc(size, sizeof *table);
+    table_mask = size - 1;
+    for (int i = 1; i < nb_nodes; i++) {
+        const Dag_node *n = &nodes[i];
+        uint64_t slot = node_hash(n->key, edges + n->first_edge, n->nb_edges) & table_mask;
+        while (table[slot]) slot = (slot + 1) & table_mask;
+        table[slot] = i;
+    }
+}
+
+// the node of this position with these moves, a new one only if there isn't the same already
+uint32_t add_node(uint64_t key, const Edge *list, int nb) {
+    if (nb == 0) return 0;
+    if (2 * (uint64_t)nb_nodes >= table_mask) grow_table();
+    uint64_t slot = node_hash(key, list, nb) & table_mask;
+    for (; table[slot]; slot = (slot + 1) & table_mask)
+        if (same_node(&nodes[table[slot]], key, list, nb)) {
+            nb_shared++;
+            return table[slot];
+        }
+
+    if (nb_edges + nb > edge_capacity) {
+        edge_capacity = 2 * edge_capacity + nb;
+        edges = realloc(edges, edge_capacity * sizeof *edges);
+    }
+    if (nb_nodes == node_capacity) {
+        node_capacity = 2 * node_capacity + 1;
+        nodes = realloc(nodes, node_capacity * sizeof *nodes);
+    }
+    memcpy(edges + nb_edges, list, nb * sizeof *list);
+    nodes[nb_nodes] = (Dag_node){ key, nb_edges, nb };
+    nb_edges += nb;
+    table[slot] = nb_nodes;
+    return nb_nodes++;
+}
+
+void walk_variations(Decoder *d, Game *g, int depth, Edge *list, int *nb);
+
+// C5 entry: the variations of this position are in an ECO file, where the same moves are
+// followed first (follow_line)
+void walk_sub_book(Decoder *d, Game *g, int depth, Edge *list, int *nb) {
+    char name[5];
+    link_name(&d->book, d->book_indx, name);
+    d->book_indx += 5;
+
+    int sub_book = find_book(&library, name), entry;
+    if (sub_book == EMPTY || library.books[sub_book].loader.book.data == d->book.data) return;
+
+    Book_file book = d->book;
+    const Book_index *index = d->index;
+    int book_indx = d->book_indx;
+    if (follow_line(&library, sub_book, d, path, depth, &entry, &followed) != OK) {
+        nb_errors++;
+        return;
+    }
+    if (d->book_indx != EMPTY) walk_variations(d, g, depth, list, nb);
+
+    d->book = book;
+    d->index = index;
+    d->book_indx = book_indx;
+}
+
+// the node of the position reached, after the nodes of all its variations
+uint32_t position_node(Decoder *d, Game *g, int depth) {
+    Edge list[MAX_VARIATIONS];
+    int nb = 0;
+    uint64_t parent_followed = followed;
+    followed = 0;
+    nb_positions++;
+    walk_variations(d, g, depth, list, &nb);
+    followed = parent_followed;
+    return add_node(g->key, list, nb);
+}
+
+// same walk as decode_variations(), the moves of the position are added to the list
+void walk_variations(Decoder *d, Game *g, int depth, Edge *list, int *nb) {
+    int flags;
+    do {
+        flags = byte_at(&d->book, d->book_indx) & 0xC0;
+        if (flags == 0xC0) {
+            if (byte_at(&d->book, d->book_indx) & 7) { walk_sub_book(d, g, depth, list, nb); break; }
+            d->book_indx += 1;
+        }
+        int move_indx = byte_at(&d->book, d->book_indx) & 0x3F;
+        if (move_indx == 0 || depth == MAX_DEPTH) break;
+
+        if (*nb == MAX_VARIATIONS || !generate_moves(d, g->turn, g->last, move_indx)) {
+            fprintf(stderr, "%05x: move %02x of %02x\n", d->book_indx, move_indx, d->nb_moves);
+            nb_errors++;
+            break;
+        }
+        Move m = d->moves[move_indx-1];
+        path[depth] = move_indx;
+        d->book_indx++;
+        nb_moves++;
+
+        Edge e = { 0, m.from, m.to, move_indx, flags == 0xC0 };
+        if (flags != 0x40) {
+            Played played = make_move(g, m);
+            e.child = position_node(d, g, depth + 1);
+            unmake_move(g, &played);
+        }
+        list[(*nb)++] = e;
+    } while (flags & 0x80);
+}
+
+/*
+ * DAG file
+ */
+
+uint32_t *new_number;           // of the nodes, once sorted by key
+
+int compare_nodes(const void *a, const void *b) {
+    const Dag_node *n1 = &nodes[*(const uint32_t *)a], *n2 = &nodes[*(const uint32_t *)b];
+    if (n1->key != n2->key) return n1->key < n2->key ? -1 : 1;
+    return n1 < n2 ? -1 : n1 > n2;
+}
+
+void put(FILE *f, uint64_t value, int size) {
+    for (int i = 0; i < size; i++) fputc(value >> 8 * i & 0xFF, f);
+}
+
+int save_dag(const char *name, uint32_t root) {
+    uint32_t *order = malloc(nb_nodes * sizeof *order);
+    new_number = malloc(nb_nodes * sizeof *new_number);
+    for (int i = 0; i < nb_nodes; i++) order[i] = i;
+    qsort(order + 1, nb_nodes - 1, sizeof *order, compare_nodes);  // node 0 stays first
+    for (int i = 0; i < nb_nodes; i++) new_number[order[i]] = i;
+
+    FILE *f = fopen(name, "wb");
+    if (!f) return ERROR;
+    fwrite("SDG1", 1, 4, f);
+    put(f, nb_nodes, 4);
+    put(f, nb_edges, 4);
+    put(f, new_number[root], 4);
+    int first_edge = 0;
+    for (int i = 0; i < nb_nodes; i++) {
+        const Dag_node *n = &nodes[order[i]];
+        put(f, n->key, 8);
+        put(f, first_edge, 4);
+        put(f, n->nb_edges, 1);
+        first_edge += n->nb_edges;
+    }
+    for (int i = 0; i < nb_nodes; i++) {
+        const Dag_node *n = &nodes[order[i]];
+        for (int j = 0; j < n->nb_edges; j++) {
+            const Edge *e = &edges[n->first_edge + j];
+            put(f, new_number[e->child], 4);
+            put(f, e->from, 1);
+            put(f, e->to, 1);
+            put(f, e->move_indx | (e->recommended ? 0x80 : 0), 1);
+        }
+    }
+    free(order);
+    return fclose(f) == 0 ? OK : ERROR;
+}
+
+typedef struct {
+    Book_file file;
+    uint32_t  nb_nodes, nb_edges, root;
+} Dag;
+
+uint64_t get(const Book_file *f, long pos, int size) {
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++) value |= (uint64_t)byte_at(f, pos + i) << 8 * i;
+    return value;
+}
+
+int load_dag(Dag *dag, const char *name) {
+    if (map_book(&dag->file, name) != OK) return ERROR;
+    dag->nb_nodes = get(&dag->file, 4, 4);
+    dag->nb_edges = get(&dag->file, 8, 4);
+    dag->root     = get(&dag->file, 12, 4);
+    if (dag->file.size < HEADER_SIZE || memcmp(dag->file.data, "SDG1", 4) != 0
+     || dag->file.size != HEADER_SIZE + (uint64_t)dag->nb_nodes * NODE_SIZE + (uint64_t)dag->nb_edges * EDGE_SIZE) {
+        unmap_book(&dag->file);
+        return ERROR;
+    }
+    return OK;
+}
+
+Dag_node node_at(const Dag *dag, uint32_t i) {
+    long pos = HEADER_SIZE + (long)i * NODE_SIZE;
+    return (Dag_node){ get(&dag->file, pos, 8), get(&dag->file, pos + 8, 4), get(&dag->file, pos + 12, 1) };
+}
+
+Edge edge_at(const Dag *dag, uint32_t i) {
+    long pos = HEADER_SIZE + (long)dag->nb_nodes * NODE_SIZE + (long)i * EDGE_SIZE;
+    int indx = get(&dag->file, pos + 6, 1);
+    return (Edge){ get(&dag->file, pos, 4), get(&dag->file, pos + 4, 1), get(&dag->file, pos + 5, 1), indx & 0x3F, indx >> 7 };
+}
+
+// first node of the position, nb_nodes if not in the book
+uint32_t find_node(const Dag *dag, uint64_t key) {
+    uint32_t low = 1, high = dag->nb_nodes;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (node_at(dag, middle).key < key) low = middle + 1;
+        else high = middle;
+    }
+    return low < dag->nb_nodes && node_at(dag, low).key == key ? low : dag->nb_nodes;
+}
+
+// the position is a FEN, or moves from the initial position
+int set_position(Game *g, Decoder *d, int nb_args, char **args) {
+    if (nb_args == 1 && strchr(args[0], '/')) return init_game(g, d, args[0]);
+    init_game(g, d, INITIAL_FEN);
+    for (int i = 0; i < nb_args; i++) {
+        search_moves(d, g->turn, g->last);
+        int move_indx = find_san(d, args[i], g->turn);
+        if (move_indx == 0) {
+            fprintf(stderr, "%s: not a move\n", args[i]);
+            return ERROR;
+        }
+        play_move(g, d->moves[move_indx-1]);
+    }
+    return OK;
+}
+
+// the moves of all the nodes of the position (they differ if it was reached with different variations)
+void probe(const Dag *dag, Game *g) {
+    Decoder *d = g->d;
+    search_moves(d, g->turn, g->last);
+    Move found[MAX_VARIATIONS];
+    int nb_found = 0, nb_contexts = 0;
+    for (uint32_t i = find_node(dag, g->key); i < dag->nb_nodes; i++) {
+        Dag_node n = node_at(dag, i);
+        if (n.key != g->key) break;
+        nb_contexts++;
+        for (int j = 0; j < n.nb_edges; j++) {
+            Edge e = edge_at(dag, n.first_edge + j);
+            Move m = { e.from, e.to };
+            bool known = false;
+            for (int k = 0; k < nb_found; k++) known |= found[k].from == m.from && found[k].to == m.to;
+            if (known || nb_found == MAX_VARIATIONS) continue;
+            found[nb_found++] = m;
+            char san[10];
+            san_move(d, m, san);
+            printf("%s%s\t%d\n", san, e.recommended ? "!" : "", e.move_indx);
+        }
+    }
+    if (nb_contexts == 0) printf("not in the book\n");
+    else if (nb_contexts > 1) printf("(%d different repertoires of this position)\n", nb_contexts);
+}
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-o dag_file] opening_book_file\n", name);
+    fprintf(stderr, "       %s -p dag_file [fen | moves...]\n", name);
+    fprintf(stderr, "  -o : DAG file to write (default: sargon.dag)\n");
+    fprintf(stderr, "  -p : prints the book moves of the position (default: the initial position)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *dag_name = "sargon.dag";
+    bool probing = false;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "-o") == 0 && arg+1 < argc) dag_name = argv[++arg];
+        else if (strcmp(argv[arg], "-p") == 0 && arg+1 < argc) { dag_name = argv[++arg]; probing = true; }
+        else usage(argv[0]);
+    }
+    if (probing ? arg > argc : argc - arg != 1) usage(argv[0]);
+
+    init_tables();
+    static Decoder decoder;
+    Decoder *d = &decoder;
+    init_decoder(d);
+    static Game game;
+
+    if (probing) {
+        Dag dag;
+        if (load_dag(&dag, dag_name) != OK) {
+            fprintf(stderr, "%s: not a DAG file\n", dag_name);
+            exit(1);
+        }
+        if (set_position(&game, d, argc - arg, argv + arg) != OK) {
+            fprintf(stderr, "bad position\n");
+            exit(1);
+        }
+        probe(&dag, &game);
+        unmap_book(&dag.file);
+        return 0;
+    }
+
+    if (open_library(&library, argv[arg]) != OK) {
+        fprintf(stderr, "%s not found\n", argv[arg]);
+        exit(1);
+    }
+
+    init_game(&game, d, INITIAL_FEN);
+    d->book  = library.books[0].loader.book;
+    d->index = library.books[0].loader.index;
+    d->book_indx = 0;
+    nodes = malloc(sizeof *nodes);
+    nodes[0] = (Dag_node){ 0, 0, 0 };
+    nb_nodes = node_capacity = 1;
+    uint32_t root = position_node(d, &game, 0);
+
+    if (save_dag(dag_name, root) != OK) {
+        fprintf(stderr, "can't create %s\n", dag_name);
+        exit(1);
+    }
+
+    // size report
+    long book_size = 0;
+    int nb_files = 0;
+    for (int i = 0; i < library.nb_books; i++)
+        if (!library.books[i].missing) {
+            book_size += library.books[i].loader.book.size;
+            nb_files++;
+        }
+    int nb_keys = 0, nb_joins = 0;
+    int *nb_parents = calloc(nb_nodes, sizeof *nb_parents);
+    for (int i = 0; i < nb_edges; i++) nb_parents[edges[i].child]++;
+    for (int i = 1; i < nb_nodes; i++) nb_joins += nb_parents[i] > 1;
+    uint32_t *order = malloc(nb_nodes * sizeof *order);
+    for (int i = 0; i < nb_nodes; i++) order[new_number[i]] = i;
+    for (int i = 1; i < nb_nodes; i++) nb_keys += i == 1 || nodes[order[i]].key != nodes[order[i-1]].key;  // in the order of the file
+
+    long tree_bytes = nb_positions * sizeof(Dag_node) + nb_moves * sizeof(Edge);
+    long dag_bytes  = (nb_nodes - 1) * sizeof(Dag_node) + nb_edges * sizeof(Edge);
+    long file_bytes = HEADER_SIZE + (long)nb_nodes * NODE_SIZE + (long)nb_edges * EDGE_SIZE;
+    printf("books:\t%d files\t%ld bytes\n", nb_files, book_size);
+    printf("tree:\t%ld positions\t%ld moves\t%ld bytes\n", nb_positions, nb_moves, tree_bytes);
+    printf("dag:\t%d nodes\t%d moves\t%ld bytes\t%.1f%%\n", nb_nodes - 1, nb_edges, dag_bytes, 100.0 * dag_bytes / tree_bytes);
+    printf("%s:\t%ld bytes\n", dag_name, file_bytes);
+    printf("%ld subtrees already in the DAG, %d nodes reached by several lines, %d positions (%d with several repertoires)\n",
+           nb_shared, nb_joins, nb_keys, nb_nodes - 1 - nb_keys);
+    if (nb_errors) printf("%ld errors\n", nb_errors);
+
+    close_library(&library);
+    return nb_errors ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Board diagrams of the positions of book files, drawn like Sargon does on the HGR screen
+ * (hgr.h): one for the initial position, then one after every move of the book, in the order
+ * of book_decoder. Between two diagrams only the squares whose piece changed are drawn again.
+ *
+ * With -f png, every diagram is a file of the output directory named after the book and the
+ * offset of the move (b000_00012.png, b000_start.png for the initial position). With -f raw,
+ * the diagrams of a book are written one after the other in a single file (b000.raw) as
+ * 280x192 grey pixels of one byte, e.g. for ffmpeg -f rawvideo -pix_fmt gray -s 280x192.
+ *
+ *   cc -O2 -o book_diagram book_diagram.c hgr.c listing.c sargon.c book_file.c trace.c
+ *   book_diagram [-l listing] [-o directory] [-f png|raw] [-r] opening_book_file...
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sargon.h"
+#include "hgr.h"
+#include "trace.h"
+
+enum Formats { PNG, RAW };
+
+typedef struct {
+    Hgr_screen  screen;
+    const char *directory;
+    char        name[64];       // of the book, for the file names
+    FILE       *raw;
+    long        nb_diagrams;
+    int         status;
+} Diagrams;
+
+Listing  listing;
+Diagrams diagrams;
+int      format = PNG;
+
+void write_diagram(Decoder *d, const char *suffix) {
+    Diagrams *g = d->emitter_state;
+    draw_board(&g->screen, d);
+    update_frame(&g->screen);
+    g->nb_diagrams++;
+    if (format == RAW) {
+        if (g->raw && fwrite(g->screen.pixels, sizeof g->screen.pixels, 1, g->raw) != 1) g->status = ERROR;
+        return;
+    }
+    static uint8_t png[HGR_PNG_SIZE];
+    size_t size = write_png(&g->screen, png);
+    char file_name[1200];
+    snprintf(file_name, sizeof file_name, "%s/%s_%s.png", g->directory, g->name, suffix);
+    FILE *file = fopen(file_name, "wb");
+    if (!file || fwrite(png, 1, size, file) != size) g->status = ERROR;
+    if (file && fclose(file) != 0) g->status = ERROR;
+}
+
+void diagram_begin_book(Decoder *d) {
+    Diagrams *g = d->emitter_state;
+    if (format == RAW) {
+        char file_name[1200];
+        snprintf(file_name, sizeof file_name, "%s/%s.raw", g->directory, g->name);
+        g->raw = fopen(file_name, "wb");
+        if (!g->raw) g->status = ERROR;
+    }
+    write_diagram(d, "start");
+}
+
+// the position after the move
+void diagram_node(Decoder *d, const Node *n) {
+    if (n->kind != MOVE_NODE) return;
+    char offset[16];
+    snprintf(offset, sizeof offset, "%05x", n->offset);
+    write_diagram(d, offset);
+}
+
+void diagram_end_book(Decoder *d) {
+    Diagrams *g = d->emitter_state;
+    if (g->raw && fclose(g->raw) != 0) g->status = ERROR;
+    g->raw = NULL;
+}
+
+const Emitter diagram_emitter = { "diagram", false, false, diagram_begin_book, diagram_node, diagram_end_book };
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-l listing] [-o directory] [-f png|raw] [-r] opening_book_file...\n", name);
+    fprintf(stderr, "  -l : the listing with the graphics (default: sargon3_disassembly.txt)\n");
+    fprintf(stderr, "  -o : where the diagrams are written (default: .)\n");
+    fprintf(stderr, "  -f : a PNG file per diagram, or all the diagrams of a book as raw grey pixels\n");
+    fprintf(stderr, "  -r : the board seen from the black side\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *listing_name = "sargon3_disassembly.txt";
+    const char *directory = ".";
+    bool reversed = false;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "-l") == 0 && arg+1 < argc) listing_name = argv[++arg];
+        else if (strcmp(argv[arg], "-o") == 0 && arg+1 < argc) directory = argv[++arg];
+        else if (strcmp(argv[arg], "-f") == 0 && arg+1 < argc) {
+            arg++;
+            if      (strcmp(argv[arg], "png") == 0) format = PNG;
+            else if (strcmp(argv[arg], "raw") == 0) format = RAW;
+            else usage(argv[0]);
+        }
+        else if (strcmp(argv[arg], "-r") == 0) reversed = true;
+        else usage(argv[0]);
+    }
+    if (arg == argc) usage(argv[0]);
+
+    if (open_listing(&listing, listing_name) != OK) {
+        fprintf(stderr, "%s not found\n", listing_name);
+        exit(1);
+    }
+    Diagrams *g = &diagrams;
+    if (init_hgr(&g->screen, &listing, reversed) != OK) {
+        fprintf(stderr, "%s: the graphics of $88D9-$8E80 are missing\n", listing_name);
+        exit(1);
+    }
+    free_listing(&listing);
+    g->directory = directory;
+
+    init_tables();
+    static Decoder decoder;
+    Decoder *d = &decoder;
+    init_decoder(d);
+    d->emitter = &diagram_emitter;
+    d->emitter_state = g;
+
+    int status = OK;
+    double start = trace_now();
+    for (; arg < argc; arg++) {
+        if (init_book(d, argv[arg]) != OK) {
+            fprintf(stderr, "%s not found\n", argv[arg]);
+            status = ERROR;
+            continue;
+        }
+        book_name(argv[arg], g->name, sizeof g->name);
+        g->status = OK;
+        decode_book(d);
+        close_book(d);
+        if (g->status != OK) {
+            fprintf(stderr, "%s: can't write the diagrams in %s\n", argv[arg], directory);
+            status = ERROR;
+        }
+    }
+    double seconds = trace_now() - start;
+    fprintf(stderr, "%ld diagrams, %.1f squares drawn per diagram, %.2f s, %.0f diagrams per minute\n",
+            g->nb_diagrams, g->nb_diagrams ? (double)g->screen.nb_squares_drawn / g->nb_diagrams : 0.0,
+            seconds, seconds > 0 ? 60 * g->nb_diagrams / seconds : 0.0);
+    return status == OK ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+/*
+ * Scores the leaves of book files with the static evaluation of sargon.c (evaluation()), to find
+ * the dubious lines. The books are decoded as by book_decoder, and the evaluation is kept up to
+ * date by the moves of the decoder, so a leaf costs no more than its move.
+ *
+ * A leaf is a move without variations after it (flags $40), or the end of a book (null move
+ * index), scored in the position after the previous move. The links to other books (C5) aren't
+ * leaves, the linked books have to be scored too.
+ *
+ *   cc -O2 -o book_eval book_eval.c sargon.c book_file.c trace.c
+ *   book_eval [-t pawns] [-d] opening_book_file...
+ *
+ * One tab separated line per leaf: book, offset of the move in the book, plies, score in pawns
+ * (white minus black), '?' if the score is at least the threshold (-t, 1.5 pawns by default)
+ * for one side, and the moves from the beginning of the book. With -d, only the dubious leaves
+ * are printed. The number of leaves and the leaves per second are printed on stderr at the end.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sargon.h"
+#include "trace.h"
+
+
+typedef struct {
+    char   name[64];            // of the book
+    char   san[MAX_DEPTH][10];  // moves of the line, by depth
+    int    threshold;           // in 1/256 pawn
+    bool   dubious_only;
+    long   nb_leaves, nb_dubious;
+} Scores;
+
+Scores scores;
+
+// the position is the one after the moves of the line, plies long
+void score_leaf(Decoder *d, int offset, int plies) {
+    Scores *s = d->emitter_state;
+    int score = evaluation(d);
+    bool dubious = abs(score) >= s->threshold;
+    s->nb_leaves++;
+    if (dubious) s->nb_dubious++;
+    if (s->dubious_only && !dubious) return;
+
+    fprintf(d->out, "%s\t%05x\t%d\t%+.2f\t%s\t", s->name, offset, plies, score / 256.0, dubious ? "?" : "");
+    for (int i = 0; i < plies && i < MAX_DEPTH; i++) {
+        if (i % 2 == 0) fprintf(d->out, "%d.", i / 2 + 1);
+        fprintf(d->out, "%s%s", s->san[i], i + 1 < plies ? " " : "");
+    }
+    fprintf(d->out, "\n");
+}
+
+void eval_node(Decoder *d, const Node *n) {
+    Scores *s = d->emitter_state;
+    switch (n->kind) {
+        case MOVE_NODE:
+            if (n->depth < MAX_DEPTH) strcpy(s->san[n->depth], n->san);
+            if (!n->recommended && (byte_at(&d->book, n->offset) & 0xC0) == 0x40) score_leaf(d, n->offset, n->depth + 1);
+            break;
+        case END_NODE:
+            score_leaf(d, n->offset, n->depth);
+            break;
+    }
+}
+
+void no_event(Decoder *d) { (void)d; }
+
+const Emitter eval_emitter = { "eval", true, false, no_event, eval_node, no_event };
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-t pawns] [-d] opening_book_file...\n", name);
+    fprintf(stderr, "  -t : score of a dubious leaf, for one side or the other (default: 1.5)\n");
+    fprintf(stderr, "  -d : only the dubious leaves\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    Scores *s = &scores;
+    double threshold = 1.5;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "-t") == 0 && arg+1 < argc) threshold = atof(argv[++arg]);
+        else if (strcmp(argv[arg], "-d") == 0) s->dubious_only = true;
+        else usage(argv[0]);
+    }
+    if (arg == argc || threshold <= 0) usage(argv[0]);
+    s->threshold = threshold * 256;
+
+    init_tables();
+    static Decoder decoder;
+    Decoder *d = &decoder;
+    init_decoder(d);
+    d->emitter = &eval_emitter;
+    d->emitter_state = s;
+
+    int status = OK;
+    double start = trace_now();
+    for (; arg < argc; arg++) {
+        if (init_book(d, argv[arg]) != OK) {
+            fprintf(stderr, "%s not found\n", argv[arg]);
+            status = ERROR;
+            continue;
+        }
+        book_name(argv[arg], s->name, sizeof s->name);
+        decode_book(d);
+        close_book(d);
+    }
+    double seconds = trace_now() - start;
+    fprintf(stderr, "%ld leaves, %ld dubious, %.2f s, %.0f leaves per second\n",
+            s->nb_leaves, s->nb_dubious, seconds, seconds > 0 ? s->nb_leaves / seconds : 0.0);
+    return status == OK ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+/*
+ * Exports the Openings Library to a Polyglot book: B000 and every ECO file it refers to (C5 entries),
+ * loaded as a Library (book_library.h), are walked like book_decoder does, each position gets its
+ * Polyglot Zobrist key, and the (key, move) entries are sorted and merged, so that transpositions
+ * between the ECO files end up as a single entry. Recommended moves get a higher weight.
+ *
+ * The keys need the 781 numbers of the Polyglot Random64 table, read from a text file
+ * (e.g. the C array of the Polyglot book format description, any 0x... hexadecimal numbers are taken).
+ *
+ *   cc -O2 -o book_export book_export.c book_library.c sargon.c book_file.c
+ *   book_export -k random64.txt b000#0x1000.BIN sargon.bin
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "book_library.h"
+
+#define RANDOM_CASTLE    768
+#define RANDOM_ENPASSANT 772
+#define RANDOM_TURN      780
+#define START_KEY        0x463B96181691FC9CULL  // Polyglot key of the initial position
+
+#define WEIGHT           1
+#define WEIGHT_RECOMMENDED 4
+
+enum Castles { WHITE_SHORT = 1, WHITE_LONG = 2, BLACK_SHORT = 4, BLACK_LONG = 8 };
+
+typedef struct {
+    uint64_t key;
+    uint16_t move;
+    uint16_t weight;
+} Entry;
+
+uint64_t random64[781];
+Entry   *entries;
+int      nb_entries, capacity;
+
+Library  library;
+uint8_t  path[MAX_DEPTH];       // move indexes from the initial position, for the ECO files
+uint64_t followed;              // ECO files the line of the position was followed in
+
+int load_random64(const char *name) {
+    FILE *file = fopen(name, "r");
+    if (!file) return ERROR;
+    int n = 0, c, previous = 0;
+    while (n < 781 && (c = getc(file)) != EOF) {
+        if (previous == '0' && (c == 'x' || c == 'X')) {
+            unsigned long long value;
+            if (fscanf(file, "%llx", &value) == 1) random64[n++] = value;
+            c = 0;
+        }
+        previous = c;
+    }
+    fclose(file);
+    return n == 781 ? OK : ERROR;
+}
+
+// see the Polyglot book format: black pawn, white pawn, black knight, ... white king
+uint64_t polyglot_key(Decoder *d, int turn, int castles, Move last) {
+    uint64_t key = 0;
+    for (int pos = 0; pos < 64; pos++) {
+        int pce = d->board[pos];
+        if (pce == EMPTY) continue;
+        int kind = 2 * d->piece_type[pce] + ((pce & BLACK) ? 0 : 1);
+        key ^= random64[64 * kind + pos];
+    }
+    for (int i = 0; i < 4; i++)
+        if (castles & (1 << i)) key ^= random64[RANDOM_CASTLE + i];
+
+    // en-passant only if a pawn can actually take
+    int pawn = d->board[last.to];
+    if (last.from != last.to && pawn != EMPTY && d->piece_type[pawn] == PAWN && abs(last.to - last.from) == 16) {
+        int x = last.to % 8;
+        for (int dx = -1; dx <= 1; dx += 2) {
+            if (x + dx < 0 || x + dx > 7) continue;
+            int pce = d->board[last.to + dx];
+            if (pce != EMPTY && (pce & BLACK) == turn && d->piece_type[pce] == PAWN) {
+                key ^= random64[RANDOM_ENPASSANT + x];
+                break;
+            }
+        }
+    }
+    if (turn == WHITE) key ^= random64[RANDOM_TURN];
+    return key;
+}
+
+// castles are encoded as the king taking its rook
+uint16_t polyglot_move(Decoder *d, Move m) {
+    int to = m.to;
+    int pce = d->board[m.from];
+    if (d->piece_type[pce] == KING && m.to == m.from + 2) to = m.from + 3;
+    if (d->piece_type[pce] == KING && m.to == m.from - 2) to = m.from - 4;
+    int promotion = d->piece_type[pce] == PAWN && (m.to >= 070 || m.to < 010) ? 4 : 0; // always a queen
+    return promotion << 12 | (m.from / 8) << 9 | (m.from % 8) << 6 | (to / 8) << 3 | (to % 8);
+}
+
+// a move from or to one of these squares loses the castle
+int castles_after(int castles, Move m) {
+    static const struct { int square, castles; } lost[] = {
+        { 004, WHITE_SHORT | WHITE_LONG }, { 007, WHITE_SHORT }, { 000, WHITE_LONG },
+        { 074, BLACK_SHORT | BLACK_LONG }, { 077, BLACK_SHORT }, { 070, BLACK_LONG }
+    };
+    for (int i = 0; i < 6; i++)
+        if (m.from == lost[i].square || m.to == lost[i].square) castles &= ~lost[i].castles;
+    return castles;
+}
+
+void add_entry(uint64_t key, uint16_t move, uint16_t weight) {
+    if (nb_entries == capacity) {
+        capacity = capacity ? 2 * capacity : 4096;
+        entries = realloc(entries, capacity * sizeof *entries);
+    }
+    entries[nb_entries++] = (Entry){ key, move, weight };
+}
+
+int compare_entries(const void *a, const void *b) {
+    const Entry *e1 = a, *e2 = b;
+    if (e1->key  != e2->key)  return e1->key  < e2->key  ? -1 : 1;
+    if (e1->move != e2->move) return e1->move < e2->move ? -1 : 1;
+    return 0;
+}
+
+void export_variations(Decoder *d, int depth, int castles, Move last);
+
+// C5 entry: the variations of this position are in an ECO file, where the same moves are
+// followed first (follow_line)
+void export_sub_book(Decoder *d, int depth, int castles, Move last) {
+    char name[5];
+    link_name(&d->book, d->book_indx, name);
+    d->book_indx += 5;
+
+    int sub_book = find_book(&library, name), entry;
+    if (sub_book == EMPTY || library.books[sub_book].loader.book.data == d->book.data) return;
+
+    Book_file book = d->book;
+    const Book_index *index = d->index;
+    int book_indx = d->book_indx;
+    if (follow_line(&library, sub_book, d, path, depth, &entry, &followed) != OK) return;
+    if (d->book_indx != EMPTY) export_variations(d, depth, castles, last);
+
+    d->book = book;
+    d->index = index;
+    d->book_indx = book_indx;
+}
+
+// same walk as decode_variations()
+void export_variations(Decoder *d, int depth, int castles, Move last) {
+    int turn = depth % 2 ? BLACK : WHITE;
+    uint64_t key = polyglot_key(d, turn, castles, last);
+
+    int flags;
+    do {
+        flags = byte_at(&d->book, d->book_indx) & 0xC0;
+        if (flags == 0xC0) {
+            if (byte_at(&d->book, d->book_indx) & 7) { export_sub_book(d, depth, castles, last); break; }
+            d->book_indx += 1;
+        }
+        int move_indx = byte_at(&d->book, d->book_indx) & 0x3F;
+        if (move_indx == 0 || depth == MAX_DEPTH) break;
+
+        if (!generate_moves(d, turn, last, move_indx)) {
+            fprintf(stderr, "%05x: move %02x of %02x\n", d->book_indx, move_indx, d->nb_moves);
+            break;
+        }
+        Move m = d->moves[move_indx-1];
+        add_entry(key, polyglot_move(d, m), flags == 0xC0 ? WEIGHT_RECOMMENDED : WEIGHT);
+        path[depth] = move_indx;
+
+        Undo undo = do_move(d, m);
+        d->book_indx++;
+        if (flags != 0x40) {
+            uint64_t parent_followed = followed;
+            followed = 0;
+            export_variations(d, depth + 1, castles_after(castles, m), m);
+            followed = parent_followed;
+        }
+        undo_move(d, undo);
+    } while (flags & 0x80);
+}
+
+void put_bytes(uint64_t value, int nb_bytes, FILE *file) {
+    for (int i = nb_bytes - 1; i >= 0; i--) putc(value >> (8*i) & 0xFF, file);
+}
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-k random64_file] opening_book_file polyglot_file\n", name);
+    fprintf(stderr, "  -k : Polyglot Random64 table (default: random64.txt)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *random64_name = "random64.txt";
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-k") == 0 && arg+1 < argc) random64_name = argv[++arg];
+        else usage(argv[0]);
+    }
+    if (argc - arg != 2) usage(argv[0]);
+
+    if (load_random64(random64_name) != OK) {
+        fprintf(stderr, "%s: the 781 numbers of the Polyglot Random64 table are needed\n", random64_name);
+        exit(1);
+    }
+
+    init_tables();
+    static Decoder decoder;
+    Decoder *d = &decoder;
+    init_decoder(d);
+    if (open_library(&library, argv[arg]) != OK) {
+        fprintf(stderr, "%s not found\n", argv[arg]);
+        exit(1);
+    }
+    d->book  = library.books[0].loader.book;
+    d->index = library.books[0].loader.index;
+
+    Move none = { 0, 0 };
+    int castles = WHITE_SHORT | WHITE_LONG | BLACK_SHORT | BLACK_LONG;
+    if (polyglot_key(d, WHITE, castles, none) != START_KEY)
+        fprintf(stderr, "%s: not the Polyglot Random64 table, keys won't match other books\n", random64_name);
+    export_variations(d, 0, castles, none);
+
+    // sort, and merge the transpositions (keep the highest weight)
+    qsort(entries, nb_entries, sizeof *entries, compare_entries);
+    int nb_merged = 0;
+    for (int i = 0; i < nb_entries; i++) {
+        if (nb_merged && compare_entries(&entries[nb_merged-1], &entries[i]) == 0) {
+            if (entries[i].weight > entries[nb_merged-1].weight) entries[nb_merged-1].weight = entries[i].weight;
+        }
+        else entries[nb_merged++] = entries[i];
+    }
+
+    FILE *file = fopen(argv[arg+1], "wb");
+    if (!file) {
+        fprintf(stderr, "can't create %s\n", argv[arg+1]);
+        exit(1);
+    }
+    for (int i = 0; i < nb_merged; i++) {
+        put_bytes(entries[i].key, 8, file);
+        put_bytes(entries[i].move, 2, file);
+        put_bytes(entries[i].weight, 2, file);
+        put_bytes(0, 4, file);  // learn
+    }
+    fclose(file);
+    printf("%d entries, %d positions and moves\n", nb_entries, nb_merged);
+
+    close_library(&library);
+    return 0;
+}
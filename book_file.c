@@ -0,0 +1,47 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "book_file.h"
+
+#define ERROR 1
+#define OK    0
+
+int map_book(Book_file *f, const char *name) {
+    f->data = NULL;
+    f->size = 0;
+    f->mapped = false;
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) return ERROR;
+    struct stat st;
+    if (fstat(fd, &st) < 0) { close(fd); return ERROR; }
+    if (st.st_size > 0) { // an empty file is an empty book
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) { close(fd); return ERROR; }
+        f->data = data;
+        f->size = st.st_size;
+        f->mapped = true;
+    }
+    close(fd);
+    return OK;
+}
+
+void unmap_book(Book_file *f) {
+    if (f->mapped) munmap((void *)f->data, f->size);
+    else           free((void *)f->data);
+    f->data = NULL;
+    f->size = 0;
+}
+
+// b000#0x1000.BIN -> b000
+void book_name(const char *file_name, char *name, int size) {
+    const char *slash = strrchr(file_name, '/');
+    const char *base = slash ? slash + 1 : file_name;
+    int length = strcspn(base, "#.");
+    if (length >= size) length = size - 1;
+    for (int i = 0; i < length; i++) name[i] = tolower(base[i]);
+    name[length] = '\0';
+}
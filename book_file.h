@@ -0,0 +1,28 @@
+#ifndef BOOK_FILE_H
+#define BOOK_FILE_H
+
+/*
+ * Read only view of a book file of any size (mapped in memory), shared by the decoder and the rebuilder.
+ * Reading past the end gives 0, i.e. the end of a list of variations.
+ * A book read some other way (e.g. from a disk image) is a malloc'ed buffer, freed by unmap_book().
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const uint8_t *data;
+    size_t         size;
+    bool           mapped;      // else malloc'ed
+} Book_file;
+
+int  map_book(Book_file *f, const char *name);  // OK, or ERROR if it can't be read
+void unmap_book(Book_file *f);                  // or free
+void book_name(const char *file_name, char *name, int size);   // b000#0x1000.BIN -> b000, in lowercase
+
+static inline uint8_t byte_at(const Book_file *f, long indx) {
+    return indx >= 0 && (size_t)indx < f->size ? f->data[indx] : 0;
+}
+
+#endif
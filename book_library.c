@@ -0,0 +1,101 @@
+/*
+ * Openings Library, see book_library.h
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "book_library.h"
+
+bool is_link(const Book_file *book, int entry) {
+    return (byte_at(book, entry) & 0xC0) == 0xC0 && (byte_at(book, entry) & 7);
+}
+
+static int library_book(const Library *l, const char *name) {
+    for (int i = 0; i < l->nb_books; i++)
+        if (strcmp(l->books[i].name, name) == 0) return i;
+    return EMPTY;
+}
+
+void link_name(const Book_file *book, int entry, char *name) {
+    for (int i = 0; i < 4; i++) name[i] = tolower(byte_at(book, entry + 1 + i));
+    name[4] = '\0';
+}
+
+// the books are loaded in the order of their first C5 entry, the ones they refer to included
+int open_library(Library *l, const char *b000_file) {
+    char directory[1024] = "";
+    const char *slash = strrchr(b000_file, '/');
+    if (slash) snprintf(directory, sizeof directory, "%.*s", (int)(slash - b000_file + 1), b000_file);
+
+    l->nb_books = 0;
+    init_decoder(&l->books[0].loader);
+    if (init_book(&l->books[0].loader, b000_file) != OK) return ERROR;
+    strcpy(l->books[0].name, "b000");
+    l->books[0].missing = false;
+    l->nb_books = 1;
+
+    for (int i = 0; i < l->nb_books; i++) {
+        if (l->books[i].missing) continue;
+        const Book_file *book = &l->books[i].loader.book;
+        for (size_t entry = 0; entry < book->size; entry++) {
+            if (!is_link(book, entry)) continue;
+            char name[5];
+            link_name(book, entry, name);
+            entry += 4;
+            if (library_book(l, name) != EMPTY || l->nb_books == MAX_BOOKS) continue;
+
+            Library_book *b = &l->books[l->nb_books];
+            char path[1100];
+            snprintf(path, sizeof path, "%s%s#0x1000.BIN", directory, name);
+            init_decoder(&b->loader);
+            strcpy(b->name, name);
+            b->missing = init_book(&b->loader, path) != OK;
+            if (b->missing) fprintf(stderr, "%s not found\n", path);
+            l->nb_books++;
+        }
+    }
+    return OK;
+}
+
+void close_library(Library *l) {
+    for (int i = 0; i < l->nb_books; i++)
+        if (!l->books[i].missing) close_book(&l->books[i].loader);
+    l->nb_books = 0;
+}
+
+int find_book(const Library *l, const char *name) {
+    int book = library_book(l, name);
+    return book != EMPTY && !l->books[book].missing ? book : EMPTY;
+}
+
+// the moves kept in $1500-$16FF by LA44A, followed again from the initial position
+int follow_line(const Library *l, int book, Decoder *d, const uint8_t *path, int plies, int *last, uint64_t *followed) {
+    if (*followed & (1ULL << book)) {
+        fprintf(stderr, "1 link back to %s\n", l->books[book].name);
+        return ERROR;
+    }
+    Book_file file = d->book;
+    const Book_index *index = d->index;
+    int book_indx = d->book_indx;
+    d->book  = l->books[book].loader.book;
+    d->index = l->books[book].loader.index;
+    d->book_indx = 0;
+    int entry = EMPTY, flags = 0;
+    for (int ply = 0; ply < plies; ply++) {
+        if (flags == 0x40 || (entry = find_variation(d, path[ply])) == EMPTY) {
+            fprintf(stderr, "1 branch not found in %s\n", l->books[book].name);
+            d->book  = file;
+            d->index = index;
+            d->book_indx = book_indx;
+            return ERROR;
+        }
+        flags = byte_at(&d->book, entry) & 0xC0;
+        if (flags == 0xC0) entry++;
+        d->book_indx = entry + 1;
+    }
+    if (flags == 0x40) d->book_indx = EMPTY;
+    *last = entry;
+    *followed |= 1ULL << book;
+    return OK;
+}
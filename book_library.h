@@ -0,0 +1,42 @@
+#ifndef BOOK_LIBRARY_H
+#define BOOK_LIBRARY_H
+
+/*
+ * The Openings Library as Sargon reads it: B000 and every ECO file it refers to (found next to
+ * it), loaded and indexed once by open_library(), then only read. The variations of a C5 entry
+ * go on in its ECO file, which starts from the initial position: the moves of the line are
+ * followed again in it first (follow_line), as LA49E does with the moves kept by LA44A.
+ * The book cursors (book_cursor.h) and the tools walking the whole library share it.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sargon.h"
+
+#define MAX_BOOKS       64
+
+typedef struct {
+    char      name[5];          // b000, or the ECO file of the C5 entries (bc40...)
+    Decoder   loader;           // the book and its index, read only once loaded
+    bool      missing;          // not found, its C5 entries are the end of the book
+} Library_book;
+
+typedef struct {
+    Library_book books[MAX_BOOKS];  // B000 first
+    int          nb_books;
+} Library;
+
+int  open_library(Library *l, const char *b000_file);  // OK, or ERROR if B000 can't be read (missing ECO files are left out)
+void close_library(Library *l);
+
+bool is_link(const Book_file *book, int entry);        // C5 entry
+void link_name(const Book_file *book, int entry, char *name);   // its ECO file, as in l->books (5 characters)
+int  find_book(const Library *l, const char *name);    // in l->books, EMPTY if it isn't there or is missing
+// d reads the book at the variations after the moves of the path (d->book_indx, EMPTY if its last
+// move is a leaf), *last is the offset of this move (EMPTY for the initial position). *followed
+// holds the books this line was already followed in, for the C5 entries of the same position:
+// the book is added to them, and a link back to one of them is a loop. OK, or ERROR if the line
+// isn't in the book or loops (reported on stderr, d is left as it was)
+int  follow_line(const Library *l, int book, Decoder *d, const uint8_t *path, int plies, int *last, uint64_t *followed);
+
+#endif
@@ -1,81 +1,164 @@
+/*
+ * Rebuilds the whole Openings Library as a single book (full_book): B000 with the variations of
+ * the ECO files spliced in at their C5 entries.
+ *
+ * With --stats, the time spent in every ECO file (loading and indexing it, splicing its
+ * variations) is printed on stderr at the end, with the bytes read and copied if it was built
+ * with -DSTATS=1 (trace.h). --trace writes the phases and the loads as a Chrome trace.
+ *
+ *   cc -O2 -o book_rebuild book_rebuild.c book_file.c trace.c
+ *   book_rebuild [--stats] [--trace file]
+ */
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <assert.h>
-#include <strings.h>
+#include <string.h>
+#include "book_file.h"
+#include "trace.h"
+
+// an ECO file, loaded once with the branches of every list of variations, to splice them directly
+typedef struct {
+    long key;                   // offset of the list * 64 + move index, 0 if unused
+    int  start, end;            // variations after this move
+} Branch;
+
+typedef struct {
+    char      name[16];
+    Book_file file;
+    Branch   *branches;         // hash table
+    int       mask;
+    bool      missing;          // not found, its lines are written as not found
+    int       nb_splices;       // --stats
+    long      nb_copied;
+    double    load_seconds, splice_seconds;
+    long      nb_reads;         // -DSTATS=1
+} Sub_book;
 
 FILE * output;
-uint8_t book[4096];
-uint8_t subb[4096];
+Book_file book;
+Sub_book sub_books[64];
+int nb_sub_books;
 uint8_t moves[100];
-int book_indx, subb_indx;
-char name[] = "....#0x1000.BIN";
+int book_indx;
+long nb_reads, nb_lookups;      // of B000, and of load_subbook() (-DSTATS=1)
+bool print_stats;
+Trace trace;
+
+// byte_at(), counted
+static uint8_t read_byte(const Book_file *f, long indx, long *nb_reads) {
+    if (STATS) ++*nb_reads;
+    return byte_at(f, indx);
+}
 
 char lowercase(char c) {
     if (c >= 'A' && c <= 'Z') return c + 32;
     else return c;
 }
 
-void parse_branch(bool copy) {
-    int level = 1;
-    while (level != 0 && subb[subb_indx]) {
-        uint8_t byte = subb[subb_indx++];
-        if (copy) { putc(byte, output); fflush(output); }
-        switch (byte & 0xC0) {
-            case 0x40: level--;
-            case 0x00: break;
-            case 0xC0: if (byte != 0xC0)  { printf("%02x in %s at %03x\n", byte,  name, subb_indx-1); break; }
-            case 0x80: level++;
+Branch *find_branch(Sub_book *s, int list, int move) {
+    long key = (long)list * 64 + move;
+    for (int i = key & s->mask; ; i = (i + 1) & s->mask)
+        if (s->branches[i].key == key || s->branches[i].key == 0) return &s->branches[i];
+}
+
+// same walk as the decoder, returns the offset after the list
+int index_list(Sub_book *s, int indx) {
+    int list = indx;
+    int flags;
+    do {
+        uint8_t byte = read_byte(&s->file, indx, &s->nb_reads);
+        flags = byte & 0xC0;
+        if (flags == 0xC0) {
+            if (byte != 0xC0) { printf("%02x in %s at %03x\n", byte, s->name, indx); indx += 5; break; }
+            indx++;
         }
-    }
+        int move = read_byte(&s->file, indx, &s->nb_reads) & 0x3f;
+        if (move == 0) break;
+        indx++;
+
+        int start = indx;
+        if (flags != 0x40) indx = index_list(s, indx);
+        Branch *b = find_branch(s, list, move);
+        if (b->key == 0) *b = (Branch){ (long)list * 64 + move, start, indx };
+    } while (flags & 0x80);
+    return indx;
 }
 
-void synchronize(int depth) {
-    bool found = false;
-    subb_indx = 0;
-    int level = 0;
-    while (subb[subb_indx] && level>=0) {
-        uint8_t byte = subb[subb_indx++];
-        if (byte == 0xC0) byte = subb[subb_indx++];
-        if ((byte & 0x3f) == moves[level]) {
-            level++;
-            if (level == depth) { found = true; parse_branch(true); }
-        } else
-            parse_branch(false);
-    }
-    if (!found) {
-        putc(0x41, output);
-        printf("1 branch not found in %s\n", name);
+Sub_book *load_subbook(const char *name) {
+    if (STATS) nb_lookups++;
+    for (int i = 0; i < nb_sub_books; i++)
+        if (strcmp(sub_books[i].name, name) == 0) return &sub_books[i];
+    if (nb_sub_books == 64) return NULL;
+
+    double start = trace_now();
+    Sub_book *s = &sub_books[nb_sub_books++];
+    memset(s, 0, sizeof *s);
+    strcpy(s->name, name);
+    if (map_book(&s->file, name) != 0) {
+        fprintf(stderr, "%s not found\n", name);
+        s->missing = true;
+        return s;
     }
+
+    // less than one entry per byte, and the table is kept half empty
+    size_t size = 64;
+    while (size < 2 * s->file.size) size *= 2;
+    s->mask = size - 1;
+    s->branches = calloc(size, sizeof *s->branches);
+    index_list(s, 0);
+
+    double end = trace_now();
+    s->load_seconds = end - start;
+    char args[64];
+    snprintf(args, sizeof args, "\"size\":%zu", s->file.size);
+    trace_event(&trace, name, "load", 0, start, end, args);
+    return s;
 }
 
+// the ECO file starts from the initial position: copy its variations after the same moves
 void read_subbook(int depth) {
+    char name[] = "....#0x1000.BIN";
     for (int i = 0; i < 4; i++)
-        name[i] = lowercase(book[book_indx++]);
-    FILE *file = fopen(name, "r");
-    assert( file );
-    bzero(subb, sizeof subb);
-    fread(subb, sizeof subb, 1, file);
-    fclose( file );
-
-    synchronize(depth);
+        name[i] = lowercase(read_byte(&book, book_indx++, &nb_reads));
+    Sub_book *s = load_subbook(name);
+    double start = trace_now();
+
+    Branch *b = NULL;
+    int list = 0;
+    for (int level = 0; s && !s->missing && level < depth; level++) {
+        b = find_branch(s, list, moves[level]);
+        if (b->key == 0) break;
+        list = b->start;
+    }
+    if (b && b->key && b->start < b->end) {
+        fwrite(s->file.data + b->start, 1, b->end - b->start, output);
+        s->nb_copied += b->end - b->start;
+    }
+    else {
+        putc(0x41, output);
+        printf("1 branch not found in %s\n", name);
+    }
+    if (!s) return;
+    s->nb_splices++;
+    s->splice_seconds += trace_now() - start;
 }
 
 
 void parse(int level) {
   int flags;
   do {
-    uint8_t byte = book[book_indx++];
+    uint8_t byte = read_byte(&book, book_indx++, &nb_reads);
     if (byte == 0xC5) {
         read_subbook(level);
         break;
     }
-    putc(byte, output); fflush(output);
+    putc(byte, output);
 
     flags = byte & 0xC0;
     if (flags == 0xC0) {
-        byte = book[book_indx++];
-        putc(byte, output); fflush(output);
+        byte = read_byte(&book, book_indx++, &nb_reads);
+        putc(byte, output);
     }
 
     moves[level] = byte & 0x3f;
@@ -85,13 +168,74 @@ void parse(int level) {
   } while (flags & 0x80);
 }
 
-int main(void) {
-    FILE *file = fopen("b000#0x1000.BIN","r");
-    fread(book, sizeof book, 1, file);
-    fclose(file);
+// one line per ECO file, then B000 and the totals (the bytes read only with -DSTATS=1)
+void report_stats(double seconds, long size) {
+    fprintf(stderr, "book\tsize\tload\tsplices\tsplice\tcopied%s\n", STATS ? "\treads" : "");
+    double load = 0, splice = 0;
+    long reads = nb_reads;
+    for (int i = 0; i < nb_sub_books; i++) {
+        Sub_book *s = &sub_books[i];
+        fprintf(stderr, "%.4s\t%zu\t%.6f\t%d\t%.6f\t%ld", s->name, s->file.size, s->load_seconds,
+                s->nb_splices, s->splice_seconds, s->nb_copied);
+        if (STATS) fprintf(stderr, "\t%ld", s->nb_reads);
+        fprintf(stderr, "\n");
+        load += s->load_seconds;
+        splice += s->splice_seconds;
+        reads += s->nb_reads;
+    }
+    fprintf(stderr, "b000\t%zu\t\t\t\t%zu", book.size, book.size);
+    if (STATS) fprintf(stderr, "\t%ld", nb_reads);
+    fprintf(stderr, "\n%.3f s: %d ECO files loaded in %.3f s, spliced in %.3f s, %ld bytes written",
+            seconds, nb_sub_books, load, splice, size);
+    if (STATS) fprintf(stderr, ", %ld bytes read, %ld lookups of the ECO files", reads, nb_lookups);
+    fprintf(stderr, "\n");
+}
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [--stats] [--trace file]\n", name);
+    fprintf(stderr, "  reads b000#0x1000.BIN and the ECO files it refers to, writes full_book\n");
+    fprintf(stderr, "  --stats : time (and bytes read with -DSTATS=1) of every ECO file on stderr\n");
+    fprintf(stderr, "  --trace : phases and loads as a Chrome trace (chrome://tracing)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "--stats") == 0) print_stats = true;
+        else if (strcmp(argv[arg], "--trace") == 0 && arg+1 < argc) {
+            if (open_trace(&trace, argv[++arg]) != 0) {
+                fprintf(stderr, "can't write %s\n", argv[arg]);
+                exit(1);
+            }
+        }
+        else usage(argv[0]);
+    }
+    if (arg != argc) usage(argv[0]);
+
+    double start = trace_now();
+    if (map_book(&book, "b000#0x1000.BIN") != 0) {
+        fprintf(stderr, "b000#0x1000.BIN not found\n");
+        exit(1);
+    }
+    double parse_start = trace_now();
+    trace_event(&trace, "b000", "load", 0, start, parse_start, NULL);
 
     output = fopen("full_book", "w");
+    setvbuf(output, NULL, _IOFBF, 1 << 16);
     parse(0);
+    long size = ftell(output);
+    double close_start = trace_now();
+    trace_event(&trace, "parse", "rebuild", 0, parse_start, close_start, NULL);
     fclose(output);
-}
+    double end = trace_now();
+    trace_event(&trace, "write", "rebuild", 0, close_start, end, NULL);
 
+    if (print_stats) report_stats(end - start, size);
+    for (int i = 0; i < nb_sub_books; i++) {
+        unmap_book(&sub_books[i].file);
+        free(sub_books[i].branches);
+    }
+    unmap_book(&book);
+    return close_trace(&trace) == 0 ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+/*
+ * Compiles the Openings Library into a succinct book (succinct.h): B000 and the ECO files it
+ * refers to, loaded as a Library (book_library.h), are read breadth first, the variations of a
+ * C5 entry being followed in its ECO file from the initial position, so that every position of
+ * the tree gets its variations in one place, numbered after the ones of the previous positions.
+ *
+ * The decoder and the prober read the mapped file: the variations of a node are a range of
+ * node numbers found with a select on the LOUDS bits, its parent with a select and a rank, so
+ * neither of them scans the book. Like in the Sargon format, the moves are move indexes, which
+ * the move generator turns into moves.
+ *
+ *   cc -O2 -o book_succinct book_succinct.c succinct.c book_library.c sargon.c book_file.c
+ *   book_succinct [-o succinct_file] b000#0x1000.BIN
+ *   book_succinct -d succinct_file [-f format]
+ *   book_succinct -p succinct_file [moves...]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include "book_library.h"
+#include "succinct.h"
+
+
+typedef struct {                // where the variations of a node are read, while compiling
+    int      book;              // in library.books
+    int      list;              // offset of its variations, EMPTY if none
+    uint32_t parent;
+    int      depth;
+} Source;
+
+Library        library;
+Decoder        reader;          // for find_variation() in the ECO files
+Succinct_node *nodes;
+Source        *sources;
+uint32_t       nb_nodes, node_capacity;
+long           nb_errors;
+
+void add_node(int book, int list, uint32_t parent, int depth, int move_indx, bool recommended) {
+    if (nb_nodes == node_capacity) {
+        node_capacity = 2 * node_capacity + 1024;
+        nodes   = realloc(nodes, node_capacity * sizeof *nodes);
+        sources = realloc(sources, node_capacity * sizeof *sources);
+    }
+    nodes[nb_nodes]   = (Succinct_node){ 0, move_indx, recommended, "", false };
+    sources[nb_nodes] = (Source){ book, list, parent, depth };
+    nb_nodes++;
+}
+
+// the variations of the node in an ECO file, where its line is followed from the initial
+// position (follow_line), EMPTY if it isn't there or loops back to one of the books followed
+int follow_link(uint32_t node, const char *name, int book, int *list, uint64_t *followed) {
+    int target = find_book(&library, name), last;
+    if (target == EMPTY || target == book) return EMPTY;
+
+    uint8_t path[MAX_DEPTH];
+    for (uint32_t n = node; n != 0; n = sources[n].parent) path[sources[n].depth - 1] = nodes[n].move_indx;
+    if (follow_line(&library, target, &reader, path, sources[node].depth, &last, followed) != OK) {
+        nb_errors++;
+        return EMPTY;
+    }
+    *list = reader.book_indx;
+    return target;
+}
+
+// same walk as decode_variations(), the variations become the next nodes
+void add_variations(uint32_t node) {
+    int book = sources[node].book, entry = sources[node].list, depth = sources[node].depth;
+    int flags;
+    uint64_t followed = 1ULL << book;
+    if (entry == EMPTY || depth == MAX_DEPTH) return;
+    do {
+        const Decoder *loader = &library.books[book].loader;
+        int byte = byte_at(&loader->book, entry);
+        flags = byte & 0xC0;
+        if (flags == 0xC0 && (byte & 7)) {  // sub-book name
+            Succinct_node *n = &nodes[node];
+            char name[5];
+            link_name(&loader->book, entry, name);
+            if (!n->link[0]) strcpy(n->link, name);     // the first one, the next ones follow from it
+            if ((book = follow_link(node, name, book, &entry, &followed)) == EMPTY) {
+                n->missing = true;
+                break;
+            }
+            if (entry == EMPTY) break;
+            continue;
+        }
+        int move = flags == 0xC0 ? entry + 1 : entry;
+        int move_indx = byte_at(&loader->book, move) & 0x3F;
+        if (nodes[node].nb_variations == UINT8_MAX) {
+            fprintf(stderr, "%05x: too many variations\n", entry);
+            nb_errors++;
+            break;
+        }
+        add_node(book, flags != 0x40 && move_indx ? move + 1 : EMPTY, node, depth + 1, move_indx, flags == 0xC0);
+        nodes[node].nb_variations++;
+        if (move_indx == 0) break;
+        entry = loader->index->end[entry];
+    } while (flags & 0x80);
+}
+
+/*
+ * Reading the succinct book
+ */
+
+// same output as decode_variations(), the node numbers in place of the offsets in the book
+void decode_node(const Succinct_book *b, Decoder *d, uint32_t position, int depth, Move last) {
+    int turn = depth % 2 ? BLACK : WHITE;
+    uint32_t first = first_variation(b, position), end = first + nb_variations(b, position);
+    for (uint32_t variation = first; variation < end; variation++) {
+        Node node = { .kind = MOVE_NODE, .depth = depth, .offset = variation };
+        node.recommended = is_recommended(b, variation);
+        node.move_indx = node_move_indx(b, variation);
+        if (d->emitter->needs_san) search_moves(d, turn, last);
+        else generate_moves(d, turn, last, node.move_indx);
+        node.nb_moves = d->nb_moves;
+        if (node.move_indx == 0) {
+            node.kind = END_NODE;
+            d->emitter->node(d, &node);
+            break;
+        }
+
+        Move m = d->moves[node.move_indx-1];
+        node.move  = m;
+        node.taken = d->board[m.to] != EMPTY;
+        if (d->emitter->needs_san) san_move(d, m, node.san);
+        Undo undo = do_move(d, m);
+        node.promoted = undo.promoted;
+        node.check    = is_check(d, turn ^ BLACK);
+        if (node.check && d->emitter->needs_san) strcat(node.san, "+");
+        d->emitter->node(d, &node);
+        decode_node(b, d, variation, depth + 1, m);
+        undo_move(d, undo);
+    }
+
+    bool missing;
+    const char *link = node_link(b, position, &missing);
+    if (link && missing) {
+        Node node = { .kind = SUB_BOOK_NODE, .depth = depth, .offset = position };
+        for (int i = 0; i < 4; i++) node.sub_book[i] = toupper(link[i]);
+        d->emitter->node(d, &node);
+    }
+}
+
+// the book moves after the moves given in SAN, found among the variations of each position
+int probe(const Succinct_book *b, Decoder *d, int nb_args, char **args) {
+    int turn = WHITE;
+    Move last = { 0, 0 };
+    uint32_t position = 0;
+    for (int i = 0; i < nb_args; i++) {
+        search_moves(d, turn, last);
+        int move_indx = find_san(d, args[i], turn);
+        if (move_indx == 0) {
+            fprintf(stderr, "%s: not a move\n", args[i]);
+            return ERROR;
+        }
+        uint32_t variation = nb_variations(b, position) ? first_variation(b, position) : 0;
+        while (variation && node_move_indx(b, variation) != move_indx) variation = next_variation(b, variation);
+        if (!variation) {
+            printf("not in the book\n");
+            return OK;
+        }
+        last = d->moves[move_indx-1];
+        do_move(d, last);
+        turn ^= BLACK;
+        position = variation;
+    }
+
+    search_moves(d, turn, last);
+    uint32_t first = first_variation(b, position), end = first + nb_variations(b, position);
+    for (uint32_t variation = first; variation < end; variation++) {
+        int move_indx = node_move_indx(b, variation);
+        if (move_indx == 0 || move_indx > d->nb_moves) continue;
+        char san[10];
+        san_move(d, d->moves[move_indx-1], san);
+        printf("%s%s\t%d\n", san, is_recommended(b, variation) ? "!" : "", move_indx);
+    }
+    bool missing;
+    const char *link = node_link(b, position, &missing);
+    if (link) printf("=> %s%s\n", link, missing ? " (not found)" : "");
+    if (end == first && !link) printf("end of the line\n");
+    return OK;
+}
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-o succinct_file] opening_book_file\n", name);
+    fprintf(stderr, "       %s -d succinct_file [-f format]\n", name);
+    fprintf(stderr, "       %s -p succinct_file [moves...]\n", name);
+    fprintf(stderr, "  -o : succinct book to write (default: sargon.slb)\n");
+    fprintf(stderr, "  -d : decodes it like book_decoder, -f text (default), pgn, json or binary\n");
+    fprintf(stderr, "  -p : prints the book moves after the moves (default: of the initial position)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *succinct_name = "sargon.slb";
+    const Emitter *emitter = &text_emitter;
+    bool decoding = false, probing = false;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "-o") == 0 && arg+1 < argc) succinct_name = argv[++arg];
+        else if (strcmp(argv[arg], "-d") == 0 && arg+1 < argc) { succinct_name = argv[++arg]; decoding = true; }
+        else if (strcmp(argv[arg], "-p") == 0 && arg+1 < argc) { succinct_name = argv[++arg]; probing = true; }
+        else if (strcmp(argv[arg], "-f") == 0 && arg+1 < argc) {
+            emitter = find_emitter(argv[++arg]);
+            if (!emitter) usage(argv[0]);
+        }
+        else usage(argv[0]);
+    }
+    if (decoding && probing) usage(argv[0]);
+    if (decoding ? arg != argc : !probing && argc - arg != 1) usage(argv[0]);
+
+    init_tables();
+    static Decoder decoder;
+    Decoder *d = &decoder;
+    init_decoder(d);
+
+    if (decoding || probing) {
+        Succinct_book b;
+        if (open_succinct(&b, succinct_name) != OK) {
+            fprintf(stderr, "%s: not a succinct book\n", succinct_name);
+            exit(1);
+        }
+        int status = OK;
+        if (decoding) {
+            setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+            d->emitter = emitter;
+            d->emitter->begin_book(d);
+            decode_node(&b, d, 0, 0, (Move){ 0, 0 });
+            d->book_indx = EMPTY;     // no offset at the end
+            d->emitter->end_book(d);
+        }
+        else status = probe(&b, d, argc - arg, argv + arg);
+        close_succinct(&b);
+        return status == OK ? 0 : 1;
+    }
+
+    if (open_library(&library, argv[arg]) != OK) {
+        fprintf(stderr, "%s not found\n", argv[arg]);
+        exit(1);
+    }
+    init_decoder(&reader);
+    add_node(0, 0, 0, 0, 0, false);
+    for (uint32_t node = 0; node < nb_nodes; node++) add_variations(node);
+
+    if (save_succinct(succinct_name, nodes, nb_nodes) != OK) {
+        fprintf(stderr, "can't create %s\n", succinct_name);
+        exit(1);
+    }
+
+    // size report
+    long book_size = 0;
+    int nb_files = 0, nb_links = 0;
+    for (int i = 0; i < library.nb_books; i++)
+        if (!library.books[i].missing) {
+            book_size += library.books[i].loader.book.size;
+            nb_files++;
+        }
+    for (uint32_t i = 0; i < nb_nodes; i++) nb_links += nodes[i].link[0] != 0;
+    long file_bytes = succinct_size(nb_nodes, nb_links);
+    printf("books:\t%d files\t%ld bytes\n", nb_files, book_size);
+    printf("tree:\t%u moves\t%d links to the ECO files\n", nb_nodes - 1, nb_links);
+    printf("%s:\t%ld bytes\t%.1f bits per move\n", succinct_name, file_bytes, 8.0 * file_bytes / (nb_nodes - 1 ? nb_nodes - 1 : 1));
+    if (nb_errors) printf("%ld errors\n", nb_errors);
+
+    close_library(&library);
+    return nb_errors ? 1 : 0;
+}
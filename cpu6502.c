@@ -0,0 +1,281 @@
+/*
+ * NMOS 6502 core, see cpu6502.h
+ */
+#include <stdint.h>
+#include "cpu6502.h"
+
+enum Ops { ILL, ADC, AND, ASL, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRK, BVC, BVS, CLC, CLD, CLI, CLV,
+           CMP, CPX, CPY, DEC, DEX, DEY, EOR, INC, INX, INY, JMP, JSR, LDA, LDX, LDY, LSR, NOP,
+           ORA, PHA, PHP, PLA, PLP, ROL, ROR, RTI, RTS, SBC, SEC, SED, SEI, STA, STX, STY,
+           TAX, TAY, TSX, TXA, TXS, TYA };
+enum Modes { IMP, ACC, IMM, ZP, ZPX, ZPY, ABS, ABX, ABY, IND, IZX, IZY, REL };
+
+static const int mode_length[] = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2, 2 };
+
+typedef struct {
+    uint8_t op, mode, cycles;
+    uint8_t page_penalty;       // indexed read: one more cycle if the page is crossed
+} Opcode;
+
+static const Opcode opcodes[256] = {
+    [0x69]={ADC,IMM,2}, [0x65]={ADC,ZP,3}, [0x75]={ADC,ZPX,4}, [0x6D]={ADC,ABS,4},
+    [0x7D]={ADC,ABX,4,1}, [0x79]={ADC,ABY,4,1}, [0x61]={ADC,IZX,6}, [0x71]={ADC,IZY,5,1},
+    [0x29]={AND,IMM,2}, [0x25]={AND,ZP,3}, [0x35]={AND,ZPX,4}, [0x2D]={AND,ABS,4},
+    [0x3D]={AND,ABX,4,1}, [0x39]={AND,ABY,4,1}, [0x21]={AND,IZX,6}, [0x31]={AND,IZY,5,1},
+    [0x0A]={ASL,ACC,2}, [0x06]={ASL,ZP,5}, [0x16]={ASL,ZPX,6}, [0x0E]={ASL,ABS,6}, [0x1E]={ASL,ABX,7},
+    [0x90]={BCC,REL,2}, [0xB0]={BCS,REL,2}, [0xF0]={BEQ,REL,2}, [0x30]={BMI,REL,2},
+    [0xD0]={BNE,REL,2}, [0x10]={BPL,REL,2}, [0x50]={BVC,REL,2}, [0x70]={BVS,REL,2},
+    [0x24]={BIT,ZP,3}, [0x2C]={BIT,ABS,4},
+    [0x00]={BRK,IMP,7},
+    [0x18]={CLC,IMP,2}, [0xD8]={CLD,IMP,2}, [0x58]={CLI,IMP,2}, [0xB8]={CLV,IMP,2},
+    [0xC9]={CMP,IMM,2}, [0xC5]={CMP,ZP,3}, [0xD5]={CMP,ZPX,4}, [0xCD]={CMP,ABS,4},
+    [0xDD]={CMP,ABX,4,1}, [0xD9]={CMP,ABY,4,1}, [0xC1]={CMP,IZX,6}, [0xD1]={CMP,IZY,5,1},
+    [0xE0]={CPX,IMM,2}, [0xE4]={CPX,ZP,3}, [0xEC]={CPX,ABS,4},
+    [0xC0]={CPY,IMM,2}, [0xC4]={CPY,ZP,3}, [0xCC]={CPY,ABS,4},
+    [0xC6]={DEC,ZP,5}, [0xD6]={DEC,ZPX,6}, [0xCE]={DEC,ABS,6}, [0xDE]={DEC,ABX,7},
+    [0xCA]={DEX,IMP,2}, [0x88]={DEY,IMP,2},
+    [0x49]={EOR,IMM,2}, [0x45]={EOR,ZP,3}, [0x55]={EOR,ZPX,4}, [0x4D]={EOR,ABS,4},
+    [0x5D]={EOR,ABX,4,1}, [0x59]={EOR,ABY,4,1}, [0x41]={EOR,IZX,6}, [0x51]={EOR,IZY,5,1},
+    [0xE6]={INC,ZP,5}, [0xF6]={INC,ZPX,6}, [0xEE]={INC,ABS,6}, [0xFE]={INC,ABX,7},
+    [0xE8]={INX,IMP,2}, [0xC8]={INY,IMP,2},
+    [0x4C]={JMP,ABS,3}, [0x6C]={JMP,IND,5}, [0x20]={JSR,ABS,6},
+    [0xA9]={LDA,IMM,2}, [0xA5]={LDA,ZP,3}, [0xB5]={LDA,ZPX,4}, [0xAD]={LDA,ABS,4},
+    [0xBD]={LDA,ABX,4,1}, [0xB9]={LDA,ABY,4,1}, [0xA1]={LDA,IZX,6}, [0xB1]={LDA,IZY,5,1},
+    [0xA2]={LDX,IMM,2}, [0xA6]={LDX,ZP,3}, [0xB6]={LDX,ZPY,4}, [0xAE]={LDX,ABS,4}, [0xBE]={LDX,ABY,4,1},
+    [0xA0]={LDY,IMM,2}, [0xA4]={LDY,ZP,3}, [0xB4]={LDY,ZPX,4}, [0xAC]={LDY,ABS,4}, [0xBC]={LDY,ABX,4,1},
+    [0x4A]={LSR,ACC,2}, [0x46]={LSR,ZP,5}, [0x56]={LSR,ZPX,6}, [0x4E]={LSR,ABS,6}, [0x5E]={LSR,ABX,7},
+    [0xEA]={NOP,IMP,2},
+    [0x09]={ORA,IMM,2}, [0x05]={ORA,ZP,3}, [0x15]={ORA,ZPX,4}, [0x0D]={ORA,ABS,4},
+    [0x1D]={ORA,ABX,4,1}, [0x19]={ORA,ABY,4,1}, [0x01]={ORA,IZX,6}, [0x11]={ORA,IZY,5,1},
+    [0x48]={PHA,IMP,3}, [0x08]={PHP,IMP,3}, [0x68]={PLA,IMP,4}, [0x28]={PLP,IMP,4},
+    [0x2A]={ROL,ACC,2}, [0x26]={ROL,ZP,5}, [0x36]={ROL,ZPX,6}, [0x2E]={ROL,ABS,6}, [0x3E]={ROL,ABX,7},
+    [0x6A]={ROR,ACC,2}, [0x66]={ROR,ZP,5}, [0x76]={ROR,ZPX,6}, [0x6E]={ROR,ABS,6}, [0x7E]={ROR,ABX,7},
+    [0x40]={RTI,IMP,6}, [0x60]={RTS,IMP,6},
+    [0xE9]={SBC,IMM,2}, [0xE5]={SBC,ZP,3}, [0xF5]={SBC,ZPX,4}, [0xED]={SBC,ABS,4},
+    [0xFD]={SBC,ABX,4,1}, [0xF9]={SBC,ABY,4,1}, [0xE1]={SBC,IZX,6}, [0xF1]={SBC,IZY,5,1},
+    [0x38]={SEC,IMP,2}, [0xF8]={SED,IMP,2}, [0x78]={SEI,IMP,2},
+    [0x85]={STA,ZP,3}, [0x95]={STA,ZPX,4}, [0x8D]={STA,ABS,4}, [0x9D]={STA,ABX,5},
+    [0x99]={STA,ABY,5}, [0x81]={STA,IZX,6}, [0x91]={STA,IZY,6},
+    [0x86]={STX,ZP,3}, [0x96]={STX,ZPY,4}, [0x8E]={STX,ABS,4},
+    [0x84]={STY,ZP,3}, [0x94]={STY,ZPX,4}, [0x8C]={STY,ABS,4},
+    [0xAA]={TAX,IMP,2}, [0xA8]={TAY,IMP,2}, [0xBA]={TSX,IMP,2},
+    [0x8A]={TXA,IMP,2}, [0x9A]={TXS,IMP,2}, [0x98]={TYA,IMP,2},
+};
+
+static uint8_t read(Cpu *c, uint16_t addr) {
+    if ((addr & 0xFF00) == 0xC000 && c->io_read) return c->io_read(c, addr);
+    return c->mem[addr];
+}
+
+static void write(Cpu *c, uint16_t addr, uint8_t value) {
+    if ((addr & 0xFF00) == 0xC000) {
+        if (c->io_write) c->io_write(c, addr, value);
+        return;
+    }
+    c->mem[addr] = value;
+}
+
+void push(Cpu *c, uint8_t value) { c->mem[0x100 + c->s--] = value; }
+uint8_t pull(Cpu *c)             { return c->mem[0x100 + ++c->s]; }
+
+static void set_nz(Cpu *c, uint8_t value) {
+    c->p &= ~(FLAG_N | FLAG_Z);
+    c->p |= (value & FLAG_N) | (value ? 0 : FLAG_Z);
+}
+
+static void set_flag(Cpu *c, int flag, int on) {
+    if (on) c->p |= flag;
+    else    c->p &= ~flag;
+}
+
+static void compare(Cpu *c, uint8_t reg, uint8_t value) {
+    set_flag(c, FLAG_C, reg >= value);
+    set_nz(c, reg - value);
+}
+
+static void adc(Cpu *c, uint8_t value) {
+    int carry = c->p & FLAG_C;
+    int sum = c->a + value + carry;
+    if (c->p & FLAG_D) {        // NMOS: Z comes from the binary sum, N and V from the sum once the low digit is adjusted
+        int lo = (c->a & 0x0F) + (value & 0x0F) + carry;
+        if (lo > 0x09) lo = ((lo + 0x06) & 0x0F) + 0x10;
+        int adjusted = (c->a & 0xF0) + (value & 0xF0) + lo;
+        set_flag(c, FLAG_Z, (sum & 0xFF) == 0);
+        set_flag(c, FLAG_N, adjusted & 0x80);
+        set_flag(c, FLAG_V, ~(c->a ^ value) & (c->a ^ adjusted) & 0x80);
+        if (adjusted >= 0xA0) adjusted += 0x60;
+        set_flag(c, FLAG_C, adjusted > 0xFF);
+        c->a = adjusted;
+        return;
+    }
+    set_flag(c, FLAG_V, ~(c->a ^ value) & (c->a ^ sum) & 0x80);
+    set_flag(c, FLAG_C, sum > 0xFF);
+    c->a = sum;
+    set_nz(c, c->a);
+}
+
+static void sbc(Cpu *c, uint8_t value) {
+    if (c->p & FLAG_D) {
+        int borrow = !(c->p & FLAG_C);
+        int diff = c->a - value - borrow;
+        int lo = (c->a & 0x0F) - (value & 0x0F) - borrow;
+        int hi = (c->a & 0xF0) - (value & 0xF0);
+        if (lo < 0) { lo -= 0x06; hi -= 0x10; }
+        if (hi < 0) hi -= 0x60;
+        set_flag(c, FLAG_V, (c->a ^ value) & (c->a ^ diff) & 0x80);
+        set_flag(c, FLAG_C, diff >= 0);
+        set_nz(c, diff);
+        c->a = (hi & 0xF0) | (lo & 0x0F);
+        return;
+    }
+    adc(c, ~value);
+}
+
+// effective address of the operand, pc on the instruction
+static uint16_t address(Cpu *c, int mode, int *crossed) {
+    uint16_t operand = c->mem[(uint16_t)(c->pc + 1)] | c->mem[(uint16_t)(c->pc + 2)] << 8;
+    uint8_t  zp = operand;
+    uint16_t base, addr;
+    switch (mode) {
+        case ZP : return zp;
+        case ZPX: return (uint8_t)(zp + c->x);
+        case ZPY: return (uint8_t)(zp + c->y);
+        case ABS: return operand;
+        case ABX: base = operand; addr = base + c->x; break;
+        case ABY: base = operand; addr = base + c->y; break;
+        case IND: // NMOS: the high byte doesn't cross the page
+            return c->mem[operand] | c->mem[(operand & 0xFF00) | (uint8_t)(operand + 1)] << 8;
+        case IZX: zp += c->x; return c->mem[zp] | c->mem[(uint8_t)(zp + 1)] << 8;
+        case IZY: base = c->mem[zp] | c->mem[(uint8_t)(zp + 1)] << 8; addr = base + c->y; break;
+        default : return c->pc + 1;  // IMM
+    }
+    *crossed = (base ^ addr) & 0xFF00 ? 1 : 0;
+    return addr;
+}
+
+static void branch(Cpu *c, int taken, int *cycles) {
+    if (!taken) return;
+    uint16_t next = c->pc;
+    c->pc += (int8_t)c->mem[(uint16_t)(next - 1)];
+    *cycles += (next ^ c->pc) & 0xFF00 ? 2 : 1;
+}
+
+int instruction_length(uint8_t opcode) {
+    const Opcode *o = &opcodes[opcode];
+    return o->op == ILL ? 0 : mode_length[o->mode];
+}
+
+void reset_cpu(Cpu *c) {
+    c->a = c->x = c->y = 0;
+    c->s = 0xFF;
+    c->p = FLAG_U | FLAG_I;
+    c->pc = 0;
+    c->cycles = 0;
+}
+
+int step(Cpu *c) {
+    const Opcode *o = &opcodes[c->mem[c->pc]];
+    if (o->op == ILL) return 0;
+
+    int crossed = 0;
+    uint16_t addr = o->mode == IMP || o->mode == ACC ? 0 : address(c, o->mode, &crossed);
+    int cycles = o->cycles + (o->page_penalty ? crossed : 0);
+    uint16_t pc = c->pc;
+    c->pc += mode_length[o->mode];
+
+    uint8_t value;
+    switch (o->op) {
+        case ADC: adc(c, read(c, addr)); break;
+        case SBC: sbc(c, read(c, addr)); break;
+        case AND: c->a &= read(c, addr); set_nz(c, c->a); break;
+        case ORA: c->a |= read(c, addr); set_nz(c, c->a); break;
+        case EOR: c->a ^= read(c, addr); set_nz(c, c->a); break;
+        case BIT:
+            value = read(c, addr);
+            c->p = (c->p & ~(FLAG_N | FLAG_V | FLAG_Z)) | (value & (FLAG_N | FLAG_V)) | (c->a & value ? 0 : FLAG_Z);
+            break;
+        case CMP: compare(c, c->a, read(c, addr)); break;
+        case CPX: compare(c, c->x, read(c, addr)); break;
+        case CPY: compare(c, c->y, read(c, addr)); break;
+
+        case ASL: case LSR: case ROL: case ROR: {
+            value = o->mode == ACC ? c->a : read(c, addr);
+            int carry_in = c->p & FLAG_C;
+            int carry_out = o->op == ASL || o->op == ROL ? value & 0x80 : value & 1;
+            switch (o->op) {
+                case ASL: value <<= 1; break;
+                case LSR: value >>= 1; break;
+                case ROL: value = value << 1 | carry_in; break;
+                case ROR: value = value >> 1 | carry_in << 7; break;
+            }
+            set_flag(c, FLAG_C, carry_out);
+            set_nz(c, value);
+            if (o->mode == ACC) c->a = value;
+            else write(c, addr, value);
+            break;
+        }
+        case INC: value = read(c, addr) + 1; write(c, addr, value); set_nz(c, value); break;
+        case DEC: value = read(c, addr) - 1; write(c, addr, value); set_nz(c, value); break;
+        case INX: set_nz(c, ++c->x); break;
+        case INY: set_nz(c, ++c->y); break;
+        case DEX: set_nz(c, --c->x); break;
+        case DEY: set_nz(c, --c->y); break;
+
+        case LDA: c->a = read(c, addr); set_nz(c, c->a); break;
+        case LDX: c->x = read(c, addr); set_nz(c, c->x); break;
+        case LDY: c->y = read(c, addr); set_nz(c, c->y); break;
+        case STA: write(c, addr, c->a); break;
+        case STX: write(c, addr, c->x); break;
+        case STY: write(c, addr, c->y); break;
+        case TAX: c->x = c->a; set_nz(c, c->x); break;
+        case TAY: c->y = c->a; set_nz(c, c->y); break;
+        case TXA: c->a = c->x; set_nz(c, c->a); break;
+        case TYA: c->a = c->y; set_nz(c, c->a); break;
+        case TSX: c->x = c->s; set_nz(c, c->x); break;
+        case TXS: c->s = c->x; break;
+
+        case PHA: push(c, c->a); break;
+        case PHP: push(c, c->p | FLAG_B | FLAG_U); break;
+        case PLA: c->a = pull(c); set_nz(c, c->a); break;
+        case PLP: c->p = pull(c) | FLAG_U; break;
+
+        case BCC: branch(c, !(c->p & FLAG_C), &cycles); break;
+        case BCS: branch(c,   c->p & FLAG_C,  &cycles); break;
+        case BNE: branch(c, !(c->p & FLAG_Z), &cycles); break;
+        case BEQ: branch(c,   c->p & FLAG_Z,  &cycles); break;
+        case BPL: branch(c, !(c->p & FLAG_N), &cycles); break;
+        case BMI: branch(c,   c->p & FLAG_N,  &cycles); break;
+        case BVC: branch(c, !(c->p & FLAG_V), &cycles); break;
+        case BVS: branch(c,   c->p & FLAG_V,  &cycles); break;
+
+        case JMP: c->pc = addr; break;
+        case JSR:
+            push(c, (pc + 2) >> 8);
+            push(c, pc + 2);
+            c->pc = addr;
+            break;
+        case RTS: c->pc = pull(c); c->pc |= pull(c) << 8; c->pc++; break;
+        case RTI:
+            c->p = pull(c) | FLAG_U;
+            c->pc = pull(c); c->pc |= pull(c) << 8;
+            break;
+        case BRK:
+            push(c, (pc + 2) >> 8);
+            push(c, pc + 2);
+            push(c, c->p | FLAG_B | FLAG_U);
+            c->p |= FLAG_I;
+            c->pc = c->mem[0xFFFE] | c->mem[0xFFFF] << 8;
+            break;
+
+        case CLC: c->p &= ~FLAG_C; break;
+        case SEC: c->p |=  FLAG_C; break;
+        case CLD: c->p &= ~FLAG_D; break;
+        case SED: c->p |=  FLAG_D; break;
+        case CLI: c->p &= ~FLAG_I; break;
+        case SEI: c->p |=  FLAG_I; break;
+        case CLV: c->p &= ~FLAG_V; break;
+        case NOP: break;
+    }
+    c->cycles += cycles;
+    return cycles;
+}
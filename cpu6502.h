@@ -0,0 +1,36 @@
+#ifndef CPU6502_H
+#define CPU6502_H
+
+/*
+ * NMOS 6502 core, official opcodes only, with the cycle counts of the data sheet
+ * (one more cycle when an indexed read or a taken branch crosses a page, one more for a taken branch).
+ * In decimal mode, Z, N and V are set as by the NMOS parts, where only C and A are valid BCD.
+ *
+ * The whole 64K is RAM, except $C000-$C0FF (Apple II soft switches) which goes through
+ * io_read()/io_write() when they are set. The caller runs step() and decides what to do
+ * with the addresses it doesn't want to execute (ROM, traps).
+ */
+
+#include <stdint.h>
+
+enum Flags { FLAG_C = 0x01, FLAG_Z = 0x02, FLAG_I = 0x04, FLAG_D = 0x08,
+             FLAG_B = 0x10, FLAG_U = 0x20, FLAG_V = 0x40, FLAG_N = 0x80 };
+
+typedef struct Cpu Cpu;
+struct Cpu {
+    uint8_t   a, x, y, s, p;
+    uint16_t  pc;
+    uint64_t  cycles;
+    uint8_t   mem[0x10000];
+    uint8_t (*io_read)(Cpu *c, uint16_t addr);
+    void    (*io_write)(Cpu *c, uint16_t addr, uint8_t value);
+    void     *user;
+};
+
+void reset_cpu(Cpu *c);                 // registers only, the memory is kept
+int  step(Cpu *c);                      // one instruction, returns its cycles, 0 for an unknown opcode (not executed)
+int  instruction_length(uint8_t opcode);// 0 for an unknown opcode
+void push(Cpu *c, uint8_t value);
+uint8_t pull(Cpu *c);
+
+#endif
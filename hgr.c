@@ -0,0 +1,181 @@
+/*
+ * Sargon's board on the HGR screen, see hgr.h
+ */
+#include <string.h>
+#include "hgr.h"
+
+#define GRAPHICS_TABLE  0x8E45  // 14 bitmaps, then the 8 digits and the 8 letters
+#define GLYPH_HEIGHT    7
+#define GLYPH_WIDTH     2
+#define LETTERS_LINE    0xB8
+#define END_MARKER      0x80
+
+// $1320 codes of the types (the black pieces are the odd ones), L9099 adds 2, 0 is no piece
+static const int8_t sargon_types[6] = { 0, 2, 10, 8, 6, 4 };  // PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING
+
+static uint32_t crc_table[256];
+
+// line abcdefgh => address 010fghcd eabab000
+static uint16_t line_address(int line) {
+    int high = 0x40 | (line & 7) << 2 | (line >> 4 & 3);
+    int low  = (line & 8) << 4 | (line >> 1 & 0x60) | (line >> 3 & 0x18);
+    return (high << 8 | low);
+}
+
+// the bitmaps of the table end with $80, the digits and the letters don't
+static int copy_graphics(const Listing *l, int indx, uint8_t *to, int size, bool marker) {
+    uint16_t from = l->image[GRAPHICS_TABLE + 2*indx] | l->image[GRAPHICS_TABLE + 2*indx + 1] << 8;
+    for (int i = 0; i < size + marker; i++)
+        if (!l->loaded[(uint16_t)(from + i)]) return ERROR;
+    if (marker && l->image[(uint16_t)(from + size)] != END_MARKER) return ERROR;
+    memcpy(to, l->image + from, size);
+    return OK;
+}
+
+// the square of the screen (L90B1) of a square of the board
+static int screen_square(const Hgr_screen *h, int pos) {
+    int rank = pos / 8, file = pos % 8;
+    return h->reversed ? 8*rank + 7 - file : 8*(7 - rank) + file;
+}
+
+// L8FC3: 14x7, without inversion
+static void draw_glyph(Hgr_screen *h, const uint8_t *glyph, int line, int column) {
+    for (int i = 0; i < GLYPH_HEIGHT; i++, line++) {
+        memcpy(h->page + h->line_address[line] + column, glyph + GLYPH_WIDTH * i, GLYPH_WIDTH);
+        h->dirty[line] = true;
+    }
+}
+
+int init_hgr(Hgr_screen *h, const Listing *l, bool reversed) {
+    memset(h, 0, sizeof *h);
+    h->reversed = reversed;
+    uint8_t glyphs[16][GLYPH_HEIGHT][GLYPH_WIDTH];      // '1'-'8', then 'a'-'h'
+    for (int i = 0; i < 14; i++)
+        if (copy_graphics(l, i, h->bitmaps[i][0], sizeof h->bitmaps[i], true) != OK) return ERROR;
+    for (int i = 0; i < 16; i++)
+        if (copy_graphics(l, 14 + i, glyphs[i][0], sizeof glyphs[i], false) != OK) return ERROR;
+
+    for (int line = 0; line < HGR_HEIGHT; line++) h->line_address[line] = line_address(line) - 0x4000;
+    for (int square = 0; square < 64; square++)   // L8EFC: line row * 22 + 1, byte column * 4 + 2
+        for (int i = 0; i < SQUARE_HEIGHT; i++)
+            h->square_lines[square][i] = h->line_address[square / 8 * SQUARE_HEIGHT + 1 + i] + square % 8 * SQUARE_WIDTH + 2;
+    memset(h->shown, -1, sizeof h->shown);
+
+    // L8F61: the digits left of the rows, 8 lines down, the letters under the columns
+    for (int i = 0; i < 8; i++) {
+        int row    = screen_square(h, 8*i) / 8;
+        int column = screen_square(h, i) % 8;
+        draw_glyph(h, glyphs[i][0], row * SQUARE_HEIGHT + 1 + 8, 0);
+        draw_glyph(h, glyphs[8 + i][0], LETTERS_LINE, column * SQUARE_WIDTH + 3);
+    }
+    for (int line = 0; line < HGR_HEIGHT; line++) h->dirty[line] = true;
+
+    if (!crc_table[1])
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320 ^ c >> 1 : c >> 1;
+            crc_table[n] = c;
+        }
+    return OK;
+}
+
+// L904D: the bitmap of the piece on its colour or on the other one, inverted for the black
+// pieces, the empty square inverted on the dark squares
+static void draw_square(Hgr_screen *h, int square, int code) {
+    int row = square / 8, column = square % 8;
+    int indx = (code & ~1) | (((row + column) ^ code) & 1);
+    uint8_t mask = (code ? code : row + column) & 1 ? 0xFF : 0;
+    const uint8_t *bitmap = h->bitmaps[indx][0];
+    for (int i = 0; i < SQUARE_HEIGHT; i++) {
+        uint8_t *to = h->page + h->square_lines[square][i];
+        for (int k = 0; k < SQUARE_WIDTH; k++) to[k] = *bitmap++ ^ mask;
+    }
+    memset(h->dirty + row * SQUARE_HEIGHT + 1, true, SQUARE_HEIGHT);
+    h->shown[square] = code;
+    h->nb_squares_drawn++;
+}
+
+int draw_board(Hgr_screen *h, const Decoder *d) {
+    int nb_drawn = 0;
+    for (int pos = 0; pos < 64; pos++) {
+        int pce = d->board[pos];
+        int code = pce == EMPTY ? 0 : sargon_types[d->piece_type[pce]] + (pce & BLACK ? 1 : 0) + 2;
+        int square = screen_square(h, pos);
+        if (h->shown[square] == code) continue;
+        draw_square(h, square, code);
+        nb_drawn++;
+    }
+    return nb_drawn;
+}
+
+// 7 pixels a byte, bit 0 first, bit 7 (the colour group) is left out as on a monochrome monitor
+void update_frame(Hgr_screen *h) {
+    for (int line = 0; line < HGR_HEIGHT; line++) {
+        if (!h->dirty[line]) continue;
+        h->dirty[line] = false;
+        const uint8_t *bytes = h->page + h->line_address[line];
+        uint8_t *pixel = h->pixels[line];
+        for (int i = 0; i < HGR_WIDTH / 7; i++)
+            for (int bit = 0; bit < 7; bit++) *pixel++ = bytes[i] >> bit & 1 ? 255 : 0;
+
+        uint8_t *row = h->png_rows[line];
+        row[0] = 0;             // no filter
+        for (int x = 0; x < HGR_WIDTH / 8; x++) {
+            int bits = 0;
+            for (int k = 0; k < 8; k++) bits = bits << 1 | (h->pixels[line][8*x + k] & 1);
+            row[1 + x] = bits;
+        }
+    }
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value) {
+    for (int i = 3; i >= 0; i--) *p++ = value >> (8*i);
+    return p;
+}
+
+// length, type, data already there, then the CRC of the type and the data
+static uint8_t *end_chunk(uint8_t *chunk, uint8_t *end) {
+    put32(chunk, end - chunk - 8);
+    uint32_t crc = 0xFFFFFFFF;
+    for (const uint8_t *p = chunk + 4; p < end; p++) crc = crc_table[(crc ^ *p) & 0xFF] ^ crc >> 8;
+    return put32(end, crc ^ 0xFFFFFFFF);
+}
+
+// 1 bit grey levels, the zlib stream of the pixels is a single stored deflate block
+size_t write_png(const Hgr_screen *h, uint8_t *png) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    enum { DATA_SIZE = sizeof h->png_rows };
+    uint8_t *p = png;
+    memcpy(p, signature, 8);
+    p += 8;
+
+    uint8_t *chunk = p;
+    memcpy(p + 4, "IHDR", 4);
+    p = put32(p + 8, HGR_WIDTH);
+    p = put32(p, HGR_HEIGHT);
+    *p++ = 1;                   // bit depth
+    *p++ = 0;                   // grey levels
+    *p++ = 0; *p++ = 0; *p++ = 0;
+    p = end_chunk(chunk, p);
+
+    chunk = p;
+    memcpy(p + 4, "IDAT", 4);
+    p += 8;
+    *p++ = 0x78; *p++ = 0x01;   // zlib, 32K window, no compression level
+    *p++ = 1;                   // last block, stored
+    *p++ = DATA_SIZE & 0xFF; *p++ = DATA_SIZE >> 8;
+    *p++ = ~DATA_SIZE & 0xFF; *p++ = (~DATA_SIZE >> 8) & 0xFF;
+    memcpy(p, h->png_rows, DATA_SIZE);
+    uint64_t a = 1, b = 0;      // Adler-32, no overflow for this size
+    for (int i = 0; i < DATA_SIZE; i++) {
+        a += p[i];
+        b += a;
+    }
+    p = put32(p + DATA_SIZE, (b % 65521) << 16 | (a % 65521));
+    p = end_chunk(chunk, p);
+
+    chunk = p;
+    memcpy(p + 4, "IEND", 4);
+    p = end_chunk(chunk, p + 8);
+    return p - png;
+}
@@ -0,0 +1,48 @@
+#ifndef HGR_H
+#define HGR_H
+
+/*
+ * The board of Sargon on the HGR screen, drawn the way the original draws it: the 28x22
+ * bitmaps of the pieces ($88D9-$8D5D, through the table of $8E45) in normal or inverse video
+ * as L904D chooses them, the 14x7 coordinates of L8F61, and the line addresses of L8EDA,
+ * in an 8 KB page laid out like the Apple II memory. The bitmaps are read from the listing.
+ *
+ * The addresses of the 22 lines of each square are computed once. As after a move in the
+ * original (L8E97), a square is only drawn again if its piece changed, and only the lines of
+ * these squares are converted again to pixels (280x192, one byte per pixel, 0 or 255) and to
+ * the rows of a black and white PNG.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sargon.h"
+#include "listing.h"
+
+#define HGR_WIDTH       280
+#define HGR_HEIGHT      192
+#define HGR_PAGE_SIZE   0x2000
+#define SQUARE_WIDTH    4       // bytes, 28 pixels
+#define SQUARE_HEIGHT   22
+#define PNG_ROW_SIZE    (1 + HGR_WIDTH / 8)     // filter byte, then 1 bit per pixel
+#define HGR_PNG_SIZE    (8 + 25 + 12 + 2 + 5 + HGR_HEIGHT * PNG_ROW_SIZE + 4 + 12)
+
+typedef struct {
+    uint8_t  page[HGR_PAGE_SIZE];               // $4000-$5FFF (HGR page 2)
+    uint8_t  pixels[HGR_HEIGHT][HGR_WIDTH];
+    uint8_t  png_rows[HGR_HEIGHT][PNG_ROW_SIZE];
+    uint16_t line_address[HGR_HEIGHT];          // L8EDA, from $4000
+    uint16_t square_lines[64][SQUARE_HEIGHT];   // address of each line of each square of the screen (row * 8 + column)
+    uint8_t  bitmaps[14][SQUARE_HEIGHT][SQUARE_WIDTH];  // by index of the table of $8E45
+    int8_t   shown[64];                         // code of L904D drawn on each square of the screen, -1 if none yet
+    bool     dirty[HGR_HEIGHT];                 // lines drawn since the last update_frame()
+    bool     reversed;                          // the board seen from the black side ($1164 = $77)
+    long     nb_squares_drawn;
+} Hgr_screen;
+
+int    init_hgr(Hgr_screen *h, const Listing *l, bool reversed);   // OK, or ERROR if the graphics aren't in the listing
+int    draw_board(Hgr_screen *h, const Decoder *d);   // number of squares drawn again
+void   update_frame(Hgr_screen *h);     // pixels and PNG rows of the lines drawn since the last update
+size_t write_png(const Hgr_screen *h, uint8_t *png);  // size of the file, png holds HGR_PNG_SIZE bytes
+
+#endif
@@ -0,0 +1,445 @@
+/*
+ * Loader of sargon3_disassembly.txt, see listing.h
+ *
+ * Lines are "ADDR   bytes   [label]   [mnemonic operand]   [; comment]", data lines can go on
+ * without address on the next lines, and strings are given between quotes after their bytes.
+ * Comment lines starting with ';' are about the next line, indented ones go on the comment of the last line.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include "listing.h"
+#include "book_file.h"
+#include "sargon.h"
+
+static const char *mnemonics =
+    "ADC AND ASL BCC BCS BEQ BIT BMI BNE BPL BRK BVC BVS CLC CLD CLI CLV CMP CPX CPY DEC DEX DEY EOR "
+    "INC INX INY JMP JSR LDA LDX LDY LSR NOP ORA PHA PHP PLA PLP ROL ROR RTI RTS SBC SEC SED SEI STA "
+    "STX STY TAX TAY TSX TXA TXS TYA ";
+
+static const char *xref_kinds[] = { "call", "jump", "branch", "read", "write", "modify", "pointer" };
+
+static bool is_mnemonic(const char *token) {
+    if (strlen(token) != 3) return false;
+    for (const char *m = mnemonics; *m; m += 4)
+        if (strncmp(m, token, 3) == 0) return true;
+    return false;
+}
+
+static bool is_hex(const char *token, int length) {
+    if ((int)strlen(token) != length) return false;
+    for (int i = 0; i < length; i++)
+        if (!isxdigit((unsigned char)token[i]) || islower((unsigned char)token[i])) return false;
+    return true;
+}
+
+static bool is_label(const char *token) {
+    return token[0] == 'L' && is_hex(token + 1, 4);
+}
+
+static void add_symbol(Listing *l, const char *name, uint16_t addr) {
+    if (!is_label(name) && find_symbol(l, name) >= 0) return;   // a label is only defined once
+    if (l->nb_symbols % 256 == 0) l->symbols = realloc(l->symbols, (l->nb_symbols + 256) * sizeof *l->symbols);
+    Symbol *s = &l->symbols[l->nb_symbols++];
+    snprintf(s->name, sizeof s->name, "%s", name);
+    s->addr = addr;
+}
+
+static void add_xref(Listing *l, uint16_t from, uint16_t to, int kind) {
+    if (l->nb_xrefs % 1024 == 0) l->xrefs = realloc(l->xrefs, (l->nb_xrefs + 1024) * sizeof *l->xrefs);
+    l->xrefs[l->nb_xrefs++] = (Xref){ from, to, kind };
+    if (kind == XREF_CALL) l->routine[to] = true;
+}
+
+static void add_text(Listing *l, const char *s) {
+    int length = strlen(s) + 1;
+    int capacity = (l->text_size + 65535) / 65536 * 65536;     // at most what was allocated
+    if (l->text_size + length > capacity)
+        l->text = realloc(l->text, (l->text_size + length) / 65536 * 65536 + 65536);
+    memcpy(l->text + l->text_size, s, length);
+    l->text_size += length;
+}
+
+// the comments of a line are kept together, the last one is always at the end of the text
+static void add_comment(Listing *l, uint16_t addr, const char *s) {
+    if (l->nb_comments > 0 && l->comments[l->nb_comments-1].addr == addr) {
+        l->text_size--;
+        add_text(l, "\n");
+        l->text_size--;
+        add_text(l, s);
+        return;
+    }
+    if (l->nb_comments % 256 == 0) l->comments = realloc(l->comments, (l->nb_comments + 256) * sizeof *l->comments);
+    l->comments[l->nb_comments++] = (Comment){ addr, l->text_size };
+    add_text(l, s);
+}
+
+// "3000-8FFF moved to 6000-BFFF" or "normally transfered from 0F00-0FFF to 0300-03FF"
+static void add_relocation(Listing *l, const char *comment) {
+    unsigned from, from_end, to, to_end;
+    if (sscanf(comment, "%x-%x moved to %x-%x", &from, &from_end, &to, &to_end) != 4
+     && sscanf(comment, "normally transfered from %x-%x to %x-%x", &from, &from_end, &to, &to_end) != 4) return;
+    if (from_end < from || to_end - to != from_end - from || to_end > 0xFFFF) return;
+    for (int i = 0; i < l->nb_relocations; i++)
+        if (l->relocations[i].from == from && l->relocations[i].to == to) return;
+    if (l->nb_relocations < (int)(sizeof l->relocations / sizeof l->relocations[0]))
+        l->relocations[l->nb_relocations++] = (Relocation){ from, to, from_end - from + 1 };
+}
+
+// what the instruction at addr does with its operand
+static void add_operand_xref(Listing *l, uint16_t addr, const char *mnemonic, const char *operand,
+                             const uint8_t *bytes, int nb_bytes) {
+    if (nb_bytes < 2 || operand[0] == '#') return;
+    uint16_t to = nb_bytes == 3 ? bytes[1] | bytes[2] << 8 : bytes[1];
+    int kind = XREF_READ;
+    if (mnemonic[0] == 'B' && strcmp(mnemonic, "BIT") != 0 && strcmp(mnemonic, "BRK") != 0) {
+        to = addr + 2 + (int8_t)bytes[1];
+        kind = XREF_BRANCH;
+    }
+    else if (operand[0] == '(')              kind = XREF_POINTER;
+    else if (strcmp(mnemonic, "JSR") == 0)   kind = XREF_CALL;
+    else if (strcmp(mnemonic, "JMP") == 0)   kind = XREF_JUMP;
+    else if (mnemonic[0] == 'S' && mnemonic[1] == 'T') kind = XREF_WRITE;
+    else if (strstr("INC DEC ASL LSR ROL ROR", mnemonic)) kind = XREF_MODIFY;
+    add_xref(l, addr, to, kind);
+}
+
+// the comment of the line (cut from it), out of the strings, without the spaces around it
+static char *cut_comment(char *line) {
+    bool string = false;
+    for (char *c = line; *c; c++) {
+        if (*c == '"') string = !string;
+        else if (*c == ';' && !string) {
+            *c++ = '\0';
+            while (*c == ' ' || *c == '\t') c++;
+            int length = strlen(c);
+            while (length > 0 && isspace((unsigned char)c[length-1])) c[--length] = '\0';
+            return c;
+        }
+    }
+    return NULL;
+}
+
+static int compare_symbols(const void *a, const void *b) {
+    const Symbol *s1 = a, *s2 = b;
+    return s1->addr - s2->addr;
+}
+
+static int compare_xrefs(const void *a, const void *b) {
+    const Xref *x1 = a, *x2 = b;
+    return x1->to != x2->to ? x1->to - x2->to : x1->from - x2->from;
+}
+
+static int compare_comments(const void *a, const void *b) {
+    const Comment *c1 = a, *c2 = b;
+    return c1->addr != c2->addr ? c1->addr - c2->addr : (c1->text > c2->text) - (c1->text < c2->text);
+}
+
+int load_listing(Listing *l, const char *name) {
+    FILE *file = fopen(name, "r");
+    if (!file) return ERROR;
+    memset(l, 0, sizeof *l);
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0) {
+        l->file_size = st.st_size;
+        l->file_time = st.st_mtime;
+    }
+
+    char line[512];
+    char block[4096] = "";      // comment lines waiting for the next line with an address
+    long addr = -1;             // where the bytes of a continuation line go, -1 after a line without bytes
+    long last_addr = -1;        // of the last line with bytes, for the indented comments
+    while (fgets(line, sizeof line, file)) {
+        l->nb_lines++;
+        char *comment = cut_comment(line);
+        char *tokens[64];
+        int nb_tokens = 0;
+        for (char *t = strtok(line, " \t\r\n"); t && nb_tokens < 64; t = strtok(NULL, " \t\r\n"))
+            tokens[nb_tokens++] = t;
+
+        int first = 0;
+        long line_addr;
+        if (line[0] != ' ' && nb_tokens > 0 && is_hex(tokens[0], 4)) {
+            line_addr = strtol(tokens[0], NULL, 16);
+            first = 1;
+        }
+        else if (line[0] == ' ' && addr >= 0 && nb_tokens > 0 && is_hex(tokens[0], 2))
+            line_addr = addr;
+        else {
+            if (comment && *comment && nb_tokens == 0) {
+                if (line[0] == '\0') {
+                    add_relocation(l, comment);
+                    size_t length = strlen(block);
+                    snprintf(block + length, sizeof block - length, "%s%s", length ? "\n" : "", comment);
+                }
+                else if (last_addr >= 0) add_comment(l, last_addr, comment);
+            }
+            addr = -1;
+            continue;
+        }
+
+        if (block[0]) add_comment(l, line_addr, block);
+        if (comment && *comment) add_comment(l, line_addr, comment);
+        block[0] = '\0';
+        last_addr = line_addr;
+
+        uint8_t bytes[64];
+        int nb_bytes = 0;
+        for (int i = first; i < nb_tokens && is_hex(tokens[i], 2); i++)
+            bytes[nb_bytes++] = strtol(tokens[i], NULL, 16);
+        for (int i = 0; i < nb_bytes; i++) {
+            long a = (line_addr + i) & 0xFFFF;
+            if (l->loaded[a] && l->image[a] != bytes[i]) {
+                fprintf(stderr, "%s:%d: %04lX listed twice\n", name, l->nb_lines, a);
+                l->nb_conflicts++;
+            }
+            if (!l->loaded[a]) l->nb_bytes++;
+            l->image[a] = bytes[i];
+            l->loaded[a] = true;
+        }
+        addr = line_addr + nb_bytes;
+
+        // label, mnemonic, operand
+        int t = first + nb_bytes;
+        if (t + 1 < nb_tokens && is_label(tokens[t]) && is_mnemonic(tokens[t+1]))
+            add_symbol(l, tokens[t++], line_addr);
+        if (t < nb_tokens && is_mnemonic(tokens[t])) {
+            addr = -1;          // no data after an instruction
+            if (t + 1 == nb_tokens) continue;
+            char *operand = tokens[t+1];
+            add_operand_xref(l, line_addr, tokens[t], operand, bytes, nb_bytes);
+
+            // ROM routines and soft switches have names in the listing: COUT, KEYBOARD...
+            operand[strcspn(operand, ",")] = '\0';
+            if (nb_bytes == 3 && isalpha((unsigned char)operand[0]) && !is_label(operand))
+                add_symbol(l, operand, bytes[1] | bytes[2] << 8);
+        }
+    }
+    fclose(file);
+    qsort(l->symbols, l->nb_symbols, sizeof *l->symbols, compare_symbols);
+    qsort(l->xrefs, l->nb_xrefs, sizeof *l->xrefs, compare_xrefs);
+    qsort(l->comments, l->nb_comments, sizeof *l->comments, compare_comments);
+    return OK;
+}
+
+/*
+ * Cache: little endian numbers, the bytes of the image only where they are loaded
+ *
+ *   "SLX1", size and date of the text (8 bytes each), lines, bytes, conflicts (4 bytes each),
+ *   relocations (1 byte, then from, to, size), bitmap of the loaded bytes (8K), the loaded bytes,
+ *   symbols (4 bytes, then address, length and name), xrefs (4 bytes, then from, to, kind),
+ *   comments (4 bytes, then address and offset in the text), text (4 bytes, then the strings)
+ */
+
+static void put(FILE *f, uint64_t value, int size) {
+    for (int i = 0; i < size; i++) fputc(value >> 8 * i & 0xFF, f);
+}
+
+static uint64_t get(const Book_file *f, long *pos, int size) {
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++) value |= (uint64_t)byte_at(f, (*pos)++) << 8 * i;
+    return value;
+}
+
+int save_listing_cache(const Listing *l, const char *name) {
+    FILE *f = fopen(name, "wb");
+    if (!f) return ERROR;
+    fwrite("SLX1", 1, 4, f);
+    put(f, l->file_size, 8);
+    put(f, l->file_time, 8);
+    put(f, l->nb_lines, 4);
+    put(f, l->nb_bytes, 4);
+    put(f, l->nb_conflicts, 4);
+    put(f, l->nb_relocations, 1);
+    for (int i = 0; i < l->nb_relocations; i++) {
+        put(f, l->relocations[i].from, 2);
+        put(f, l->relocations[i].to, 2);
+        put(f, l->relocations[i].size, 2);
+    }
+    for (long addr = 0; addr < 0x10000; addr += 8) {
+        int bits = 0;
+        for (int i = 0; i < 8; i++) bits |= l->loaded[addr+i] << i;
+        fputc(bits, f);
+    }
+    for (long addr = 0; addr < 0x10000; addr++)
+        if (l->loaded[addr]) fputc(l->image[addr], f);
+    put(f, l->nb_symbols, 4);
+    for (int i = 0; i < l->nb_symbols; i++) {
+        int length = strlen(l->symbols[i].name);
+        put(f, l->symbols[i].addr, 2);
+        put(f, length, 1);
+        fwrite(l->symbols[i].name, 1, length, f);
+    }
+    put(f, l->nb_xrefs, 4);
+    for (int i = 0; i < l->nb_xrefs; i++) {
+        put(f, l->xrefs[i].from, 2);
+        put(f, l->xrefs[i].to, 2);
+        put(f, l->xrefs[i].kind, 1);
+    }
+    put(f, l->nb_comments, 4);
+    for (int i = 0; i < l->nb_comments; i++) {
+        put(f, l->comments[i].addr, 2);
+        put(f, l->comments[i].text, 4);
+    }
+    put(f, l->text_size, 4);
+    fwrite(l->text, 1, l->text_size, f);
+    return fclose(f) == 0 ? OK : ERROR;
+}
+
+int load_listing_cache(Listing *l, const char *name) {
+    Book_file f;
+    if (map_book(&f, name) != OK) return ERROR;
+    memset(l, 0, sizeof *l);
+    long pos = 4;
+    if (f.size < 4 || memcmp(f.data, "SLX1", 4) != 0) goto error;
+    l->file_size    = get(&f, &pos, 8);
+    l->file_time    = get(&f, &pos, 8);
+    l->nb_lines     = get(&f, &pos, 4);
+    l->nb_bytes     = get(&f, &pos, 4);
+    l->nb_conflicts = get(&f, &pos, 4);
+    l->nb_relocations = get(&f, &pos, 1);
+    if (l->nb_relocations > (int)(sizeof l->relocations / sizeof l->relocations[0])) goto error;
+    for (int i = 0; i < l->nb_relocations; i++) {
+        l->relocations[i].from = get(&f, &pos, 2);
+        l->relocations[i].to   = get(&f, &pos, 2);
+        l->relocations[i].size = get(&f, &pos, 2);
+    }
+    for (long addr = 0; addr < 0x10000; addr += 8) {
+        int bits = byte_at(&f, pos++);
+        for (int i = 0; i < 8; i++) l->loaded[addr+i] = bits >> i & 1;
+    }
+    for (long addr = 0; addr < 0x10000; addr++)
+        if (l->loaded[addr]) l->image[addr] = byte_at(&f, pos++);
+
+    // the counts can't be more than the bytes left, whatever the file
+    l->nb_symbols = get(&f, &pos, 4);
+    if (l->nb_symbols < 0 || (size_t)l->nb_symbols > f.size) goto error;
+    l->symbols = calloc(l->nb_symbols + 1, sizeof *l->symbols);
+    for (int i = 0; i < l->nb_symbols; i++) {
+        Symbol *s = &l->symbols[i];
+        s->addr = get(&f, &pos, 2);
+        int length = get(&f, &pos, 1);
+        for (int j = 0; j < length; j++) {
+            char c = byte_at(&f, pos++);
+            if (j < (int)sizeof s->name - 1) s->name[j] = c;
+        }
+    }
+    l->nb_xrefs = get(&f, &pos, 4);
+    if (l->nb_xrefs < 0 || (size_t)l->nb_xrefs > f.size) goto error;
+    l->xrefs = calloc(l->nb_xrefs + 1, sizeof *l->xrefs);
+    for (int i = 0; i < l->nb_xrefs; i++) {
+        Xref *x = &l->xrefs[i];
+        x->from = get(&f, &pos, 2);
+        x->to   = get(&f, &pos, 2);
+        x->kind = get(&f, &pos, 1);
+        if (x->kind == XREF_CALL) l->routine[x->to] = true;
+    }
+    l->nb_comments = get(&f, &pos, 4);
+    if (l->nb_comments < 0 || (size_t)l->nb_comments > f.size) goto error;
+    l->comments = calloc(l->nb_comments + 1, sizeof *l->comments);
+    for (int i = 0; i < l->nb_comments; i++) {
+        l->comments[i].addr = get(&f, &pos, 2);
+        l->comments[i].text = get(&f, &pos, 4);
+    }
+    l->text_size = get(&f, &pos, 4);
+    if (l->text_size < 0 || (size_t)pos + l->text_size != f.size) goto error;
+    l->text = malloc(l->text_size + 1);
+    memcpy(l->text, f.data + pos, l->text_size);
+    l->text[l->text_size] = '\0';
+    for (int i = 0; i < l->nb_comments; i++)
+        if (l->comments[i].text >= (uint32_t)l->text_size) goto error;
+    unmap_book(&f);
+    return OK;
+
+error:
+    unmap_book(&f);
+    free_listing(l);
+    return ERROR;
+}
+
+// sargon3_disassembly.txt -> sargon3_disassembly.idx
+static void cache_name(const char *name, char *cache, size_t size) {
+    snprintf(cache, size, "%s", name);
+    char *dot = strrchr(cache, '.');
+    if (!dot || strchr(dot, '/')) dot = cache + strlen(cache);
+    snprintf(dot, size - (dot - cache), ".idx");
+}
+
+int open_listing(Listing *l, const char *name) {
+    char cache[1024];
+    cache_name(name, cache, sizeof cache);
+    struct stat st;
+    if (stat(name, &st) == 0 && load_listing_cache(l, cache) == OK) {
+        if (l->file_size == st.st_size && l->file_time == st.st_mtime) return OK;
+        free_listing(l);
+    }
+    if (load_listing(l, name) != OK) return ERROR;
+    save_listing_cache(l, cache);       // not an error if it can't be written
+    return OK;
+}
+
+void free_listing(Listing *l) {
+    free(l->symbols);
+    free(l->xrefs);
+    free(l->comments);
+    free(l->text);
+    l->symbols = NULL;
+    l->xrefs = NULL;
+    l->comments = NULL;
+    l->text = NULL;
+    l->nb_symbols = l->nb_xrefs = l->nb_comments = l->text_size = 0;
+}
+
+const char *symbol_name(const Listing *l, uint16_t addr) {
+    int low = 0, high = l->nb_symbols - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if      (l->symbols[middle].addr < addr) low  = middle + 1;
+        else if (l->symbols[middle].addr > addr) high = middle - 1;
+        else return l->symbols[middle].name;
+    }
+    return NULL;
+}
+
+int find_symbol(const Listing *l, const char *name) {
+    for (int i = 0; i < l->nb_symbols; i++)
+        if (strcmp(l->symbols[i].name, name) == 0) return l->symbols[i].addr;
+    return -1;
+}
+
+const char *comment_at(const Listing *l, uint16_t addr) {
+    int low = 0, high = l->nb_comments - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (l->comments[middle].addr < addr) low  = middle + 1;
+        else                                 high = middle - 1;
+    }
+    return low < l->nb_comments && l->comments[low].addr == addr ? l->text + l->comments[low].text : NULL;
+}
+
+int find_xrefs(const Listing *l, uint16_t addr, const Xref **first) {
+    int low = 0, high = l->nb_xrefs - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (l->xrefs[middle].to < addr) low  = middle + 1;
+        else                            high = middle - 1;
+    }
+    int end = low;
+    while (end < l->nb_xrefs && l->xrefs[end].to == addr) end++;
+    *first = l->xrefs + low;
+    return end - low;
+}
+
+const char *xref_kind_name(int kind) {
+    return kind >= 0 && kind <= XREF_POINTER ? xref_kinds[kind] : "?";
+}
+
+uint16_t load_address(const Listing *l, uint16_t addr) {
+    for (int i = 0; i < l->nb_relocations; i++) {
+        const Relocation *r = &l->relocations[i];
+        if (addr >= r->to && addr - r->to < r->size) return r->from + (addr - r->to);
+    }
+    return addr;
+}
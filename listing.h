@@ -0,0 +1,70 @@
+#ifndef LISTING_H
+#define LISTING_H
+
+/*
+ * Loader of sargon3_disassembly.txt: the bytes of the listing at their addresses
+ * (the listing is already at the addresses of the program after the transfer routines at 0E00),
+ * the labels, the names of the Apple II ROM routines and soft switches used as operands,
+ * the comments, and the cross references (who calls, jumps to, reads or writes each address).
+ *
+ * The text is parsed in one pass; open_listing() keeps the result in a binary cache next to it
+ * (sargon3_disassembly.idx), which is used instead as long as the text keeps its size and date.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    char     name[16];
+    uint16_t addr;
+} Symbol;
+
+enum Xref_kinds { XREF_CALL, XREF_JUMP, XREF_BRANCH, XREF_READ, XREF_WRITE, XREF_MODIFY, XREF_POINTER };
+
+typedef struct {
+    uint16_t from, to;          // the instruction at from uses the address to (the base address when indexed)
+    uint8_t  kind;
+} Xref;
+
+typedef struct {
+    uint16_t addr;
+    uint32_t text;              // offset in the text of the listing: the comments above the line, then the one on it
+} Comment;
+
+typedef struct {
+    uint16_t from, to, size;    // "; 3000-8FFF moved to 6000-BFFF": loaded at from, run at to
+} Relocation;
+
+typedef struct {
+    uint8_t     image[0x10000];
+    bool        loaded[0x10000];    // the byte is in the listing
+    bool        routine[0x10000];   // target of a JSR somewhere in the listing
+    Symbol     *symbols;            // sorted by address
+    int         nb_symbols;
+    Xref       *xrefs;              // sorted by address used, then by user
+    int         nb_xrefs;
+    Comment    *comments;           // sorted by address
+    int         nb_comments;
+    char       *text;
+    int         text_size;
+    Relocation  relocations[8];
+    int         nb_relocations;
+    int         nb_lines, nb_bytes;
+    int         nb_conflicts;       // bytes listed twice with different values (the last one is kept)
+    int64_t     file_size, file_time;   // of the text, to know if a cache is up to date
+} Listing;
+
+int  load_listing(Listing *l, const char *name);   // OK, or ERROR if the file can't be read
+int  save_listing_cache(const Listing *l, const char *name);
+int  load_listing_cache(Listing *l, const char *name);
+int  open_listing(Listing *l, const char *name);   // from the cache if up to date, else parsed and cached
+void free_listing(Listing *l);
+
+const char *symbol_name(const Listing *l, uint16_t addr);      // NULL if no symbol at this address
+int  find_symbol(const Listing *l, const char *name);           // address, or -1
+const char *comment_at(const Listing *l, uint16_t addr);       // NULL if no comment at this address
+int  find_xrefs(const Listing *l, uint16_t addr, const Xref **first);  // number of users of addr
+const char *xref_kind_name(int kind);
+uint16_t load_address(const Listing *l, uint16_t addr);        // where the byte is before the transfer routines
+
+#endif
@@ -0,0 +1,1612 @@
+/*
+ * Sargon III move generator and Openings Library decoder, see sargon.h
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <string.h>
+#include <ctype.h>
+#include "sargon.h"
+
+void print_board(Decoder *d) {
+    for (int y=7; y>=0; y--) {
+        fprintf(d->out, "\n");
+        for (int x=0; x<8; x++) {
+            int i = x + 8*y;
+            fprintf(d->out, d->board[i] < 0 ? "%d ":"%02x ", d->board[i]);
+        }
+    }
+    for (int i=0; i<32; i++) {
+        if (i % 16 == 0) fprintf(d->out, "\n");
+        if (d->piece_location[i]!=EMPTY) fprintf(d->out, "%c%d ", d->piece_location[i]%8+'a', d->piece_location[i]/8+1);
+        else fprintf(d->out, "xx ");
+    }
+    fprintf(d->out, "\n");
+}
+
+static int max(int x, int y) { return x < y ? y : x; }
+static int sgn(int x) { return x < 0 ? -1
+                      : x > 0 ? +1
+                      : 0;
+}
+
+static bool      odd(int x  ) { return x % 2 == 1;          }
+static bool is_empty(Decoder *d, int pos) { return d->board[pos] == EMPTY; }
+static int     color(Decoder *d, int pos) { return d->board[pos] & 0x10;   }
+static int     piece(Decoder *d, int pos) { assert(d->board[pos]!=EMPTY); return d->piece_type[d->board[pos]];   }
+static int   adverse(int col) { return col ^ 0x10;          }
+static bool is_white(Decoder *d, int pos) { return color(d, pos) == WHITE; }
+static bool is_alive(Decoder *d, int pce) { return d->piece_location[pce] != EMPTY; }
+static bool on_board(int x, int y) { return x >= 0 && x < 8 && y >= 0 && y < 8; }
+
+/*
+ * Accessibility tables, like $1200/$1208 (white pawns/pieces) and $1280/$1288 (black pawns/pieces)
+ * in Sargon: for each location, one bit per piece that reaches it (bit n for piece color+n).
+ * Long range moves stop at the first occupied location, which is included (taken or protected).
+ * They are kept up to date by do_move() and undo_move(), so that threats are simple lookups.
+ */
+
+//                      N  NE   E  SE   S  SW   W  NW
+static int step_x[8] = {  0, +1, +1, +1,  0, -1, -1, -1 };
+static int step_y[8] = { +1, +1,  0, -1, -1, -1,  0, +1 };
+
+/*
+ * Static evaluation in 1/256 pawn, white minus black, kept up to date with the attack maps: the
+ * material values of $61A4/$61B0 (and $6198 for the balance $F8), a small bonus for the advance of
+ * the pawns, and the mobility, i.e. the locations reached in the attack maps, the centre counting
+ * twice. evaluation() adds the trades of L7B80, which change the value of the white pieces and
+ * pawns when the material isn't balanced.
+ */
+static const int16_t piece_value[6] = { 0x100, 0x319, 0x325, 0x500, 0x900, 0x1000 };  // PAWN..KING
+static const int8_t  piece_units[6] = { 1, 3, 3, 5, 9, 16 };
+#define PAWN_ADVANCE    8       // per rank
+#define MOBILITY_VALUE  4       // per location reached
+
+static int8_t mobility_weight[32][64];   // by piece number (the kings are in the same slots), negative for black
+
+static void init_evaluation_tables(void) {
+    for (int pce = 0; pce < 32; pce++)
+        for (int pos = 0; pos < 64; pos++) {
+            int x = pos % 8, y = pos / 8;
+            int weight = x >= 2 && x <= 5 && y >= 2 && y <= 5 ? 2 : 1;
+            if ((pce & 15) == KING1) weight = 0;
+            mobility_weight[pce][pos] = pce & BLACK ? -weight : weight;
+        }
+}
+
+// add (sign +1) or remove (sign -1) a piece at its location
+static void count_piece(Decoder *d, int pce, int sign) {
+    Evaluation *e = &d->eval;
+    int type = d->piece_type[pce];
+    int value = piece_value[type];
+    if (type == PAWN) value += PAWN_ADVANCE * (pce & BLACK ? 6 - d->piece_location[pce] / 8 : d->piece_location[pce] / 8 - 1);
+    if (pce & BLACK) {
+        e->material -= sign * value;
+        e->balance  -= sign * piece_units[type];
+    } else {
+        e->material += sign * value;
+        e->balance  += sign * piece_units[type];
+        if      (pce <= PAWN8)  e->nb_pawns  += sign;
+        else if (pce <= QUEEN1) e->nb_pieces += sign;
+    }
+}
+
+static void init_evaluation(Decoder *d) {
+    d->eval.material = 0;
+    d->eval.balance = d->eval.nb_pieces = d->eval.nb_pawns = 0;
+    for (int pce = 0; pce < 32; pce++)
+        if (d->piece_location[pce] != EMPTY) count_piece(d, pce, +1);
+}
+
+int evaluation(Decoder *d) {
+    const Evaluation *e = &d->eval;
+    int trade = e->balance >= 2 ? -16 : e->balance == 1 ? -8 : e->balance == 0 ? 0 : e->balance == -1 ? 8 : 16;
+    return e->material + MOBILITY_VALUE * e->mobility + trade * (e->nb_pieces - e->nb_pawns);
+}
+
+// the change of mobility, added up by the callers
+static int toggle_location(Decoder *d, int pce, int x, int y) {
+    uint16_t *reaching = &d->attack_map[pce >> 4][x + 8*y];
+    *reaching ^= 1 << (pce & 15);
+    int weight = mobility_weight[pce][x + 8*y];
+    return *reaching >> (pce & 15) & 1 ? weight : -weight;
+}
+
+// remove or set the locations reached by a piece (L67CC)
+static void toggle_attacks(Decoder *d, int pce) {
+    static int knight_x[8] = { +1, +2, +2, +1, -1, -2, -2, -1 };
+    static int knight_y[8] = { +2, +1, -1, -2, -2, -1, +1, +2 };
+    int x = d->piece_location[pce] % 8, y = d->piece_location[pce] / 8;
+    int first_dir = 0, dir_step = 1, mobility = 0;
+
+    switch (d->piece_type[pce]) {
+        case PAWN:
+            y += (pce & BLACK) ? -1 : +1;
+            if (on_board(x-1, y)) mobility += toggle_location(d, pce, x-1, y);
+            if (on_board(x+1, y)) mobility += toggle_location(d, pce, x+1, y);
+            d->eval.mobility += mobility;
+            return;
+        case KNIGHT:
+            for (int dir = 0; dir < 8; dir++)
+                if (on_board(x+knight_x[dir], y+knight_y[dir])) mobility += toggle_location(d, pce, x+knight_x[dir], y+knight_y[dir]);
+            d->eval.mobility += mobility;
+            return;
+        case KING:
+            for (int dir = 0; dir < 8; dir++)
+                if (on_board(x+step_x[dir], y+step_y[dir])) toggle_location(d, pce, x+step_x[dir], y+step_y[dir]);
+            return;     // no mobility for the king
+        case BISHOP: first_dir = 1; dir_step = 2; break;
+        case ROOK  : first_dir = 0; dir_step = 2; break;
+        case QUEEN : first_dir = 0; dir_step = 1; break;
+    }
+    for (int dir = first_dir; dir < 8; dir += dir_step)
+        for (int x2 = x+step_x[dir], y2 = y+step_y[dir]; on_board(x2, y2); x2 += step_x[dir], y2 += step_y[dir]) {
+            mobility += toggle_location(d, pce, x2, y2);
+            if (d->board[x2 + 8*y2] != EMPTY) break;
+        }
+    d->eval.mobility += mobility;
+}
+
+// a location just got emptied or occupied: extend or cut the long range moves going through it (L6818)
+static void update_rays(Decoder *d, int pos) {
+    int x = pos % 8, y = pos / 8;
+    for (int col = 0; col < 2; col++) {
+        for (int reaching = d->attack_map[col][pos]; reaching; reaching &= reaching - 1) {
+            int pce  = 16*col + __builtin_ctz(reaching);
+            int type = d->piece_type[pce];
+            if (type != BISHOP && type != ROOK && type != QUEEN) continue;
+
+            int dx = sgn(x - d->piece_location[pce] % 8), dy = sgn(y - d->piece_location[pce] / 8);
+            int mobility = 0;
+            for (int x2 = x+dx, y2 = y+dy; on_board(x2, y2); x2 += dx, y2 += dy) {
+                mobility += toggle_location(d, pce, x2, y2);
+                if (d->board[x2 + 8*y2] != EMPTY) break;
+            }
+            d->eval.mobility += mobility;
+        }
+    }
+}
+
+static void init_attack_maps(Decoder *d) {
+    memset(d->attack_map, 0, sizeof d->attack_map);
+    d->eval.mobility = 0;
+    for (int pce = 0; pce < 32; pce++)
+        if (is_alive(d, pce)) toggle_attacks(d, pce);
+}
+
+static bool are_same_color(Decoder *d, int from, int to) {
+    assert( !is_empty(d, from) );
+    return !is_empty(d, to) && color(d, from)==color(d, to);
+}
+
+static bool can_pawn_take(Decoder *d, int from, int to) {
+    assert( !is_empty(d, from) );
+    assert( piece(d, from) == PAWN );
+    if (are_same_color(d, from, to)) return false;
+
+    int x1 = from % 8, y1 = from / 8;
+    int x2 =  to  % 8, y2 =  to  / 8;
+    int forward_dir = is_white(d, from) ? +1 : -1;
+    return abs(x1-x2)==1 && y2-y1 == forward_dir;
+}
+
+static bool is_pawn_move(Decoder *d, int from, int to) {
+    assert( piece(d, from) == PAWN );
+    assert( is_empty(d, to) );
+    int forward_step = is_white(d, from) ? +8 : -8;
+    return to-from == forward_step;
+}
+
+static bool is_pawn_entry(Decoder *d, int from, int to) {
+    assert( piece(d, from) == PAWN );
+    assert( is_empty(d, to) );
+    int y1 = from / 8;
+    int forward_step = is_white(d, from) ? +8 : -8;
+    int start_row = is_white(d, from) ? 1 : 6;
+    return y1 == start_row && is_empty(d, from+forward_step) && to-from == 2*forward_step;
+}
+
+static bool is_knight_move(Decoder *d, int from, int to) {
+    assert( piece(d, from) == KNIGHT );
+
+    if (are_same_color(d, from, to)) return false;
+
+    int x1 = from % 8, y1 = from / 8;
+    int x2 =  to  % 8, y2 =  to  / 8;
+    return (abs(x1-x2)==1 && abs(y1-y2)==2)
+        || (abs(x1-x2)==2 && abs(y1-y2)==1);
+}
+
+static bool is_bishop_move(Decoder *d, int from, int to) {
+    assert( piece(d, from) == BISHOP );
+
+    if (are_same_color(d, from, to)) return false;
+
+    int x1 = from % 8, y1 = from / 8;
+    int x2 =  to  % 8, y2 =  to  / 8;
+    if (abs(x1-x2) != abs(y1-y2)) return false;
+
+    int step = sgn(x2-x1) + 8*sgn(y2-y1);
+    for (int n=1; n < abs(x1-x2); n++)
+        if (!is_empty(d, from+n*step)) return false;
+    return true;
+}
+
+static bool is_rook_move(Decoder *d, int from, int to) {
+    assert( piece(d, from) == ROOK );
+
+    if (are_same_color(d, from, to)) return false;
+
+    int x1 = from % 8, y1 = from / 8;
+    int x2 =  to  % 8, y2 =  to  / 8;
+    if (x1 != x2 && y1 != y2) return false;
+
+    int step = sgn(x2-x1) + 8*sgn(y2-y1);
+    for (int n=1; n < max( abs(x1-x2), abs(y1-y2) ); n++)
+        if (!is_empty(d, from+n*step)) return false;
+    return true;
+}
+
+static bool is_queen_move(Decoder *d, int from, int to) {
+    assert( piece(d, from) == QUEEN );
+
+    if (are_same_color(d, from, to)) return false;
+
+    int x1 = from % 8, y1 = from / 8;
+    int x2 =  to  % 8, y2 =  to  / 8;
+    if (abs(x1-x2) != abs(y1-y2) && x1 != x2 && y1 != y2) return false;
+
+    int step = sgn(x2-x1) + 8*sgn(y2-y1);
+    for (int n=1; n < max( abs(x1-x2), abs(y1-y2) ); n++)
+        if (!is_empty(d, from+n*step)) return false;
+    return true;
+}
+
+static bool is_king_move(Decoder *d, int from, int to) {
+    assert( piece(d, from) == KING );
+
+    if (are_same_color(d, from, to)) return false;
+    int x1 = from % 8, y1 = from / 8;
+    int x2 =  to  % 8, y2 =  to  / 8;
+    if (abs(x1-x2) > 1 || abs(y1-y2) > 1) return false;
+
+    return true;
+}
+
+static bool can_move(Decoder *d, int from, int to) {
+   assert( !is_empty(d, from) );
+   switch (piece(d, from)) {
+       case PAWN  : return is_pawn_move(d, from, to);
+       case KNIGHT: return is_knight_move(d, from, to);
+       case BISHOP: return is_bishop_move(d, from, to);
+       case ROOK  : return is_rook_move(d, from, to);
+       case QUEEN : return is_queen_move(d, from, to);
+       case KING  : return is_king_move(d, from, to);
+       default    : return false;
+   }
+}
+
+static bool can_take(Decoder *d, int from, int pos) {
+   assert( !is_empty(d, from) );
+   switch (piece(d, from)) {
+       case PAWN  : return can_pawn_take(d, from, pos);
+       case KNIGHT: return is_knight_move(d, from, pos);
+       case BISHOP: return is_bishop_move(d, from, pos);
+       case ROOK  : return is_rook_move(d, from, pos);
+       case QUEEN : return is_queen_move(d, from, pos);
+       case KING  : return is_king_move(d, from, pos);
+       default    : return false;
+   }
+}
+
+bool is_threaten(Decoder *d, int pos, int attacker) {
+    // see if a piece (or pawn) threatens
+    if (STATS) d->stats.threats++;
+    if (!is_empty(d, pos) && color(d, pos) == attacker) return false;
+    return d->attack_map[attacker >> 4][pos] != 0;
+}
+
+static bool is_protected(Decoder *d, int pos, int color) {
+    // the accessibility table already includes the locations occupied by the own pieces
+    return d->attack_map[color >> 4][pos] != 0;
+}
+
+static int king_attackers(Decoder *d, int king_color) {
+    // pieces giving check (the king himself can't)
+    int king_pos = d->piece_location[king_color+KING1];
+    return d->attack_map[adverse(king_color) >> 4][king_pos] & ~(1 << KING1);
+}
+
+bool is_check(Decoder *d, int king_color) {
+    return is_threaten(d, d->piece_location[king_color+KING1], adverse(king_color));
+}
+
+static int find_king_attacker(Decoder *d, int king_color) {
+    int attackers = king_attackers(d, king_color);
+    assert( attackers );
+    return d->piece_location[adverse(king_color) + __builtin_ctz(attackers)];
+}
+
+static void register_move(Decoder *d, int from, int to) {
+    assert( !is_empty(d, from) );
+    Move this_move = { .from = from, .to = to };
+    if (d->nb_moves < MAX_MOVES) d->moves[d->nb_moves++] = this_move;
+}
+
+static void try_to_take(Decoder *d, int pos) {
+    assert( !is_empty(d, pos) );
+    int defenser = color(d, pos);
+    int attacker = adverse(defenser);
+    for (int i = PAWN1; i <= KING1; i++) {
+        int from = d->piece_location[attacker+i];
+        if (is_alive(d, attacker+i) && can_take(d, from, pos)) {
+            register_move(d, from, pos);
+            if (piece(d, from)!=PAWN) continue;
+            if ((attacker==WHITE && pos >= 070)
+             || (attacker==BLACK && pos <  010))
+                for (int i=0; i<3; i++)
+                    register_move(d, from, pos); // register underpromotion
+        }
+    }
+}
+
+static void try_to_move_a_piece_to(Decoder *d, int pos, int color) {
+    assert( is_empty(d, pos) );
+    
+    for (int i = KNIGHT1; i <= KING1; i++) {
+        int from = d->piece_location[color+i];
+        if (is_alive(d, color+i) && can_move(d, from, pos))
+            register_move(d, from, pos);
+    }
+}
+
+static void try_to_move_a_promoted_piece_to(Decoder *d, int pos, int color) {
+    assert( is_empty(d, pos) );
+    
+    for (int i = PAWN1; i <= PAWN8; i++) {
+        int from = d->piece_location[color+i];
+        if (is_alive(d, color+i) && piece(d, from)!=PAWN && can_move(d, from, pos))
+            register_move(d, from, pos);
+    }
+}
+
+static void try_king_take(Decoder *d, int king_pos) {
+    int turn = color(d, king_pos), opponent = adverse(turn);
+    static int dx[] = { -1, +1,  0, -1, +1,  0, -1, +1 };
+    static int dy[] = {  0, -1, -1, -1, +1, +1, +1,  0 };
+    for (int dir = 7; dir >= 0 ; dir--) {
+        int x = king_pos % 8, y = king_pos / 8;
+        int x2 = x + dx[dir], y2 = y + dy[dir];
+        if (x2 < 0 || x2 > 7 || y2 < 0 || y2 > 7) continue;
+
+        int king_to = x2 + y2*8;
+        if (is_empty(d, king_to) || are_same_color(d, king_pos, king_to)) continue;
+        if (!is_protected(d, king_to, opponent)) register_move(d, king_pos, king_to);
+    }
+}
+
+static void try_king_move(Decoder *d, int king_pos) {
+    int turn = color(d, king_pos), opponent = adverse(turn);
+    static int dx[] = { -1, +1,  0, -1, +1,  0, -1, +1 };
+    static int dy[] = {  0, -1, -1, -1, +1, +1, +1,  0 };
+    for (int dir = 7; dir >= 0 ; dir--) {
+        int x = king_pos % 8, y = king_pos / 8;
+        int x2 = x + dx[dir], y2 = y + dy[dir];
+        if (x2 < 0 || x2 > 7 || y2 < 0 || y2 > 7) continue;
+
+        int king_to = x2 + y2*8;
+        if (!is_empty(d, king_to)) continue;
+        if (!is_threaten(d, king_to, opponent)) register_move(d, king_pos, king_to);
+    }
+}
+
+static void search_moves_under_check(Decoder *d, int turn) {
+    int king_pos = d->piece_location[turn+KING1];
+    if (STATS) d->stats.under_check++;
+
+    int nb_checks = __builtin_popcount(king_attackers(d, turn));
+    if (nb_checks > 1) { // double check => can only try to evade
+        try_king_take(d, king_pos);
+        try_king_move(d, king_pos);
+        return;
+    }
+
+    // Single check
+
+    // TODO: handle king threatened by pawn entry move
+    // TODO: handle removing threat by pawn promotion taking attacker
+
+    // see if some pieces (not the king himself) can take the attacker
+    int attacker_pos = find_king_attacker(d, turn);
+    for (int i = PAWN1; i <= QUEEN1; i++) {
+        int from = d->piece_location[turn+i];
+        if (is_alive(d, turn+i) && can_take(d, from, attacker_pos))
+            register_move(d, from, attacker_pos);  // TODO: handle promotion at the same time
+    }
+
+    // then try to have the King eat a white unprotected neighbor
+    try_king_take(d, king_pos);
+
+    // then try every shield position between the attacker and the king
+    if (piece(d, attacker_pos) != PAWN && piece(d, attacker_pos) != KNIGHT) {
+        int x1 = attacker_pos % 8, y1 = attacker_pos / 8;
+        int x2 =     king_pos % 8, y2 =     king_pos / 8;
+        int dx = sgn(x2-x1), dy = sgn(y2-y1);
+        int step = dx + dy*8;
+        for (int shield_pos = attacker_pos + step; shield_pos != king_pos; shield_pos += step) {
+            for (int i = KNIGHT1; i <= QUEEN1; i++) // first try to move normal pieces
+                if (is_alive(d, turn+i) && can_move(d, d->piece_location[turn+i], shield_pos))
+                    register_move(d, d->piece_location[turn+i], shield_pos);
+            for (int i=PAWN1; i <= PAWN8; i++) // then try to move promoted pawns
+                if (is_alive(d, turn+i) && d->piece_type[turn+i]!=PAWN && can_move(d, d->piece_location[turn+i], shield_pos))
+                    register_move(d, d->piece_location[turn+i], shield_pos);
+            for (int i=PAWN1; i <= PAWN8; i++) { // then try to move pawns
+                if (is_alive(d, turn+i) && d->piece_type[turn+i]==PAWN && is_pawn_move(d, d->piece_location[turn+i], shield_pos))
+                    register_move(d, d->piece_location[turn+i], shield_pos);
+                if (is_alive(d, turn+i) && d->piece_type[turn+i]==PAWN && is_pawn_entry(d, d->piece_location[turn+i], shield_pos))
+                    register_move(d, d->piece_location[turn+i], shield_pos);
+            }
+        }
+    }
+
+    // finally, try evading the King
+    try_king_move(d, king_pos);
+}
+
+int check_board(Decoder *d) {
+    for (int i=0; i<32; i++) {
+        int pos = d->piece_location[i];
+        if (pos != EMPTY && (pos < 0 || pos > 077 || d->board[pos]!=i)) return ERROR;
+    }
+    for (int pos = 0; pos <= 077; pos++) {
+        if (d->board[pos] != EMPTY && (d->board[pos] < 0 || d->board[pos] > 31 || d->piece_location[d->board[pos]] != pos)) return ERROR;
+    }
+    Attack_map attack_map;
+    Evaluation eval = d->eval;
+    memcpy(attack_map, d->attack_map, sizeof attack_map);
+    init_attack_maps(d);
+    init_evaluation(d);
+    bool same = memcmp(attack_map, d->attack_map, sizeof attack_map) == 0
+             && eval.material == d->eval.material && eval.mobility == d->eval.mobility
+             && eval.balance == d->eval.balance && eval.nb_pieces == d->eval.nb_pieces && eval.nb_pawns == d->eval.nb_pawns;
+    memcpy(d->attack_map, attack_map, sizeof attack_map);
+    d->eval = eval;
+    return same ? OK : ERROR;
+}
+
+// only in the checked builds (-DCHECKED=1), it costs more than the generation itself
+static void verify_board(Decoder *d) {
+    if (CHECKED && check_board(d) != OK)
+    { fprintf(stderr, "BOARD ERROR!!\n"); print_board(d); exit(1); }
+}
+
+// order in which the destinations of piece moves are tried, starting at 033
+int next_location[64] = {
+    001, 002, 003, 004, 005, 006, 007, 077,
+    060, 061, 062, 063, 064, 065, 066, 067,
+    050, 051, 052, 053, 054, 055, 056, 057,
+    040, 041, 042, 043, 044, 045, 046, 047,
+    020, 021, 022, 034, 035, 024, 026, 027,
+    014, 030, 037, 036, 025, 023, 032, 031,
+    000, 017, 016, 015, 013, 012, 011, 010,
+    END, 070, 071, 072, 073, 074, 075, 076
+};
+
+static void ref_search_moves(Decoder *d, int turn, Move last) {
+    int ennemy = adverse(turn);
+
+    d->nb_moves = 0;
+
+    if (is_threaten(d, d->piece_location[turn+KING1], ennemy)) {
+        search_moves_under_check(d, turn);
+        return;
+    }
+
+    // first see if en-passant take is possible
+    int last_moved_piece = piece(d, last.to);
+    if (abs(last.to-last.from)==2*8 && last_moved_piece==PAWN) {
+        // pretend the pawn only did a single step
+        int pretend_location = color(d, last.to) == WHITE ? last.to-8 : last.to+8;
+        int pawn = d->board[last.to];
+        d->board[pretend_location] = pawn;
+        d->board[last.to]     = EMPTY;
+        d->piece_location[pawn] = pretend_location;
+
+        // try to take this pawn with a pawn
+        for (int my_pawn = turn+PAWN1; my_pawn <= turn+PAWN8; my_pawn++) {
+            int from = d->piece_location[my_pawn];
+            if (is_alive(d, my_pawn) && piece(d, from)==PAWN && can_pawn_take(d, from, pretend_location))
+                register_move(d, from, pretend_location);
+        }
+
+        // restore the pawn at its right place
+        d->board[last.to] = pawn;
+        d->board[pretend_location] = EMPTY;
+        d->piece_location[pawn] = last.to;
+    }
+
+    // then try to take material
+    for (int taken = ennemy+QUEEN1 ; taken >= ennemy+PAWN1; taken--) {
+        int pos = d->piece_location[taken];
+        if (is_alive(d, taken)) try_to_take(d, pos);
+    }
+
+    // then try to promote pawn
+    for (int pawn=turn+PAWN1; pawn <= turn+PAWN8; pawn++) {
+        int from = d->piece_location[pawn];
+        if (is_alive(d, pawn) && piece(d, from)==PAWN) {
+            int from = d->piece_location[pawn];
+            int to   = turn==WHITE ? from+8 : from-8;
+            if (is_empty(d, to) && (to >= 070 || to < 010))
+                for (int i=0; i<4; i++)
+                    register_move(d, from, to); // register promotion and underpromotions
+        }
+    }
+
+    // then try to castle
+    int king_location = d->piece_location[turn+KING1];
+    int row = turn == WHITE ? 0 : 070;
+    if (king_location == 004+row && !is_threaten(d, 004+row, ennemy)   // TODO: check they haven't moved
+     && is_alive(d, turn+ROOK2) && d->piece_location[turn+ROOK2]==007+row
+     && is_empty(d, 005+row) && !is_threaten(d, 005+row, ennemy)
+     && is_empty(d, 006+row) && !is_threaten(d, 006+row, ennemy))
+        register_move(d, 004+row, 006+row);
+    if (king_location == 004+row && !is_threaten(d, 004+row, ennemy)
+     && is_alive(d, turn+ROOK1) && d->piece_location[turn+ROOK1]==000+row
+     && is_empty(d, 001+row)
+     && is_empty(d, 002+row) && !is_threaten(d, 002+row, ennemy)
+     && is_empty(d, 003+row) && !is_threaten(d, 003+row, ennemy))
+        register_move(d, 004+row, 002+row);
+
+    // then try to move a piece to priorized locations...
+    for (int pos = 033; pos != END; pos = next_location[pos])
+        if (is_empty(d, pos)) try_to_move_a_piece_to(d, pos, turn);
+
+    for (int pos = 033; pos != END; pos = next_location[pos])
+        if (is_empty(d, pos)) try_to_move_a_promoted_piece_to(d, pos, turn);
+
+    // ... then move pawns
+    for (int pawn = turn+PAWN8; pawn >= turn+PAWN1; pawn--) {
+        int from = d->piece_location[pawn];
+        if (is_alive(d, pawn) && piece(d, from)==PAWN) { // TODO: handle promoted pawns
+            int from = d->piece_location[pawn];
+            int forward_step = turn==WHITE ? +8 : -8;
+            int start_row = turn==WHITE ? 1 : 6;
+            int y =  from / 8;
+            int to = from + forward_step;
+            if (is_empty(d, to)) {
+                if (to >= 070 || to < 010) continue; // promotions were already registered
+                register_move(d, from, to);
+                if (y==start_row && is_empty(d, to+forward_step))
+                    register_move(d, from, to+forward_step);
+            }
+        }
+    }
+}
+
+/*
+ * Bitboard backend.
+ *
+ * Generates exactly the same moves in exactly the same order as ref_search_moves()
+ * (otherwise the book move indices would decode into garbage), but the attack set of
+ * every piece is computed once per position from precomputed tables, so that each
+ * "can this piece reach that square" / "is that square threatened" question becomes
+ * a bit test instead of a ray walk.
+ */
+#define BIT(pos) ((Bitboard)1 << (pos))
+
+// the first four directions go towards increasing locations, the last four towards decreasing ones
+enum Directions { NORTH, NORTH_EAST, EAST, NORTH_WEST, SOUTH, SOUTH_WEST, WEST, SOUTH_EAST };
+
+Bitboard ray[8][64];
+Bitboard knight_attacks[64], king_attacks[64], pawn_attacks[2][64];
+
+static void init_bitboards(void) {
+    static int dx[8] = {  0, +1, +1, -1,  0, -1, -1, +1 };
+    static int dy[8] = { +1, +1,  0, +1, -1, -1,  0, -1 };
+    static int knight_dx[8] = { +1, +2, +2, +1, -1, -2, -2, -1 };
+    static int knight_dy[8] = { +2, +1, -1, -2, -2, -1, +1, +2 };
+
+    for (int pos = 0; pos < 64; pos++) {
+        int x = pos % 8, y = pos / 8;
+        for (int dir = 0; dir < 8; dir++) {
+            for (int x2 = x+dx[dir], y2 = y+dy[dir]; on_board(x2, y2); x2 += dx[dir], y2 += dy[dir])
+                ray[dir][pos] |= BIT(x2 + 8*y2);
+            if (on_board(x+dx[dir], y+dy[dir]))
+                king_attacks[pos] |= BIT(x+dx[dir] + 8*(y+dy[dir]));
+            if (on_board(x+knight_dx[dir], y+knight_dy[dir]))
+                knight_attacks[pos] |= BIT(x+knight_dx[dir] + 8*(y+knight_dy[dir]));
+        }
+        for (int side = -1; side <= +1; side += 2) {
+            if (on_board(x+side, y+1)) pawn_attacks[0][pos] |= BIT(x+side + 8*(y+1)); // white
+            if (on_board(x+side, y-1)) pawn_attacks[1][pos] |= BIT(x+side + 8*(y-1)); // black
+        }
+    }
+}
+
+// squares reached from pos in direction dir, stopping at (and including) the first occupied one
+static Bitboard slide(int pos, int dir, Bitboard occupied) {
+    Bitboard attacks  = ray[dir][pos];
+    Bitboard blockers = attacks & occupied;
+    if (blockers) {
+        int blocker = dir < SOUTH ? __builtin_ctzll(blockers) : 63 - __builtin_clzll(blockers);
+        attacks ^= ray[dir][blocker];
+    }
+    return attacks;
+}
+
+static Bitboard bishop_attacks(int pos, Bitboard occupied) {
+    return slide(pos, NORTH_EAST, occupied) | slide(pos, NORTH_WEST, occupied)
+         | slide(pos, SOUTH_EAST, occupied) | slide(pos, SOUTH_WEST, occupied);
+}
+
+static Bitboard rook_attacks(int pos, Bitboard occupied) {
+    return slide(pos, NORTH, occupied) | slide(pos, EAST, occupied)
+         | slide(pos, SOUTH, occupied) | slide(pos, WEST, occupied);
+}
+
+// sets d->occupied, d->attacks (squares reached, taken or protected, by each piece, empty for
+// dead ones) and d->covered (union of the attacks of the white / black pieces)
+static Bitboard attacks_of(Decoder *d, int pce) {
+    int pos = d->piece_location[pce];
+    switch (d->piece_type[pce]) {
+        case PAWN  : return pawn_attacks[pce >> 4][pos];
+        case KNIGHT: return knight_attacks[pos];
+        case BISHOP: return bishop_attacks(pos, d->occupied);
+        case ROOK  : return rook_attacks(pos, d->occupied);
+        case QUEEN : return bishop_attacks(pos, d->occupied) | rook_attacks(pos, d->occupied);
+        case KING  : return king_attacks[pos];
+        default    : return 0;
+    }
+}
+
+static void scan_position(Decoder *d) {
+    d->occupied = 0;
+    for (int pce = 0; pce < 32; pce++)
+        if (is_alive(d, pce)) d->occupied |= BIT(d->piece_location[pce]);
+
+    d->covered[0] = d->covered[1] = 0;
+    for (int pce = 0; pce < 32; pce++) {
+        d->attacks[pce] = is_alive(d, pce) ? attacks_of(d, pce) : 0;
+        d->covered[pce >> 4] |= d->attacks[pce];
+    }
+}
+
+// same answer as is_threaten() and is_protected(), as long as the position hasn't changed since scan_position()
+static bool bb_is_threaten(Decoder *d, int pos, int attacker) {
+    if (STATS) d->stats.threats++;
+    if (!is_empty(d, pos) && color(d, pos) == attacker) return false;
+    return (d->covered[attacker >> 4] & BIT(pos)) != 0;
+}
+
+static void bb_try_king_take(Decoder *d, int king_pos) {
+    int turn = color(d, king_pos), opponent = adverse(turn);
+    static int dx[] = { -1, +1,  0, -1, +1,  0, -1, +1 };
+    static int dy[] = {  0, -1, -1, -1, +1, +1, +1,  0 };
+    for (int dir = 7; dir >= 0 ; dir--) {
+        int x2 = king_pos % 8 + dx[dir], y2 = king_pos / 8 + dy[dir];
+        if (!on_board(x2, y2)) continue;
+
+        int king_to = x2 + y2*8;
+        if (is_empty(d, king_to) || color(d, king_to) == turn) continue;
+        if (!(d->covered[opponent >> 4] & BIT(king_to))) register_move(d, king_pos, king_to);
+    }
+}
+
+static void bb_try_king_move(Decoder *d, int king_pos) {
+    int opponent = adverse(color(d, king_pos));
+    static int dx[] = { -1, +1,  0, -1, +1,  0, -1, +1 };
+    static int dy[] = {  0, -1, -1, -1, +1, +1, +1,  0 };
+    for (int dir = 7; dir >= 0 ; dir--) {
+        int x2 = king_pos % 8 + dx[dir], y2 = king_pos / 8 + dy[dir];
+        if (!on_board(x2, y2)) continue;
+
+        int king_to = x2 + y2*8;
+        if (!is_empty(d, king_to)) continue;
+        if (!(d->covered[opponent >> 4] & BIT(king_to))) register_move(d, king_pos, king_to);
+    }
+}
+
+static void bb_search_moves_under_check(Decoder *d, int turn) {
+    int king_pos = d->piece_location[turn+KING1];
+    if (STATS) d->stats.under_check++;
+    int attacker = adverse(turn);
+
+    int checkers = 0;   // attacking pieces, as a mask of piece numbers (the king can't give check)
+    for (int i = PAWN1; i <= QUEEN1; i++)
+        if (d->attacks[attacker+i] & BIT(king_pos)) checkers |= 1 << i;
+
+    if (checkers & (checkers - 1)) { // double check => can only try to evade
+        bb_try_king_take(d, king_pos);
+        bb_try_king_move(d, king_pos);
+        return;
+    }
+    assert( checkers );
+    int attacker_pos = d->piece_location[attacker + __builtin_ctz(checkers)];
+
+    // same order as search_moves_under_check(): take the attacker, king takes, shields, king evades
+    for (int i = PAWN1; i <= QUEEN1; i++)
+        if (d->attacks[turn+i] & BIT(attacker_pos))
+            register_move(d, d->piece_location[turn+i], attacker_pos);
+
+    bb_try_king_take(d, king_pos);
+
+    int attacker_type = d->piece_type[d->board[attacker_pos]];
+    if (attacker_type != PAWN && attacker_type != KNIGHT) {
+        int x1 = attacker_pos % 8, y1 = attacker_pos / 8;
+        int x2 =     king_pos % 8, y2 =     king_pos / 8;
+        int step = sgn(x2-x1) + sgn(y2-y1)*8;
+        int forward_step = turn==WHITE ? +8 : -8;
+        int start_row    = turn==WHITE ?  1 :  6;
+        for (int shield_pos = attacker_pos + step; shield_pos != king_pos; shield_pos += step) {
+            for (int i = KNIGHT1; i <= QUEEN1; i++)
+                if (d->attacks[turn+i] & BIT(shield_pos))
+                    register_move(d, d->piece_location[turn+i], shield_pos);
+            for (int i = PAWN1; i <= PAWN8; i++)
+                if (d->piece_type[turn+i] != PAWN && (d->attacks[turn+i] & BIT(shield_pos)))
+                    register_move(d, d->piece_location[turn+i], shield_pos);
+            for (int i = PAWN1; i <= PAWN8; i++) {
+                int from = d->piece_location[turn+i];
+                if (!is_alive(d, turn+i) || d->piece_type[turn+i] != PAWN) continue;
+                if (shield_pos - from == forward_step)
+                    register_move(d, from, shield_pos);
+                if (from / 8 == start_row && is_empty(d, from+forward_step) && shield_pos - from == 2*forward_step)
+                    register_move(d, from, shield_pos);
+            }
+        }
+    }
+
+    bb_try_king_move(d, king_pos);
+}
+
+/*
+ * Lazy generation: the moves of search_moves() in the same order, stage by stage (and in the
+ * stages, taken piece by taken piece, location by location, pawn by pawn), only as far as a
+ * caller needs them, e.g. up to the index of a book move. The bitboard backend is always run
+ * this way, the reference one and the moves under check are generated all at once.
+ * The position must not change until the next start_moves().
+ */
+enum Stages { SCAN, EN_PASSANT, TAKES, PROMOTIONS, CASTLES, PIECE_MOVES, PROMOTED_PIECE_MOVES, PAWN_MOVES, DONE };
+
+void start_moves(Decoder *d, int turn, Move last) {
+    verify_board(d);
+    if (STATS) d->stats.generations++;
+    d->nb_moves = 0;
+    d->generator = (Generator){ .turn = turn, .last = last, .stage = SCAN };
+}
+
+// one step of the current stage, false when the stage is over
+static bool bb_step(Decoder *d, Generator *g) {
+    int turn = g->turn, ennemy = adverse(turn);
+    Bitboard *mine = &d->attacks[turn];
+    switch (g->stage) {
+        case SCAN:
+            scan_position(d);
+            if (bb_is_threaten(d, d->piece_location[turn+KING1], ennemy)) {
+                bb_search_moves_under_check(d, turn);
+                g->stage = DONE;
+                return true;
+            }
+            return false;
+
+        case EN_PASSANT: {
+            Move last = g->last;
+            if (abs(last.to-last.from)==2*8 && piece(d, last.to)==PAWN) {
+                int pretend_location = color(d, last.to) == WHITE ? last.to-8 : last.to+8;
+                for (int i = PAWN1; i <= PAWN8; i++)
+                    if (is_alive(d, turn+i) && d->piece_type[turn+i]==PAWN
+                     && (pawn_attacks[turn >> 4][d->piece_location[turn+i]] & BIT(pretend_location)))
+                        register_move(d, d->piece_location[turn+i], pretend_location);
+            }
+            g->cursor = ennemy+QUEEN1;
+            return false;
+        }
+
+        case TAKES: {   // the taken pieces from the queen to the pawns
+            if (g->cursor < ennemy+PAWN1) return false;
+            int taken = g->cursor--;
+            int pos = d->piece_location[taken];
+            if (!is_alive(d, taken) || !(d->covered[turn >> 4] & BIT(pos))) return true;
+            for (int i = PAWN1; i <= KING1; i++) {
+                if (!(mine[i] & BIT(pos))) continue;
+                register_move(d, d->piece_location[turn+i], pos);
+                if (d->piece_type[turn+i] == PAWN && (pos >= 070 || pos < 010))
+                    for (int n=0; n<3; n++)
+                        register_move(d, d->piece_location[turn+i], pos); // register underpromotion
+            }
+            return true;
+        }
+
+        case PROMOTIONS:
+            for (int pawn=turn+PAWN1; pawn <= turn+PAWN8; pawn++) {
+                if (!is_alive(d, pawn) || d->piece_type[pawn] != PAWN) continue;
+                int from = d->piece_location[pawn];
+                int to   = turn==WHITE ? from+8 : from-8;
+                if (is_empty(d, to) && (to >= 070 || to < 010))
+                    for (int i=0; i<4; i++)
+                        register_move(d, from, to); // register promotion and underpromotions
+            }
+            return false;
+
+        case CASTLES: {
+            int king_location = d->piece_location[turn+KING1];
+            int row = turn == WHITE ? 0 : 070;
+            if (king_location == 004+row && !bb_is_threaten(d, 004+row, ennemy)
+             && is_alive(d, turn+ROOK2) && d->piece_location[turn+ROOK2]==007+row
+             && is_empty(d, 005+row) && !bb_is_threaten(d, 005+row, ennemy)
+             && is_empty(d, 006+row) && !bb_is_threaten(d, 006+row, ennemy))
+                register_move(d, 004+row, 006+row);
+            if (king_location == 004+row && !bb_is_threaten(d, 004+row, ennemy)
+             && is_alive(d, turn+ROOK1) && d->piece_location[turn+ROOK1]==000+row
+             && is_empty(d, 001+row)
+             && is_empty(d, 002+row) && !bb_is_threaten(d, 002+row, ennemy)
+             && is_empty(d, 003+row) && !bb_is_threaten(d, 003+row, ennemy))
+                register_move(d, 004+row, 002+row);
+
+            g->reached = 0;
+            for (int i = KNIGHT1; i <= KING1; i++) g->reached |= mine[i];
+            g->reached &= ~d->occupied;
+            g->cursor = 033;
+            return false;
+        }
+
+        case PIECE_MOVES:   // the priorized locations...
+            if (!g->reached || g->cursor == END) {
+                g->reached = 0;
+                for (int i = PAWN1; i <= PAWN8; i++)
+                    if (d->piece_type[turn+i] != PAWN) g->reached |= mine[i];
+                g->reached &= ~d->occupied;
+                g->cursor = 033;
+                return false;
+            }
+            if (g->reached & BIT(g->cursor))
+                for (int i = KNIGHT1; i <= KING1; i++)
+                    if (mine[i] & BIT(g->cursor)) register_move(d, d->piece_location[turn+i], g->cursor);
+            g->cursor = next_location[g->cursor];
+            return true;
+
+        case PROMOTED_PIECE_MOVES:
+            if (!g->reached || g->cursor == END) {
+                g->cursor = turn+PAWN8;
+                return false;
+            }
+            if (g->reached & BIT(g->cursor))
+                for (int i = PAWN1; i <= PAWN8; i++)
+                    if (d->piece_type[turn+i] != PAWN && (mine[i] & BIT(g->cursor)))
+                        register_move(d, d->piece_location[turn+i], g->cursor);
+            g->cursor = next_location[g->cursor];
+            return true;
+
+        case PAWN_MOVES: {  // ... then the pawns
+            if (g->cursor < turn+PAWN1) return false;
+            int pawn = g->cursor--;
+            if (!is_alive(d, pawn) || d->piece_type[pawn] != PAWN) return true;
+            int forward_step = turn==WHITE ? +8 : -8;
+            int start_row    = turn==WHITE ?  1 :  6;
+            int from = d->piece_location[pawn];
+            int to   = from + forward_step;
+            if (is_empty(d, to) && to < 070 && to >= 010) { // promotions were already registered
+                register_move(d, from, to);
+                if (from / 8 == start_row && is_empty(d, to+forward_step))
+                    register_move(d, from, to+forward_step);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool more_moves(Decoder *d) {
+    Generator *g = &d->generator;
+    int nb_moves = d->nb_moves;
+    uint64_t start = STATS ? stats_ticks() : 0;
+    while (d->nb_moves == nb_moves && g->stage != DONE) {
+        if (!d->use_bitboards) {
+            ref_search_moves(d, g->turn, g->last);
+            g->stage = DONE;
+        }
+        else if (!bb_step(d, g)) g->stage++;
+    }
+    if (STATS) d->stats.generation_ticks += stats_ticks() - start;
+    return d->nb_moves > nb_moves;
+}
+
+bool generate_moves(Decoder *d, int turn, Move last, int count) {
+    start_moves(d, turn, last);
+    while (d->nb_moves < count && more_moves(d));
+    return d->nb_moves >= count;
+}
+
+int move_index(Decoder *d, int turn, Move last, Move m) {
+    start_moves(d, turn, last);
+    int i = 0;
+    do {
+        for (; i < d->nb_moves; i++)
+            if (d->moves[i].from == m.from && d->moves[i].to == m.to) return i+1;
+    } while (more_moves(d));
+    return 0;
+}
+
+void search_moves(Decoder *d, int turn, Move last) {
+    start_moves(d, turn, last);
+    while (more_moves(d));
+}
+
+void init_board(Decoder *d) {
+    static const Piece_types initial_type = {
+        PAWN, PAWN, PAWN, PAWN, PAWN, PAWN, PAWN, PAWN,
+        KNIGHT, KNIGHT, BISHOP, BISHOP, ROOK, ROOK, QUEEN, KING,
+        PAWN, PAWN, PAWN, PAWN, PAWN, PAWN, PAWN, PAWN,
+        KNIGHT, KNIGHT, BISHOP, BISHOP, ROOK, ROOK, QUEEN, KING
+    };
+    static const Locations initial_location = {
+        010, 011, 012, 013, 014, 015, 016, 017, // white pawns
+        001, 006, 002, 005, 000, 007, 003, 004, // white pieces
+        060, 061, 062, 063, 064, 065, 066, 067, // black pawns
+        071, 076, 072, 075, 070, 077, 073, 074  // black pieces
+    };
+    memcpy(d->piece_type, initial_type, sizeof initial_type);
+    memcpy(d->piece_location, initial_location, sizeof initial_location);
+
+    for (int pos = 0; pos < 64; pos++) d->board[pos] = EMPTY;
+    for (int piece = 0; piece < 32; piece++) {
+        d->board[d->piece_location[piece]] = piece;
+    }
+    init_attack_maps(d);
+    init_evaluation(d);
+}
+
+// takes the first free slot among the pieces from first to last (same colour)
+static int free_slot(Decoder *d, int first, int last) {
+    for (int pce = first; pce <= last; pce++)
+        if (d->piece_location[pce] == EMPTY) return pce;
+    return EMPTY;
+}
+
+// sets up a FEN position. The moves are generated with the piece numbers, so the rooks are
+// numbered after the castles (a-file rook = ROOK1 for the big castle, h-file rook = ROOK2),
+// and extra pieces become promoted pawns. The last move is made up for the en-passant square.
+int init_fen(Decoder *d, const char *fen, int *turn, Move *last) {
+    static const char names[] = "pnbrqk";
+    static const int  slots[6][2] = {   // range of piece numbers for each type
+        { PAWN1, PAWN8 }, { KNIGHT1, KNIGHT2 }, { BISHOP1, BISHOP2 }, { ROOK1, ROOK2 }, { QUEEN1, QUEEN1 }, { KING1, KING1 }
+    };
+    char placement[100], side[4] = "w", castles[8] = "-", en_passant[4] = "-";
+    if (sscanf(fen, "%99s %3s %7s %3s", placement, side, castles, en_passant) < 1) return ERROR;
+
+    for (int pos = 0; pos < 64; pos++) d->board[pos] = EMPTY;
+    for (int pce = 0; pce < 32; pce++) { d->piece_location[pce] = EMPTY; d->piece_type[pce] = PAWN; }
+
+    // pawns, then kings, then the other pieces, so that extra pieces find the free pawn slots
+    for (int pass = 0; pass < 3; pass++) {
+        int x = 0, y = 7;
+        for (const char *c = placement; *c; c++) {
+            if (*c == '/') { x = 0; y--; continue; }
+            if (*c >= '1' && *c <= '8') { x += *c - '0'; continue; }
+            const char *name = strchr(names, *c | 0x20);
+            if (!name || x > 7 || y < 0) return ERROR;
+            int type = name - names;
+            int col  = *c & 0x20 ? BLACK : WHITE;
+            int pos  = 8*y + x++;
+            if ((pass == 0) != (type == PAWN) || (pass == 1) != (type == KING)) continue;
+
+            int first = col + slots[type][0], last_slot = col + slots[type][1];
+            int row = col == WHITE ? 0 : 070;
+            int pce = EMPTY;
+            if (type == ROOK) { // the rook of a castle must have the right number, the other one mustn't
+                bool big   = pos == row + 000 && strchr(castles, col == WHITE ? 'Q' : 'q');
+                bool small = pos == row + 007 && strchr(castles, col == WHITE ? 'K' : 'k');
+                if      (big)   pce = free_slot(d, col+ROOK1, col+ROOK1);
+                else if (small) pce = free_slot(d, col+ROOK2, col+ROOK2);
+                else if (pos == row + 000) pce = free_slot(d, col+ROOK2, col+ROOK2);
+                else if (pos == row + 007) pce = free_slot(d, col+ROOK1, col+ROOK1);
+                else                       pce = free_slot(d, first, last_slot);
+                if (pce == EMPTY && (pos == row + 000 || pos == row + 007)) pce = free_slot(d, col+PAWN1, col+PAWN8);
+            }
+            if (pce == EMPTY) pce = free_slot(d, first, last_slot);
+            if (pce == EMPTY) pce = free_slot(d, col+PAWN1, col+PAWN8);
+            if (pce == EMPTY) return ERROR;
+            d->piece_type[pce] = type;
+            d->piece_location[pce] = pos;
+            d->board[pos] = pce;
+        }
+    }
+    if (d->piece_location[WHITE+KING1] == EMPTY || d->piece_location[BLACK+KING1] == EMPTY) return ERROR;
+
+    *turn = side[0] == 'b' ? BLACK : WHITE;
+    last->from = last->to = d->piece_location[adverse(*turn)+KING1]; // the generator looks at the piece on last.to
+    if (en_passant[0] >= 'a' && en_passant[0] <= 'h') { // the pawn has just moved two squares
+        int pos = 8*(en_passant[1] - '1') + en_passant[0] - 'a';
+        int step = *turn == WHITE ? -8 : +8;
+        last->from = pos - step;
+        last->to   = pos + step;
+    }
+    init_attack_maps(d);
+    init_evaluation(d);
+    return OK;
+}
+
+void init_tables(void) {
+    init_bitboards();
+    init_evaluation_tables();
+}
+
+void init_decoder(Decoder *d) {
+    d->use_bitboards = BITBOARDS;
+    d->book = (Book_file){ 0 };
+    d->index = NULL;
+    d->book_indx = 0;
+    d->out = stdout;
+    d->emitter = &text_emitter;
+    d->emitter_state = NULL;
+    d->split = NULL;
+    d->split_depth = 0;
+    d->user = NULL;
+    memset(&d->stats, 0, sizeof d->stats);
+    init_board(d);
+}
+
+void print_move(Decoder *d, int ply, Move m) {
+    for (int i = 0; i < ply; i++) fprintf(d->out, "     ");
+    fprintf(d->out, "%2d. ", ply);
+//    if (ply % 2 == 1) printf("  ..  ");
+    int x1 = m.from % 8, y1 = m.from / 8;
+    int x2 = m.to   % 8, y2 = m.to   / 8;
+    char separator = is_empty(d, m.to) ? '-' : 'x';
+    fprintf(d->out, "%c%c%c%c%c",'A'+x1,'1'+y1,separator,'A'+x2,'1'+y2);
+}
+
+void print_moves(Decoder *d, int ply) {
+    for (int i=0; i<d->nb_moves; i++) {
+        fprintf(d->out, "%02x: ", i+1);
+        print_move(d, ply, d->moves[i]);
+        fprintf(d->out, "\n");
+    }
+}
+
+// every change of occupancy is immediately followed by update_rays(), and pieces are removed from
+// the accessibility tables before they move (or are taken) and set again once they have landed
+static void move_rook(Decoder *d, int from, int to) {
+    int rook = d->board[from];
+    toggle_attacks(d, rook);
+    d->board[from] = EMPTY;
+    update_rays(d, from);
+    d->board[to] = rook;
+    update_rays(d, to);
+    d->piece_location[rook] = to;
+    toggle_attacks(d, rook);
+}
+
+Undo do_move(Decoder *d, Move m) {
+    assert( !is_empty(d, m.from) );
+    uint64_t start = STATS ? stats_ticks() : 0;
+    int p     = d->board[m.from];
+    int taken = d->board[m.to];
+    int x1 = m.from % 8, y1 = m.from / 8;
+    int x2 = m.to   % 8;
+    bool pawn_move = piece(d, m.from) == PAWN;
+    Undo undo = { .move = m, .piece = p, .taken = taken, .taken_location = m.to,
+                  .rook_from = EMPTY, .rook_to = EMPTY, .promoted = false };
+
+    toggle_attacks(d, p);
+    count_piece(d, p, -1);
+    if (taken != EMPTY) toggle_attacks(d, taken);
+    if (pawn_move && taken == EMPTY && abs(x1-x2)==1) { // en-passant
+        undo.taken_location = x2 + y1 * 8;
+        taken = undo.taken = d->board[undo.taken_location];
+        toggle_attacks(d, taken);
+        d->board[undo.taken_location] = EMPTY;
+        update_rays(d, undo.taken_location);
+    } 
+    if (taken != EMPTY) {
+        count_piece(d, taken, -1);
+        d->piece_location[taken] = EMPTY;
+    }
+    bool was_empty = is_empty(d, m.to);
+    d->board[m.from] = EMPTY;
+    update_rays(d, m.from);
+    d->board[m.to] = p;
+    if (was_empty) update_rays(d, m.to);
+    d->piece_location[p] = m.to;
+
+    if (piece(d, m.to) == KING && m.to == m.from + 2) { // small castle
+        undo.rook_from = m.to + 1;
+        undo.rook_to   = m.to - 1;
+    }
+    if (piece(d, m.to) == KING && m.to == m.from - 2) { // big castle
+        undo.rook_from = m.to - 2;
+        undo.rook_to   = m.to + 1;
+    }
+    if (undo.rook_from != EMPTY) move_rook(d, undo.rook_from, undo.rook_to);
+    if (pawn_move && (m.to >= 070 || m.to < 010)) { // promotion
+        d->piece_type[d->board[m.to]] = QUEEN;    // no underpromotion for now
+        undo.promoted = true;
+    }
+    count_piece(d, p, +1);
+    toggle_attacks(d, p);
+    if (STATS) {
+        d->stats.moves_done++;
+        d->stats.move_ticks += stats_ticks() - start;
+    }
+    return undo;
+}
+
+// restore the position before do_move(), changed locations only (L66A1)
+void undo_move(Decoder *d, Undo u) {
+    int p = u.piece;
+
+    toggle_attacks(d, p);
+    count_piece(d, p, -1);
+    if (u.promoted) d->piece_type[p] = PAWN;
+    if (u.rook_from != EMPTY) move_rook(d, u.rook_to, u.rook_from);
+
+    if (u.taken != EMPTY && u.taken_location == u.move.to)
+        d->board[u.move.to] = u.taken;    // still occupied, no ray to update
+    else {
+        d->board[u.move.to] = EMPTY;
+        update_rays(d, u.move.to);
+    }
+    d->board[u.move.from] = p;
+    d->piece_location[p] = u.move.from;
+    update_rays(d, u.move.from);
+
+    if (u.taken != EMPTY) {
+        if (u.taken_location != u.move.to) { // en-passant
+            d->board[u.taken_location] = u.taken;
+            update_rays(d, u.taken_location);
+        }
+        d->piece_location[u.taken] = u.taken_location;
+        count_piece(d, u.taken, +1);
+        toggle_attacks(d, u.taken);
+    }
+    count_piece(d, p, +1);
+    toggle_attacks(d, p);
+}
+
+// walks the variations starting at indx like decode_variations(), returns the offset after them
+static int index_variations(Book_index *index, const Book_file *book, int indx) {
+    int first = indx, count = 0;
+    int flags;
+    do {
+        int entry = indx;
+        flags = byte_at(book, indx) & 0xC0;
+        if (flags == 0xC0) {
+            if (byte_at(book, indx) & 7) { indx += 5; index->end[entry] = indx; count++; break; } // sub-book name
+            indx += 1;
+        }
+        if ((byte_at(book, indx) & 0x3F) == 0) break;
+        indx++;
+        if (flags != 0x40) indx = index_variations(index, book, indx);
+        index->end[entry] = indx;
+        count++;
+    } while (flags & 0x80);
+    index->nb_variations[first] = count;
+    return indx;
+}
+
+int init_book(Decoder *d, const char *name) {
+    Book_file book;
+    if (map_book(&book, name) != OK) return ERROR;
+    return init_book_file(d, book);
+}
+
+int init_book_file(Decoder *d, Book_file book) {
+    // a list can start just after a truncated sub-book name at the end of the file
+    Book_index *index = malloc(sizeof *index);
+    index->end = calloc(book.size + 8, sizeof *index->end);
+    index->nb_variations = calloc(book.size + 8, sizeof *index->nb_variations);
+    index_variations(index, &book, 0);
+
+    d->book = book;
+    d->index = index;
+    d->book_indx = 0;
+    return OK;
+}
+
+void close_book(Decoder *d) {
+    if (d->index) {
+        free(d->index->end);
+        free(d->index->nb_variations);
+        free((void *)d->index);
+    }
+    unmap_book(&d->book);
+    d->index = NULL;
+}
+
+// skip silently what decode_variations() would read
+void skip_variations(Decoder *d) {
+    if (d->index) {
+        for (int n = d->index->nb_variations[d->book_indx]; n > 0; n--)
+            d->book_indx = d->index->end[d->book_indx];
+        return;
+    }
+
+    int flags;
+    do {
+        flags = byte_at(&d->book, d->book_indx) & 0xC0;
+        if (flags == 0xC0) {
+            if (byte_at(&d->book, d->book_indx) & 7) { d->book_indx += 5; return; } // sub-book name
+            d->book_indx += 1;
+        }
+        if ((byte_at(&d->book, d->book_indx) & 0x3F) == 0) return;
+        d->book_indx++;
+        if (flags != 0x40) skip_variations(d);
+    } while (flags & 0x80);
+}
+
+// offset of the entry for move_indx among the variations starting at book_indx, or EMPTY (LA473)
+int find_variation(Decoder *d, int move_indx) {
+    int entry = d->book_indx;
+    for (int n = d->index->nb_variations[entry]; n > 0; n--, entry = d->index->end[entry]) {
+        int byte = byte_at(&d->book, entry);
+        if ((byte & 0xC0) == 0xC0) {
+            if (byte & 7) continue;     // sub-book link (C5 entry), never a move, as for decode_variations()
+            byte = byte_at(&d->book, entry+1);
+        }
+        if ((byte & 0x3F) == move_indx) return entry;
+    }
+    return EMPTY;
+}
+
+// number of variations the "random" choice is made among, minus one (LA50B):
+// the leading variations followed by others, as long as they are recommended ones
+// (all of them if all_variations, like when bit 6 of $1163 is set)
+int count_variations(Decoder *d, bool all_variations) {
+    int entry = d->book_indx, count = 0;
+    for (int n = d->index->nb_variations[entry]; n > 1; n--, entry = d->index->end[entry]) {
+        if (!(byte_at(&d->book, entry) & 0x80)) break;
+        if (!all_variations && byte_at(&d->book, entry) != 0xC0) break;
+        count++;
+    }
+    return count;
+}
+
+// "random" choice of a variation (LA52E), random being the value of $A9: offset of its entry
+int choose_variation(Decoder *d, int random, bool all_variations) {
+    int count = count_variations(d, all_variations);
+    int mask = 0;
+    for (int n = count; n; n >>= 1) mask = mask << 1 | 1;
+    int chosen = random & mask;
+    if (chosen > count) chosen = 0;
+
+    int entry = d->book_indx;
+    while (chosen--) entry = d->index->end[entry];
+    return entry;
+}
+
+void decode_variations(Decoder *d, int depth, Move last) {
+    int turn = odd(depth) ? BLACK : WHITE;
+
+    int flags;
+    do {
+        Node node = { .kind = MOVE_NODE, .depth = depth, .offset = d->book_indx };
+        flags     = byte_at(&d->book, d->book_indx) & 0xC0;
+        if (flags == 0xC0) {
+            if (byte_at(&d->book, d->book_indx) & 7) { // sub-book name
+                node.kind = SUB_BOOK_NODE;
+                for (int i = 0; i < 4; i++) node.sub_book[i] = byte_at(&d->book, d->book_indx + 1 + i);
+                d->emitter->node(d, &node);
+                d->book_indx += 5;
+                break;
+            }
+            d->book_indx += 1;
+            assert( (byte_at(&d->book, d->book_indx) & 0xC0) == 0 );
+        }
+        node.offset = d->book_indx;
+        node.recommended = flags == 0xC0;
+
+        assert( (byte_at(&d->book, d->book_indx) & 0xC0) != 0xC0 );
+        node.move_indx = byte_at(&d->book, d->book_indx) & 0x3F;
+        // the SAN needs the other moves to the same location
+        if (d->emitter->needs_san) search_moves(d, turn, last);
+        else generate_moves(d, turn, last, node.move_indx);
+//        print_moves(depth);
+        node.nb_moves  = d->nb_moves;
+        if (STATS) {
+            d->stats.nodes[depth < STATS_DEPTHS ? depth : STATS_DEPTHS - 1]++;
+            d->stats.generated += node.nb_moves;
+            d->stats.used += node.move_indx;
+        }
+        if (node.move_indx == 0) {
+            node.kind = END_NODE;
+            d->emitter->node(d, &node);
+            break;
+        }
+
+        Move m = d->moves[node.move_indx-1];
+        node.move  = m;
+        node.taken = !is_empty(d, m.to);
+        if (d->emitter->needs_san) san_move(d, m, node.san);
+        Undo undo = do_move(d, m);
+        node.promoted = undo.promoted;
+        node.check    = is_check(d, adverse(turn));
+        if (node.check && d->emitter->needs_san) strcat(node.san, "+");
+        d->emitter->node(d, &node);
+
+        d->book_indx++;
+        if (flags != 0x40) {
+            if (d->split && depth + 1 == d->split_depth) d->split(d, depth + 1, m);
+            else decode_variations(d, depth + 1, m);
+        }
+
+        // back to the position of this node for the next sibling
+        undo_move(d, undo);
+    } while (flags & 0x80);
+}
+
+void decode_book(Decoder *d) {
+    Move none = { 0, 0};
+    init_board(d);
+    d->book_indx = 0;
+    d->emitter->begin_book(d);
+    decode_variations(d, 0, none);
+    d->emitter->end_book(d);
+}
+
+// index (from 1) of a SAN among the generated moves, 0 if not found: the first one for the
+// promotions (generated 4 times), and the legal one when the SAN leaves out a pinned piece
+int find_san(Decoder *d, const char *san, int turn) {
+    const char *s = san;
+    int type = PAWN, file = -1, rank = -1, to;
+    int row = turn == WHITE ? 0 : 070;
+    if (strncmp(s, "O-O-O", 5) == 0 || strncmp(s, "0-0-0", 5) == 0) { type = KING; file = 4; rank = row/8; to = row + 2; }
+    else if (strncmp(s, "O-O", 3) == 0 || strncmp(s, "0-0", 3) == 0) { type = KING; file = 4; rank = row/8; to = row + 6; }
+    else {
+        const char *letter = strchr("NBRQK", *s);
+        if (*s && letter) { type = letter - "NBRQK" + KNIGHT; s++; }
+        // the destination is the last square of the SAN, before a promotion
+        int len = strlen(s);
+        while (len > 0 && !isdigit(s[len-1])) len--;
+        if (len < 2 || s[len-2] < 'a' || s[len-2] > 'h' || s[len-1] < '1' || s[len-1] > '8') return 0;
+        to = 8*(s[len-1]-'1') + s[len-2]-'a';
+        for (int i = 0; i < len-2; i++) {
+            if (s[i] >= 'a' && s[i] <= 'h') file = s[i]-'a';
+            if (s[i] >= '1' && s[i] <= '8') rank = s[i]-'1';
+        }
+    }
+    // the SAN only tells apart the legal moves, the generator doesn't know about pins
+    int first = 0;
+    for (int i = 0; i < d->nb_moves; i++) {
+        Move m = d->moves[i];
+        if (m.to != to || d->piece_type[d->board[m.from]] != type) continue;
+        if ((file >= 0 && m.from % 8 != file) || (rank >= 0 && m.from / 8 != rank)) continue;
+        if (!first) first = i+1;
+        Undo undo = do_move(d, m);
+        bool legal = !is_check(d, turn);
+        undo_move(d, undo);
+        if (legal) return i+1;
+    }
+    return first;
+}
+
+// standard algebraic notation of one of the generated moves, in the position before it
+void san_move(Decoder *d, Move m, char *san) {
+    static const char letters[] = "PNBRQK";
+    int type = piece(d, m.from);
+    int x1 = m.from % 8, y1 = m.from / 8;
+    int x2 = m.to   % 8, y2 = m.to   / 8;
+    bool takes = !is_empty(d, m.to) || (type == PAWN && x1 != x2);
+
+    if (type == KING && abs(x2 - x1) == 2) {
+        strcpy(san, x2 > x1 ? "O-O" : "O-O-O");
+        return;
+    }
+    char *s = san;
+    if (type == PAWN) {
+        if (takes) *s++ = 'a' + x1;
+    } else {
+        *s++ = letters[type];
+        // other pieces of the same type going there: file, rank, or both to tell them apart
+        bool ambiguous = false, same_file = false, same_rank = false;
+        for (int i = 0; i < d->nb_moves; i++) {
+            Move other = d->moves[i];
+            if (other.to != m.to || other.from == m.from || piece(d, other.from) != type) continue;
+            Undo undo = do_move(d, other);
+            bool legal = !is_check(d, color(d, other.to));
+            undo_move(d, undo);
+            if (!legal) continue;
+            ambiguous = true;
+            if (other.from % 8 == x1) same_file = true;
+            if (other.from / 8 == y1) same_rank = true;
+        }
+        if (ambiguous && (!same_file || same_rank)) *s++ = 'a' + x1;
+        if (ambiguous && same_file) *s++ = '1' + y1;
+    }
+    if (takes) *s++ = 'x';
+    *s++ = 'a' + x2;
+    *s++ = '1' + y2;
+    if (type == PAWN && (y2 == 7 || y2 == 0)) { *s++ = '='; *s++ = 'Q'; }  // no underpromotion for now
+    *s = '\0';
+}
+
+/*
+ * Emitters: every node is formatted in a local buffer and written at once,
+ * the caller gives the output stream a large buffer (or a memory stream).
+ */
+
+static void no_event(Decoder *d) { (void)d; }
+
+static void text_node(Decoder *d, const Node *n) {
+    char line[5 * MAX_DEPTH + 64];
+    int len = 0;
+    switch (n->kind) {
+        case SUB_BOOK_NODE:
+            len = sprintf(line, " => %.4s", n->sub_book);
+            break;
+        case END_NODE:
+            line[len++] = '\n';
+            break;
+        case MOVE_NODE:
+            line[len++] = '\n';
+            if (n->move_indx > n->nb_moves) len += sprintf(line+len, "%02x > %02x !!!\n", n->move_indx, n->nb_moves);
+            for (int i = 0; i < n->depth; i++) {
+                if (len + 64 > (int)sizeof line) { fwrite(line, 1, len, d->out); len = 0; }  // deeper than any book
+                len += sprintf(line+len, "     ");
+            }
+            len += sprintf(line+len, "%2d. %c%c%c%c%c", n->depth,
+                           'A' + n->move.from % 8, '1' + n->move.from / 8, n->taken ? 'x' : '-',
+                           'A' + n->move.to   % 8, '1' + n->move.to   / 8);
+            if (n->promoted)    len += sprintf(line+len, "=Q");     // no underpromotion for now
+            if (n->check)       line[len++] = '+';
+            if (n->recommended) line[len++] = '!';                  // recommended move
+            break;
+    }
+    fwrite(line, 1, len, d->out);
+}
+
+// the offset after the book, none if the nodes aren't read from a Sargon book (book_succinct)
+static void text_end_book(Decoder *d) {
+    if (d->book_indx != EMPTY) fprintf(d->out, "\nEnd at %03x\n", d->book_indx);
+    else putc('\n', d->out);
+}
+
+const Emitter text_emitter = { "text", false, true, no_event, text_node, text_end_book };
+
+// PGN: the main line of a position comes after the other variations, so the tree is kept until the end
+typedef struct Pgn_node Pgn_node;
+struct Pgn_node {
+    Node      node;
+    Pgn_node *first_child, *last_child, *next;
+};
+
+typedef struct {
+    Pgn_node  root;
+    Pgn_node *last[MAX_DEPTH];  // last node seen at each depth
+    int       column;
+} Pgn_state;
+
+static void pgn_begin_book(Decoder *d) {
+    Pgn_state *pgn = calloc(1, sizeof *pgn);
+    d->emitter_state = pgn;
+    fprintf(d->out, "[Event \"Sargon III Openings Library\"]\n[Site \"?\"]\n[Date \"????.??.??\"]\n[Round \"-\"]\n"
+                    "[White \"?\"]\n[Black \"?\"]\n[Result \"*\"]\n\n");
+}
+
+static void pgn_node(Decoder *d, const Node *n) {
+    Pgn_state *pgn = d->emitter_state;
+    if (n->kind == END_NODE || n->depth >= MAX_DEPTH) return;
+    Pgn_node *parent = n->depth == 0 ? &pgn->root : pgn->last[n->depth - 1];
+    if (!parent) return;
+    Pgn_node *p = calloc(1, sizeof *p);
+    p->node = *n;
+    if (parent->last_child) parent->last_child->next = p;
+    else                    parent->first_child = p;
+    parent->last_child = p;
+    pgn->last[n->depth] = p;
+}
+
+// writes a token, after a space if asked, lines are kept under 80 characters
+static void pgn_write(Decoder *d, const char *token, bool space) {
+    Pgn_state *pgn = d->emitter_state;
+    int len = strlen(token);
+    space = space && pgn->column > 0;
+    if (pgn->column > 0 && pgn->column + space + len >= 80) { putc('\n', d->out); pgn->column = 0; space = false; }
+    if (space) { putc(' ', d->out); pgn->column++; }
+    fwrite(token, 1, len, d->out);
+    pgn->column += len;
+}
+
+// the move of a nested variation is written with its "(", so that they stay on the same line
+static void pgn_move(Decoder *d, const Node *n, bool number, bool space, bool nested) {
+    char token[32];
+    int len = nested ? sprintf(token, "(") : 0;
+    if (n->depth % 2 == 0) len += sprintf(token + len, "%d. ", n->depth / 2 + 1);
+    else if (number)       len += sprintf(token + len, "%d... ", n->depth / 2 + 1);
+    sprintf(token + len, "%s%s", n->san, n->recommended ? "!" : "");
+    pgn_write(d, token, space);
+}
+
+static void pgn_sub_book(Decoder *d, const Node *n) {
+    char token[16];
+    sprintf(token, "{=> %.4s}", n->sub_book);
+    pgn_write(d, token, true);
+}
+
+// a list of variations: the first one is the main line, the others nested
+static void pgn_variations(Decoder *d, Pgn_node *first, bool number) {
+    // sub-books first, so that the comment is about this position
+    Pgn_node *main = NULL;
+    for (Pgn_node *p = first; p; p = p->next) {
+        if (p->node.kind == SUB_BOOK_NODE) { pgn_sub_book(d, &p->node); number = true; }
+        else if (!main) main = p;
+    }
+    if (!main) return;
+    pgn_move(d, &main->node, number, true, false);
+
+    bool nested = false;
+    for (Pgn_node *p = main->next; p; p = p->next) {
+        if (p->node.kind == SUB_BOOK_NODE) continue;
+        pgn_move(d, &p->node, true, true, true);
+        pgn_variations(d, p->first_child, false);
+        pgn_write(d, ")", false);
+        nested = true;
+    }
+    pgn_variations(d, main->first_child, nested);
+}
+
+static void pgn_free(Pgn_node *p) {
+    while (p) {
+        Pgn_node *next = p->next;
+        pgn_free(p->first_child);
+        free(p);
+        p = next;
+    }
+}
+
+static void pgn_end_book(Decoder *d) {
+    Pgn_state *pgn = d->emitter_state;
+    pgn_variations(d, pgn->root.first_child, false);
+    pgn_write(d, "*", true);
+    putc('\n', d->out);
+    pgn_free(pgn->root.first_child);
+    free(pgn);
+    d->emitter_state = NULL;
+}
+
+const Emitter pgn_emitter = { "pgn", true, false, pgn_begin_book, pgn_node, pgn_end_book };
+
+// JSON lines: {"ply":1,"san":"e4","from":"e2","to":"e4","index":12,"offset":0,"recommended":false}
+static void json_node(Decoder *d, const Node *n) {
+    char line[256];
+    int len = 0;
+    if (n->kind == SUB_BOOK_NODE)
+        len = sprintf(line, "{\"ply\":%d,\"sub_book\":\"%.4s\",\"offset\":%d}\n", n->depth + 1, n->sub_book, n->offset);
+    if (n->kind == MOVE_NODE)
+        len = sprintf(line, "{\"ply\":%d,\"san\":\"%s\",\"from\":\"%c%c\",\"to\":\"%c%c\",\"index\":%d,\"offset\":%d,\"recommended\":%s}\n",
+                      n->depth + 1, n->san, 'a' + n->move.from % 8, '1' + n->move.from / 8,
+                      'a' + n->move.to % 8, '1' + n->move.to / 8, n->move_indx, n->offset, n->recommended ? "true" : "false");
+    fwrite(line, 1, len, d->out);
+}
+
+const Emitter json_emitter = { "json", true, true, no_event, json_node, no_event };
+
+// binary: 8 bytes per node, depth, flags, from, to, offset (little endian),
+// followed by the 4 characters of the name for a sub-book (flag 0x80)
+static void binary_node(Decoder *d, const Node *n) {
+    if (n->kind == END_NODE) return;
+    uint8_t record[12] = {
+        n->depth,
+        (n->recommended ? 1 : 0) | (n->taken ? 2 : 0) | (n->check ? 4 : 0) | (n->promoted ? 8 : 0)
+            | (n->kind == SUB_BOOK_NODE ? 0x80 : 0),
+        n->move.from, n->move.to,
+        n->offset, n->offset >> 8, n->offset >> 16, n->offset >> 24
+    };
+    int len = 8;
+    if (n->kind == SUB_BOOK_NODE) {
+        record[2] = record[3] = 0;
+        memcpy(record + 8, n->sub_book, 4);
+        len = 12;
+    }
+    fwrite(record, 1, len, d->out);
+}
+
+const Emitter binary_emitter = { "binary", false, true, no_event, binary_node, no_event };
+
+const Emitter *find_emitter(const char *name) {
+    static const Emitter *emitters[] = { &text_emitter, &pgn_emitter, &json_emitter, &binary_emitter };
+    for (int i = 0; i < 4; i++)
+        if (strcmp(emitters[i]->name, name) == 0) return emitters[i];
+    return NULL;
+}
@@ -0,0 +1,192 @@
+#ifndef SARGON_H
+#define SARGON_H
+
+/*
+ * Sargon III move generator and Openings Library decoder.
+ *
+ * All the state lives in a Decoder context, so that several books can be decoded
+ * at the same time (one context per thread). init_tables() must be called once
+ * before any context is used.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "book_file.h"
+#include "trace.h"
+
+#define WHITE 0
+#define BLACK 0x10
+#define EMPTY -1
+#define END   -1
+#define ERROR 1
+#define OK    0
+
+// default move generator backend, can be changed at build time with -DBITBOARDS=0
+#ifndef BITBOARDS
+#define BITBOARDS 1
+#endif
+
+// with -DCHECKED=1, the board is checked before every generation (see check_board)
+#ifndef CHECKED
+#define CHECKED 0
+#endif
+
+#define MAX_DEPTH 256           // of the lines laid out by the emitters, and of the tools walking the books
+
+// with -DSTATS=1 (trace.h), the decoder counts what it does in its Stats
+#define STATS_DEPTHS 32
+
+enum Types { PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING };
+enum Pieces{ PAWN1, PAWN2, PAWN3, PAWN4, PAWN5, PAWN6, PAWN7, PAWN8, KNIGHT1, KNIGHT2, BISHOP1, BISHOP2, ROOK1, ROOK2, QUEEN1, KING1 };
+
+typedef struct { int from, to; } Move;
+#define MAX_MOVES 256           // legal positions have up to 218 moves, the promotions are generated 4 times
+typedef Move Moves[MAX_MOVES];
+typedef int8_t Board[64];       // piece numbers : 0-15 white pieces, 16-31 black pieces
+typedef int8_t Locations[32];   // locations of the 32 pieces
+typedef int8_t Piece_types[32];
+typedef uint16_t Attack_map[2][64];
+typedef uint64_t Bitboard;
+
+// what do_move() changed, enough for undo_move() to restore the position (like $88/$89/$9C for L66A1)
+typedef struct {
+    Move   move;
+    int8_t piece;           // moved piece
+    int8_t taken;           // taken piece, EMPTY if it was only a move
+    int8_t taken_location;  // not the destination for an en-passant take
+    int8_t rook_from;       // castling rook, EMPTY if not a castle
+    int8_t rook_to;
+    bool   promoted;        // the pawn became a queen
+} Undo;
+
+// static evaluation, kept up to date by do_move() and undo_move() like the attack maps (see evaluation())
+typedef struct {
+    int32_t material;           // values of $61A4/$61B0 and advance of the pawns, white minus black, in 1/256 pawn
+    int32_t mobility;           // locations reached (twice in the centre) in the attack maps, kings left out
+    int8_t  balance;            // $F8: values of $6198 in pawns, white minus black
+    int8_t  nb_pieces, nb_pawns;    // white knights to queen, white pawns, for the trades of L7B80
+} Evaluation;
+
+// built in one pass when the book is loaded, so that skipping variations doesn't scan them
+typedef struct {
+    int32_t *end;               // for each entry (move, recommended move or sub-book): offset after its variations
+    uint8_t *nb_variations;     // for each first entry of a list of variations: number of entries in the list
+} Book_index;
+
+// only counted with -DSTATS=1, all zeros otherwise
+typedef struct {
+    long     generations;       // start_moves(): search_moves(), generate_moves(), move_index()
+    long     under_check;       // the ones that took the path of search_moves_under_check()
+    long     threats;           // is_threaten(), the bitboard one included
+    long     moves_done;        // do_move()
+    uint64_t generation_ticks, move_ticks;  // stats_ticks() in more_moves() and do_move()
+    long     nodes[STATS_DEPTHS];   // book entries by depth (the deeper ones in the last)
+    long     generated, used;   // moves generated to reach the book moves, and their indexes
+} Stats;
+
+typedef struct Decoder Decoder;
+
+// what decode_variations() found at some point of the book, for the emitters
+enum Node_kinds { MOVE_NODE, SUB_BOOK_NODE, END_NODE };  // END_NODE: null move index (end of the book)
+typedef struct {
+    int   kind;
+    int   depth;                // 0 for the first move
+    int   offset;               // of the move byte (of the C5 byte for a sub-book) in the book
+    int   move_indx, nb_moves;  // move index in the book, and number of moves generated to reach it (all of them if fewer)
+    Move  move;
+    char  san[10];              // standard algebraic notation, only if the emitter needs it
+    char  sub_book[5];
+    bool  taken;                // the destination was occupied (not for en-passant)
+    bool  promoted, check, recommended;
+} Node;
+
+// writes the decoded tree in some format, through the output stream of the decoder
+typedef struct {
+    const char *name;
+    bool  needs_san;
+    bool  can_split;            // the output of split tasks can be concatenated
+    void (*begin_book)(Decoder *d);
+    void (*node)(Decoder *d, const Node *n);
+    void (*end_book)(Decoder *d);
+} Emitter;
+
+extern const Emitter text_emitter;      // indented tree, as always
+extern const Emitter pgn_emitter;       // one game with nested variations
+extern const Emitter json_emitter;      // one JSON object per line and node
+extern const Emitter binary_emitter;    // fixed size records, see binary_node()
+const Emitter *find_emitter(const char *name);
+
+// where the lazy generation of the moves goes on (start_moves, more_moves)
+typedef struct {
+    int      turn;
+    Move     last;
+    int      stage, cursor;     // enum Stages of sargon.c, and taken piece, location or pawn in the stage
+    Bitboard reached;           // destinations of the piece moves
+} Generator;
+
+struct Decoder {
+    // position
+    Board       board;
+    Locations   piece_location;
+    Piece_types piece_type;
+    Attack_map  attack_map;     // accessibility tables, kept up to date by do_move() and undo_move()
+    Evaluation  eval;           // idem
+
+    // generated moves
+    Moves       moves;
+    int         nb_moves;
+    Generator   generator;
+    bool        use_bitboards;  // bitboard backend instead of the reference one
+    Bitboard    occupied, attacks[32], covered[2];  // bitboard backend, set by scan_position()
+
+    // opening book
+    Book_file   book;           // read only, can be shared by several contexts
+    const Book_index *index;    // idem
+    int         book_indx;
+    FILE       *out;            // where the decoded tree is printed
+    const Emitter *emitter;     // how, text_emitter by default
+    void       *emitter_state;
+
+    // parallel decoding: the variations at depth split_depth are handed over to split()
+    // instead of being decoded, and split() must skip them (skip_variations)
+    int         split_depth;
+    void      (*split)(Decoder *d, int depth, Move last);
+    void       *user;
+
+    Stats       stats;          // -DSTATS=1
+};
+
+void init_tables(void);
+void init_decoder(Decoder *d);  // initial position, output to stdout
+void init_board(Decoder *d);
+int  init_fen(Decoder *d, const char *fen, int *turn, Move *last);    // OK, or ERROR if not a valid position
+int  init_book(Decoder *d, const char *name);
+int  init_book_file(Decoder *d, Book_file book);  // a book already in memory (e.g. from a disk image), freed by close_book()
+void close_book(Decoder *d);
+
+void search_moves(Decoder *d, int turn, Move last);
+void start_moves(Decoder *d, int turn, Move last);  // the moves of search_moves() are then generated by more_moves()
+bool more_moves(Decoder *d);    // at least one more move in d->moves, false if they are all there
+bool generate_moves(Decoder *d, int turn, Move last, int count);   // at least the first count moves, false if there are fewer
+int  move_index(Decoder *d, int turn, Move last, Move m);  // index (from 1) of the first m, 0 if not generated
+Undo do_move(Decoder *d, Move m);
+void undo_move(Decoder *d, Undo u);
+bool is_threaten(Decoder *d, int pos, int attacker);
+bool is_check(Decoder *d, int king_color);
+int  check_board(Decoder *d);   // OK, or ERROR if the board, the piece locations, the attack maps and the evaluation don't agree
+int  evaluation(Decoder *d);    // in 1/256 pawn, white minus black
+
+void print_board(Decoder *d);
+void print_move(Decoder *d, int ply, Move m);
+void print_moves(Decoder *d, int ply);
+void san_move(Decoder *d, Move m, char *san);  // before the move, among the generated moves, without check
+int  find_san(Decoder *d, const char *san, int turn);  // index (from 1) among the generated moves, 0 if not found
+void skip_variations(Decoder *d);
+int  find_variation(Decoder *d, int move_indx);
+int  count_variations(Decoder *d, bool all_variations);
+int  choose_variation(Decoder *d, int random, bool all_variations);
+void decode_variations(Decoder *d, int depth, Move last);
+void decode_book(Decoder *d);   // whole book from the initial position
+
+#endif
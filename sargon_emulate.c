@@ -0,0 +1,466 @@
+/*
+ * Runs the original Sargon III code of sargon3_disassembly.txt on a 6502 emulator,
+ * as a reference for the C move generator and as a profile of the original engine.
+ *
+ *   moves [depth [fen...]] : on the test positions (or the given ones), walks the tree of legal
+ *                            moves and compares the moves generated by L68F9 (in this order)
+ *                            with search_moves() at every node
+ *   book file...           : same comparison at every position of the book files
+ *   think [level [fen]]    : lets Sargon choose a move (LA0E5), as in a game at this level
+ *
+ * The program is initialized for a new game (L9FBF), then the positions are set up with its
+ * routines (L97C3, L97E2, L9838), and the moves are collected through the $AE hook, like
+ * L964D does when it checks the move of the player.
+ * The Apple II ROM routines return at once, the soft switches read 0 (no key pressed),
+ * and the RWTS ($03D9) returns an I/O error. With -p, the cycles and calls of each routine
+ * (the JSR targets), while generating or thinking, are printed at the end: self cycles are
+ * the ones spent before it returns, out of the routines it calls, total cycles include them.
+ *
+ *   cc -O2 -o sargon_emulate sargon_emulate.c cpu6502.c listing.c sargon.c book_file.c
+ *   sargon_emulate [-l listing] [-p] [-b|-r] [moves [depth [fen...]] | book file... | think [level [fen]]]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sargon.h"
+#include "cpu6502.h"
+#include "listing.h"
+
+// entry points and variables of the program
+#define NEW_GAME     0x9FBF     // L9FBF: variables of a new game, initial position
+#define NEXT_MOVE    0x63F5     // L63F5: back to the generator after a move, X kept (like the action at 9662)
+#define GENERATE     0x68F9     // L68F9: numbers the moves from 0 in $9B, and generates them (L68FD)
+#define CLEAR_BOARD  0x97C3     // L97C3: empty board, all pieces taken
+#define INIT_TYPES   0x97E2     // L97E2: types of the pieces ($1320) of the initial position
+#define SCAN_BOARD   0x9838     // L9838: locations, moved flags and accessibility tables from the board
+#define THINK        0xA0E5     // LA0E5: chooses the move of the side to play
+#define RWTS         0x03D9     // DOS entry of the disk routines, (A,Y) = IOB
+#define MOVE_HOOK    0x00AE     // JMP ($00AE) for every generated move, Z clear at the end
+#define MOVE_NUMBER  0x9B
+#define TURN         0x8B
+#define ORIGIN       0xE8
+#define DESTINATION  0xE9
+#define MOVE_TYPE    0x9C
+#define PIECE_TYPES  0x1320
+#define BOARD        0x80       // 0x88 board in page zero, the variables are in the holes
+#define LEVEL        0x1162
+#define MOVES_LIST   0x13F0     // move numbers of the legal moves, best first after LA0E5
+#define DEPTH        0xBD       // depth of the last iteration of LA0E5 (from 1)
+
+// addresses of the harness, in the ROM space which is not in the listing
+#define EXIT_TRAP    0xCFF0
+#define MOVE_TRAP    0xCFF3
+
+// piece types in $1320 (white, black is +1), for enum Types
+static const int sargon_types[] = { 0x00, 0x02, 0x0A, 0x08, 0x06, 0x04 };
+
+Listing  listing;
+Cpu      cpu;
+long     max_cycles = 2000000000;
+bool     profiling, print_profile;
+Moves    emulated_moves;
+int      nb_emulated_moves;
+long     nb_positions, nb_differences;
+
+typedef struct {
+    uint64_t calls, self, total;
+} Routine_profile;
+
+typedef struct {
+    uint16_t routine;
+    uint8_t  s;                 // after the JSR
+    uint64_t start;
+} Frame;
+
+Routine_profile profile[0x10000];
+int             active[0x10000];        // recursion: only the outer call counts in the total
+Frame           frames[1024];
+int             nb_frames;
+
+typedef struct { const char *name, *fen; } Position;
+
+Position positions[] = {
+    { "initial",      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1" },
+    { "kiwipete",     "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1" },
+    { "endgame",      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1" },
+    { "promote",      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1" },
+    { "middle",       "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8" },
+    { "en_passant",   "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3" },
+    { "double_check", "4k3/8/3N4/8/8/8/8/4RK2 b - - 0 1" },
+};
+
+#define NB(array) (int)(sizeof array / sizeof array[0])
+
+static int to_sargon(int pos) { return (pos / 8) << 4 | pos % 8; }
+static int to_board(int loc)  { return (loc >> 4) * 8 + (loc & 7); }
+
+const char *routine_name(uint16_t addr) {
+    static char name[8];
+    const char *s = symbol_name(&listing, addr);
+    if (s) return s;
+    sprintf(name, "L%04X", addr);
+    return name;
+}
+
+/*
+ * Profile
+ */
+
+// before the instruction at pc is executed
+void profile_call(uint16_t routine) {
+    profile[routine].calls++;
+    if (nb_frames == NB(frames)) return;
+    frames[nb_frames++] = (Frame){ routine, cpu.s, cpu.cycles };
+    active[routine]++;
+}
+
+// the stack went back over some frames (RTS, TXS, or return addresses pulled)
+void profile_returns(void) {
+    while (nb_frames > 0 && frames[nb_frames-1].s < cpu.s) {
+        Frame *f = &frames[--nb_frames];
+        if (--active[f->routine] == 0) profile[f->routine].total += cpu.cycles - f->start;
+    }
+}
+
+// the cycles go to the routine of the last JSR still on the stack, so that the code reached
+// with JMP or branches (the generator after L68F9) counts in the routine which jumped there
+void profile_step(uint16_t pc, uint8_t opcode, int cycles) {
+    (void)pc;
+    if (nb_frames > 0) profile[frames[nb_frames-1].routine].self += cycles;
+    if (opcode == 0x20) profile_call(cpu.pc);
+    else if (opcode == 0x60 || opcode == 0x40 || opcode == 0x9A || opcode == 0x68 || opcode == 0x28) profile_returns();
+}
+
+int compare_profiles(const void *a, const void *b) {
+    const Routine_profile *p1 = &profile[*(const uint16_t *)a], *p2 = &profile[*(const uint16_t *)b];
+    return p1->self < p2->self ? 1 : p1->self > p2->self ? -1 : 0;
+}
+
+void report_profile(void) {
+    static uint16_t routines[0x10000];
+    int nb_routines = 0;
+    uint64_t cycles = 0;
+    for (long addr = 0; addr < 0x10000; addr++)
+        if (profile[addr].self || profile[addr].calls) {
+            routines[nb_routines++] = addr;
+            cycles += profile[addr].self;
+        }
+    qsort(routines, nb_routines, sizeof *routines, compare_profiles);
+    printf("#routine\taddress\tcalls\tself_cycles\ttotal_cycles\tself_percent\n");
+    for (int i = 0; i < nb_routines; i++) {
+        Routine_profile *p = &profile[routines[i]];
+        printf("%s\t%04X\t%llu\t%llu\t%llu\t%.2f\n", routine_name(routines[i]), routines[i],
+               (unsigned long long)p->calls, (unsigned long long)p->self, (unsigned long long)p->total,
+               cycles ? 100.0 * p->self / cycles : 0);
+    }
+}
+
+/*
+ * Apple II
+ */
+
+uint8_t io_read(Cpu *c, uint16_t addr) {
+    (void)c; (void)addr;
+    return 0;                   // no key pressed, disk not ready
+}
+
+void io_write(Cpu *c, uint16_t addr, uint8_t value) {
+    (void)c; (void)addr; (void)value;
+}
+
+void return_from_stub(void) {
+    cpu.pc = pull(&cpu);
+    cpu.pc |= pull(&cpu) << 8;
+    cpu.pc++;
+    cpu.cycles += 6;
+    if (profiling) profile_returns();
+}
+
+// the disk routines fail: error in the IOB, carry set
+void rwts_stub(void) {
+    uint16_t iob = cpu.a << 8 | cpu.y;
+    cpu.mem[(uint16_t)(iob + 0x0D)] = 0x40;     // drive error
+    cpu.p |= FLAG_C;
+    return_from_stub();
+}
+
+// a move of the generator (Z set), or the end of the moves
+bool move_trap(void) {
+    if (!(cpu.p & FLAG_Z)) return false;
+    if (nb_emulated_moves < NB(emulated_moves))
+        emulated_moves[nb_emulated_moves++] = (Move){ to_board(cpu.mem[ORIGIN]), to_board(cpu.mem[DESTINATION]) };
+    cpu.mem[MOVE_NUMBER]++;
+    cpu.pc = NEXT_MOVE;
+    return true;
+}
+
+// runs from the pc until EXIT_TRAP (OK), or until max_cycles or an unknown opcode (ERROR)
+int run(void) {
+    uint64_t end = cpu.cycles + max_cycles;
+    while (cpu.cycles < end) {
+        uint16_t pc = cpu.pc;
+        if (pc >= 0xC000 || pc == RWTS) {
+            if (pc == EXIT_TRAP) return OK;
+            if (pc == MOVE_TRAP) {
+                if (move_trap()) continue;
+                return OK;
+            }
+            if (profiling) profile[pc].calls++;
+            if (pc == RWTS) rwts_stub();
+            else return_from_stub();
+            continue;
+        }
+        uint8_t opcode = cpu.mem[pc];
+        int cycles = step(&cpu);
+        if (cycles == 0) {
+            fprintf(stderr, "unknown opcode %02X at %04X\n", opcode, pc);
+            return ERROR;
+        }
+        if (profiling) profile_step(pc, opcode, cycles);
+    }
+    fprintf(stderr, "stopped after %ld cycles at %04X\n", max_cycles, cpu.pc);
+    return ERROR;
+}
+
+// as if the routine was called with JSR, s is the stack pointer before
+int call(uint16_t addr, uint8_t s) {
+    cpu.s = s;
+    push(&cpu, (EXIT_TRAP - 1) >> 8);
+    push(&cpu, (EXIT_TRAP - 1) & 0xFF);
+    cpu.pc = addr;
+    nb_frames = 0;
+    if (profiling) profile_call(addr);
+    int status = run();
+    if (profiling) {
+        cpu.s = 0xFF;           // closes the frames still open
+        profile_returns();
+    }
+    return status;
+}
+
+/*
+ * Positions and moves
+ */
+
+// the position of the decoder, and the last move for en-passant
+void set_position(Decoder *d, int turn, Move last) {
+    call(CLEAR_BOARD, 0xFF);
+    call(INIT_TYPES, 0xFF);
+    for (int pce = 0; pce < 32; pce++) {
+        if (d->piece_location[pce] == EMPTY) continue;
+        cpu.mem[BOARD + to_sargon(d->piece_location[pce])] = pce;
+        cpu.mem[PIECE_TYPES + pce] = sargon_types[d->piece_type[pce]] + (pce >= 16);
+    }
+    call(SCAN_BOARD, 0xFF);
+
+    cpu.mem[TURN] = turn;
+    cpu.mem[ORIGIN] = to_sargon(last.from);
+    cpu.mem[DESTINATION] = to_sargon(last.to);
+    int pawn = d->board[last.to];
+    bool pawn_entry = last.from != last.to && pawn != EMPTY && d->piece_type[pawn] == PAWN && abs(last.to - last.from) == 16;
+    cpu.mem[MOVE_TYPE] = pawn_entry ? 0x20 : 0;
+    cpu.mem[0x88] = pawn == EMPTY ? 0 : pawn;
+    cpu.mem[0x89] = 0x80;       // nothing taken
+}
+
+// like L9647/L964D, with MOVE_TRAP as action for each move
+int generate(void) {
+    cpu.mem[MOVE_HOOK] = MOVE_TRAP & 0xFF;
+    cpu.mem[MOVE_HOOK+1] = MOVE_TRAP >> 8;
+    cpu.mem[0x8C] = 1;          // ply
+    cpu.mem[0x8F] = 0;          // not a quiescence search
+    cpu.mem[0x03] = 0;          // no move of the previous iteration to try first
+    cpu.mem[0x1140] = 0xFF;
+    nb_emulated_moves = 0;
+    profiling = print_profile;
+    int status = call(GENERATE, 0xFF);
+    profiling = false;
+    return status;
+}
+
+void print_moves_list(const char *title, Move *moves, int nb_moves) {
+    printf("  %s:", title);
+    for (int i = 0; i < nb_moves; i++)
+        printf(" %c%d%c%d", 'a' + moves[i].from % 8, 1 + moves[i].from / 8, 'a' + moves[i].to % 8, 1 + moves[i].to / 8);
+    printf("\n");
+}
+
+// compares the moves of the emulated program and of search_moves() (already called)
+void compare_moves(Decoder *d, int turn, Move last, const char *where) {
+    set_position(d, turn, last);
+    if (generate() != OK) exit(1);
+    nb_positions++;
+    bool same = nb_emulated_moves == d->nb_moves
+             && memcmp(emulated_moves, d->moves, d->nb_moves * sizeof *d->moves) == 0;
+    if (same) return;
+    if (nb_differences++ < 10) {
+        printf("%s: different moves\n", where);
+        print_moves_list("sargon", emulated_moves, nb_emulated_moves);
+        print_moves_list("search_moves", d->moves, d->nb_moves);
+    }
+}
+
+void compare_tree(Decoder *d, int depth, int turn, Move last, char *path, int path_length) {
+    search_moves(d, turn, last);
+    compare_moves(d, turn, last, path_length ? path : "root");
+    if (depth == 0) return;
+
+    int nb_moves = d->nb_moves;
+    Moves moves;
+    memcpy(moves, d->moves, nb_moves * sizeof *moves);
+    for (int i = 0; i < nb_moves; i++) {
+        Undo undo = do_move(d, moves[i]);
+        if (!is_check(d, turn)) {
+            int length = path_length + sprintf(path + path_length, " %c%d%c%d", 'a' + moves[i].from % 8, 1 + moves[i].from / 8,
+                                                                             'a' + moves[i].to % 8,   1 + moves[i].to / 8);
+            compare_tree(d, depth - 1, turn ^ BLACK, moves[i], path, length);
+            path[path_length] = '\0';
+        }
+        undo_move(d, undo);
+    }
+}
+
+// same walk as decode_variations(), without printing
+void compare_book(Decoder *d, int depth, Move last) {
+    int turn = depth % 2 ? BLACK : WHITE;
+    int flags;
+    do {
+        flags = byte_at(&d->book, d->book_indx) & 0xC0;
+        if (flags == 0xC0) {
+            if (byte_at(&d->book, d->book_indx) & 7) { d->book_indx += 5; break; } // sub-book name
+            d->book_indx += 1;
+        }
+        search_moves(d, turn, last);
+        char where[32];
+        sprintf(where, "%05x", d->book_indx);
+        compare_moves(d, turn, last, where);
+        int move_indx = byte_at(&d->book, d->book_indx) & 0x3F;
+        if (move_indx == 0 || move_indx > d->nb_moves) break;
+
+        Move m = d->moves[move_indx-1];
+        Undo undo = do_move(d, m);
+        d->book_indx++;
+        if (flags != 0x40) compare_book(d, depth + 1, m);
+        undo_move(d, undo);
+    } while (flags & 0x80);
+}
+
+void think(Decoder *d, int level, int turn, Move last) {
+    set_position(d, turn, last);
+    search_moves(d, turn, last);
+    Moves moves;
+    int nb_moves = d->nb_moves;
+    memcpy(moves, d->moves, nb_moves * sizeof *moves);
+
+    // as in a game: level, no time spent yet, out of book, no key pressed
+    cpu.mem[LEVEL] = level;
+    cpu.mem[0x1169] = 0;        // moves before the next time control
+    cpu.mem[0x1167] = cpu.mem[0x1168] = 0;
+    cpu.mem[0x1163] = 0;        // options
+    cpu.mem[0x9A] = 0xFF;       // out of book
+    cpu.mem[0x98] = 0x80;       // thinking on its own time
+    cpu.mem[MOVE_HOOK] = 0x6E;  // normal action for each move (L626E)
+    cpu.mem[MOVE_HOOK+1] = 0x62;
+    memset(cpu.mem + MOVES_LIST, 0xFF, 0x60);
+
+    profiling = print_profile;
+    uint64_t start = cpu.cycles;
+    int status = call(THINK, 0x01);   // L914C: the search uses the whole stack page
+    profiling = false;
+    uint64_t cycles = cpu.cycles - start;
+
+    int move_number = cpu.mem[MOVES_LIST];
+    printf("level %d: %llu cycles (%.1f s at 1.023 MHz), depth %d, ", level, (unsigned long long)cycles, cycles / 1.023e6, cpu.mem[DEPTH]);
+    if (status != OK || move_number == 0 || move_number > nb_moves) printf("no move\n");
+    else {
+        char san[16];
+        san_move(d, moves[move_number-1], san);
+        printf("move %d %s, score %02X%02X\n", move_number, san, cpu.mem[0x1360], cpu.mem[0x1340]);
+    }
+}
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-l listing] [-p] [-b|-r] [-c cycles] [moves [depth [fen...]] | book opening_book_file... | think [level [fen]]]\n", name);
+    fprintf(stderr, "  -l : the listing (default: sargon3_disassembly.txt)\n");
+    fprintf(stderr, "  -p : profile of the routines\n");
+    fprintf(stderr, "  -b : bitboard move generator (default), -r : reference move generator\n");
+    fprintf(stderr, "  -c : maximum cycles of a run (default: 2000000000)\n");
+    fprintf(stderr, "  default: moves 2\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *listing_name = "sargon3_disassembly.txt";
+    bool use_bitboards = BITBOARDS;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "-l") == 0 && arg+1 < argc) listing_name = argv[++arg];
+        else if (strcmp(argv[arg], "-c") == 0 && arg+1 < argc) max_cycles = atol(argv[++arg]);
+        else if (strcmp(argv[arg], "-p") == 0) print_profile = true;
+        else if (strcmp(argv[arg], "-b") == 0) use_bitboards = true;
+        else if (strcmp(argv[arg], "-r") == 0) use_bitboards = false;
+        else usage(argv[0]);
+    }
+    const char *mode = arg < argc ? argv[arg++] : "moves";
+    if (strcmp(mode, "moves") && strcmp(mode, "book") && strcmp(mode, "think")) usage(argv[0]);
+    if (strcmp(mode, "book") == 0 && arg == argc) usage(argv[0]);
+
+    if (open_listing(&listing, listing_name) != OK) {
+        fprintf(stderr, "%s not found\n", listing_name);
+        exit(1);
+    }
+    memcpy(cpu.mem, listing.image, sizeof cpu.mem);
+    reset_cpu(&cpu);
+    cpu.io_read = io_read;
+    cpu.io_write = io_write;
+    if (call(NEW_GAME, 0xFF) != OK) exit(1);
+
+    init_tables();
+    Decoder decoder, *d = &decoder;
+    init_decoder(d);
+    d->use_bitboards = use_bitboards;
+    int turn;
+    Move last;
+
+    if (strcmp(mode, "moves") == 0) {
+        int depth = arg < argc ? atoi(argv[arg++]) : 2;
+        char path[1024] = "";
+        for (int i = 0; i < (arg < argc ? argc - arg : NB(positions)); i++) {
+            const char *fen = arg < argc ? argv[arg + i] : positions[i].fen;
+            if (init_fen(d, fen, &turn, &last) != OK) {
+                fprintf(stderr, "bad position %s\n", fen);
+                continue;
+            }
+            long differences = nb_differences, nb = nb_positions;
+            compare_tree(d, depth, turn, last, path, 0);
+            printf("%s\t%ld positions\t%ld different\n", arg < argc ? fen : positions[i].name,
+                   nb_positions - nb, nb_differences - differences);
+        }
+    }
+    else if (strcmp(mode, "book") == 0) {
+        for (; arg < argc; arg++) {
+            if (init_book(d, argv[arg]) != OK) {
+                fprintf(stderr, "%s not found\n", argv[arg]);
+                continue;
+            }
+            long differences = nb_differences, nb = nb_positions;
+            Move none = { 0, 0 };
+            init_board(d);
+            d->book_indx = 0;
+            compare_book(d, 0, none);
+            printf("%s\t%ld positions\t%ld different\n", argv[arg], nb_positions - nb, nb_differences - differences);
+            close_book(d);
+        }
+    }
+    else {
+        int level = arg < argc ? atoi(argv[arg++]) : 1;
+        const char *fen = arg < argc ? argv[arg] : positions[0].fen;
+        if (level < 1 || level > 9 || init_fen(d, fen, &turn, &last) != OK) usage(argv[0]);
+        think(d, level, turn, last);
+    }
+
+    if (print_profile) report_profile();
+    free_listing(&listing);
+    return nb_differences ? 2 : 0;
+}
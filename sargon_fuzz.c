@@ -0,0 +1,374 @@
+/*
+ * Differential fuzzing of the move generators: the bitboard backend, run all at once and lazily
+ * (generate_moves, move_index), must give the moves of the reference generator in the same order,
+ * or the book indexes decode into other moves.
+ *
+ * The positions are random legal ones (set up with init_fen(), with castles and en-passant) and
+ * the positions of random walks from the initial position, with low move indexes like in the
+ * books. At each one, the lists are compared index by index, and do_move()/undo_move() must keep
+ * the board consistent (check_board) and give the position back.
+ * A failing random position is minimized (pieces removed as long as it keeps failing) and printed
+ * as a FEN, with the moves of each generator; for a walk, the moves from the initial position.
+ *
+ *   cc -O2 -DCHECKED=1 -o sargon_fuzz sargon_fuzz.c sargon.c book_file.c trace.c -lpthread
+ *   sargon_fuzz [-j threads] [-n positions] [-t seconds] [-s seed] [-m failures]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "sargon.h"
+#include "trace.h"
+
+#define MAX_WALK 80
+
+typedef struct {
+    Decoder  d;
+    uint64_t random;
+    long     positions;
+    Move     walk[MAX_WALK];    // moves of the current walk
+} Fuzzer;
+
+long     max_positions;
+double   max_seconds = 10;
+int      max_failures = 10;
+long     nb_positions, nb_failures;
+bool     stop;
+pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t next_random(Fuzzer *f) {      // splitmix64
+    uint64_t z = (f->random += 0x9E3779B97F4A7C15);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+int random_below(Fuzzer *f, int n) {
+    return next_random(f) % n;
+}
+
+/*
+ * Comparison of the generators
+ */
+
+typedef struct {
+    Moves moves;
+    int   nb_moves;
+} Move_list;
+
+void generate(Decoder *d, bool bitboards, int turn, Move last, Move_list *l) {
+    d->use_bitboards = bitboards;
+    search_moves(d, turn, last);
+    memcpy(l->moves, d->moves, d->nb_moves * sizeof *d->moves);
+    l->nb_moves = d->nb_moves;
+}
+
+// what doesn't match, NULL if everything does
+const char *compare_generators(Fuzzer *f, int turn, Move last) {
+    Decoder *d = &f->d;
+    Move_list reference, bitboards;
+    generate(d, false, turn, last, &reference);
+    generate(d, true, turn, last, &bitboards);
+    if (reference.nb_moves != bitboards.nb_moves
+     || memcmp(reference.moves, bitboards.moves, reference.nb_moves * sizeof *reference.moves))
+        return "search_moves";
+
+    int n = reference.nb_moves;
+    int k = random_below(f, n + 2);     // up to one more than there are
+    bool enough = generate_moves(d, turn, last, k);
+    if (enough != (k <= n) || d->nb_moves < (enough ? k : n)
+     || memcmp(d->moves, reference.moves, (enough ? k : n) * sizeof *d->moves))
+        return "generate_moves";
+    if (n > 0) {
+        Move m = reference.moves[random_below(f, n)];
+        int first = 0;
+        while (reference.moves[first].from != m.from || reference.moves[first].to != m.to) first++;
+        if (move_index(d, turn, last, m) != first + 1) return "move_index";
+    }
+
+    for (int i = random_below(f, 4); i < n; i += 4) {    // a quarter of the moves
+        Board board;
+        Attack_map attack_map;
+        memcpy(board, d->board, sizeof board);
+        memcpy(attack_map, d->attack_map, sizeof attack_map);
+        Undo undo = do_move(d, reference.moves[i]);
+        bool consistent = check_board(d) == OK;
+        undo_move(d, undo);
+        if (!consistent) return "do_move";
+        if (memcmp(board, d->board, sizeof board) || memcmp(attack_map, d->attack_map, sizeof attack_map)
+         || check_board(d) != OK) return "undo_move";
+    }
+    return NULL;
+}
+
+/*
+ * Random positions
+ */
+
+void board_fen(Decoder *d, int turn, Move last, char *fen) {
+    static const char names[] = "PNBRQK";
+    for (int y = 7; y >= 0; y--) {
+        int empty = 0;
+        for (int x = 0; x < 8; x++) {
+            int pce = d->board[8*y + x];
+            if (pce == EMPTY) { empty++; continue; }
+            if (empty) *fen++ = '0' + empty;
+            empty = 0;
+            *fen++ = names[d->piece_type[pce]] | (pce & BLACK ? 0x20 : 0);
+        }
+        if (empty) *fen++ = '0' + empty;
+        if (y) *fen++ = '/';
+    }
+    fen += sprintf(fen, " %c ", turn == WHITE ? 'w' : 'b');
+    // the castles that the generator would try: king and rook of the right number in place
+    char *castles = fen;
+    for (int col = WHITE; col <= BLACK; col += BLACK) {
+        int row = col == WHITE ? 0 : 070;
+        if (d->piece_location[col+KING1] != 004+row) continue;
+        if (d->piece_location[col+ROOK2] == 007+row && d->piece_type[col+ROOK2] == ROOK) *fen++ = col == WHITE ? 'K' : 'k';
+        if (d->piece_location[col+ROOK1] == 000+row && d->piece_type[col+ROOK1] == ROOK) *fen++ = col == WHITE ? 'Q' : 'q';
+    }
+    if (fen == castles) *fen++ = '-';
+    int moved = d->board[last.to];
+    if (moved != EMPTY && d->piece_type[moved] == PAWN && abs(last.to - last.from) == 16)
+        sprintf(fen, " %c%c", 'a' + last.to % 8, '1' + (last.to + last.from) / 16);
+    else sprintf(fen, " -");
+}
+
+// kings not next to each other, no pawn on the first and last rows, not more than 16 pieces a
+// side, and the side that has just played not in check
+int random_position(Fuzzer *f, char *fen, int *turn, Move *last) {
+    static const char names[] = "PNBRQ";
+    static const int  counts[] = { 8, 2, 2, 2, 1 };
+    char board[64];
+    memset(board, 0, sizeof board);
+    int pos;
+    board[pos = random_below(f, 64)] = 'K';
+    int king = pos;
+    do pos = random_below(f, 64); while (board[pos] || (abs(pos % 8 - king % 8) <= 1 && abs(pos / 8 - king / 8) <= 1));
+    board[pos] = 'k';
+    for (int col = 0; col < 2; col++) {
+        int density = random_below(f, 101), nb_pieces = 1;
+        for (int type = 0; type < 5; type++)
+            for (int i = 0; i < counts[type] + (type && random_below(f, 8) == 0); i++) {  // sometimes a promoted piece
+                if (random_below(f, 100) >= density || nb_pieces == 16) continue;
+                do pos = random_below(f, 64); while (board[pos] || (type == 0 && (pos < 010 || pos >= 070)));
+                board[pos] = names[type] | (col ? 0x20 : 0);
+                nb_pieces++;
+            }
+    }
+    bool white = random_below(f, 2);
+    char castles[5], *c = castles;
+    if (board[004] == 'K' && board[007] == 'R' && random_below(f, 2)) *c++ = 'K';
+    if (board[004] == 'K' && board[000] == 'R' && random_below(f, 2)) *c++ = 'Q';
+    if (board[074] == 'k' && board[077] == 'r' && random_below(f, 2)) *c++ = 'k';
+    if (board[074] == 'k' && board[070] == 'r' && random_below(f, 2)) *c++ = 'q';
+    if (c == castles) *c++ = '-';
+    *c = '\0';
+    // en-passant: a pawn of the other side that can have just moved two squares
+    char en_passant[3] = "-";
+    int file = random_below(f, 8), row = white ? 4 : 3, step = white ? 8 : -8;
+    int pawn = 8*row + file;
+    if (board[pawn] == (white ? 'p' : 'P') && !board[pawn + step] && !board[pawn + 2*step] && random_below(f, 2))
+        sprintf(en_passant, "%c%c", 'a' + file, '1' + row + (white ? 1 : -1));
+
+    char *p = fen;
+    for (int y = 7; y >= 0; y--) {
+        for (int x = 0, empty = 0; x < 8; x++) {
+            if (!board[8*y + x]) { empty++; if (x == 7) *p++ = '0' + empty; continue; }
+            if (empty) *p++ = '0' + empty;
+            empty = 0;
+            *p++ = board[8*y + x];
+        }
+        if (y) *p++ = '/';
+    }
+    sprintf(p, " %c %s %s", white ? 'w' : 'b', castles, en_passant);
+    if (init_fen(&f->d, fen, turn, last) != OK) return ERROR;
+    return is_check(&f->d, *turn ^ BLACK) ? ERROR : OK;
+}
+
+// removes pieces (not the kings) as long as the position keeps failing
+void minimize(Fuzzer *f, char *fen) {
+    int turn;
+    Move last;
+    for (bool smaller = true; smaller; ) {
+        smaller = false;
+        for (int pos = 0; pos < 64 && !smaller; pos++) {
+            init_fen(&f->d, fen, &turn, &last);
+            int pce = f->d.board[pos];
+            if (pce == EMPTY || f->d.piece_type[pce] == KING) continue;
+
+            // the same FEN without this piece
+            f->d.board[pos] = EMPTY;
+            f->d.piece_location[pce] = EMPTY;
+            char candidate[100];
+            board_fen(&f->d, turn, last, candidate);
+            int turn2;
+            Move last2;
+            if (init_fen(&f->d, candidate, &turn2, &last2) != OK || is_check(&f->d, turn2 ^ BLACK)) continue;
+            if (compare_generators(f, turn2, last2)) {
+                strcpy(fen, candidate);
+                smaller = true;
+            }
+        }
+    }
+}
+
+void print_list(const char *title, Move_list *l) {
+    printf("  %-10s", title);
+    for (int i = 0; i < l->nb_moves; i++)
+        printf(" %c%c%c%c", 'a' + l->moves[i].from % 8, '1' + l->moves[i].from / 8, 'a' + l->moves[i].to % 8, '1' + l->moves[i].to / 8);
+    printf("\n");
+}
+
+// the position of the Decoder, after the moves of the walk if nb_walk >= 0
+void report_failure(Fuzzer *f, const char *what, int turn, Move last, int nb_walk) {
+    pthread_mutex_lock(&print_lock);
+    if (nb_failures++ < max_failures) {
+        printf("%s differs", what);
+        if (nb_walk >= 0) {
+            printf(" after");
+            for (int i = 0; i < nb_walk; i++)
+                printf(" %c%c%c%c", 'a' + f->walk[i].from % 8, '1' + f->walk[i].from / 8, 'a' + f->walk[i].to % 8, '1' + f->walk[i].to / 8);
+        }
+        printf("\n");
+        char fen[100];
+        Move_list reference, bitboards;
+        board_fen(&f->d, turn, last, fen);
+        generate(&f->d, false, turn, last, &reference);
+        generate(&f->d, true, turn, last, &bitboards);
+        printf("  %s\n", fen);
+        print_list("reference", &reference);
+        print_list("bitboards", &bitboards);
+        fflush(stdout);
+    }
+    if (nb_failures >= max_failures) __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&print_lock);
+}
+
+/*
+ * Threads
+ */
+
+void random_walk(Fuzzer *f) {
+    int turn = WHITE;
+    Move last = { 0, 0 };
+    init_board(&f->d);
+    int length = random_below(f, MAX_WALK);
+    for (int ply = 0; ply <= length; ply++) {
+        const char *what = compare_generators(f, turn, last);
+        f->positions++;
+        if (what) {
+            // minimized if the FEN fails too (the piece numbers of a walk aren't always the ones
+            // of init_fen), else the position of the walk
+            char fen[100];
+            board_fen(&f->d, turn, last, fen);
+            int turn2;
+            Move last2;
+            static __thread Fuzzer copy;
+            copy = *f;
+            if (init_fen(&copy.d, fen, &turn2, &last2) == OK && compare_generators(&copy, turn2, last2)) {
+                minimize(&copy, fen);
+                init_fen(&copy.d, fen, &turn2, &last2);
+                report_failure(&copy, what, turn2, last2, ply);
+            }
+            else report_failure(f, what, turn, last, ply);
+            return;
+        }
+        if (ply == length) break;
+
+        // a legal move, with the low indexes of the books more often
+        f->d.use_bitboards = true;
+        search_moves(&f->d, turn, last);
+        Moves moves;
+        int nb_moves = f->d.nb_moves;
+        memcpy(moves, f->d.moves, nb_moves * sizeof *moves);
+        Move m = { EMPTY, EMPTY };
+        for (int tries = 0; tries < 8 && m.from == EMPTY && nb_moves > 0; tries++) {
+            int i = random_below(f, 2) ? random_below(f, nb_moves < 8 ? nb_moves : 8) : random_below(f, nb_moves);
+            Undo undo = do_move(&f->d, moves[i]);
+            if (!is_check(&f->d, turn)) m = moves[i];
+            undo_move(&f->d, undo);
+        }
+        if (m.from == EMPTY) break;
+        do_move(&f->d, m);
+        f->walk[ply] = m;
+        last = m;
+        turn ^= BLACK;
+    }
+}
+
+void *fuzz(void *arg) {
+    Fuzzer *f = arg;
+    double start = trace_now();
+    for (long n = 0; !__atomic_load_n(&stop, __ATOMIC_RELAXED); n++) {
+        if (n % 2) random_walk(f);
+        else {
+            char fen[100];
+            int turn;
+            Move last;
+            if (random_position(f, fen, &turn, &last) != OK) continue;
+            const char *what = compare_generators(f, turn, last);
+            f->positions++;
+            if (what) {
+                minimize(f, fen);
+                init_fen(&f->d, fen, &turn, &last);
+                report_failure(f, what, turn, last, -1);
+            }
+        }
+        if (n % 64 == 0) {
+            long total = __atomic_add_fetch(&nb_positions, f->positions, __ATOMIC_RELAXED);
+            f->positions = 0;
+            if ((max_positions && total >= max_positions) || (max_seconds && trace_now() - start >= max_seconds))
+                __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_add_fetch(&nb_positions, f->positions, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-j threads] [-n positions] [-t seconds] [-s seed] [-m failures]\n", name);
+    fprintf(stderr, "  -j : number of threads (default: one per processor)\n");
+    fprintf(stderr, "  -n : stop after this number of positions\n");
+    fprintf(stderr, "  -t : stop after this time (default: 10 s, 0 for none)\n");
+    fprintf(stderr, "  -m : stop after this number of failures (default: 10)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = time(NULL);
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "-j") == 0 && arg+1 < argc) nb_threads = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-n") == 0 && arg+1 < argc) max_positions = atol(argv[++arg]);
+        else if (strcmp(argv[arg], "-t") == 0 && arg+1 < argc) max_seconds = atof(argv[++arg]);
+        else if (strcmp(argv[arg], "-s") == 0 && arg+1 < argc) seed = strtoull(argv[++arg], NULL, 0);
+        else if (strcmp(argv[arg], "-m") == 0 && arg+1 < argc) max_failures = atoi(argv[++arg]);
+        else usage(argv[0]);
+    }
+    if (arg < argc || max_failures < 1) usage(argv[0]);
+    if (nb_threads < 1) nb_threads = 1;
+    if (!CHECKED) fprintf(stderr, "not a checked build (-DCHECKED=1): the board isn't checked at every generation\n");
+
+    init_tables();
+    Fuzzer *fuzzers = calloc(nb_threads, sizeof *fuzzers);
+    pthread_t threads[nb_threads];
+    double start = trace_now();
+    for (int i = 0; i < nb_threads; i++) {
+        init_decoder(&fuzzers[i].d);
+        fuzzers[i].random = seed + i * 0x1000003;
+        pthread_create(&threads[i], NULL, fuzz, &fuzzers[i]);
+    }
+    for (int i = 0; i < nb_threads; i++) pthread_join(threads[i], NULL);
+    double seconds = trace_now() - start;
+
+    fprintf(stderr, "seed %llu: %ld positions in %.1f s (%.0f per minute, %d threads), %ld failures\n",
+            (unsigned long long)seed, nb_positions, seconds, seconds > 0 ? 60 * nb_positions / seconds : 0,
+            nb_threads, nb_failures);
+    return nb_failures ? 1 : 0;
+}
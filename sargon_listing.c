@@ -0,0 +1,135 @@
+/*
+ * Queries on sargon3_disassembly.txt without grepping it: the bytes at an address, the symbols,
+ * the comments (e.g. of the tables at $6210/$621C), and the users of an address
+ * (JSR/JMP/branches to it, and the instructions reading, writing or modifying it, indexed or not).
+ *
+ * The listing is parsed once and kept in sargon3_disassembly.idx (see listing.h), so that the
+ * next queries only load the cache; -n parses the text without the cache.
+ *
+ *   cc -O2 -o sargon_listing sargon_listing.c listing.c book_file.c
+ *   sargon_listing [-l listing] [-n] [info | bytes addr [count] | symbol addr... | comment addr... | xref addr...]
+ *
+ * An address is hexadecimal ($6210, 6210, L6210) or a symbol (COUT, KEYBOARD...).
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include "sargon.h"
+#include "listing.h"
+
+Listing listing;
+
+int parse_addr(const char *s) {
+    int addr = find_symbol(&listing, s);
+    if (addr >= 0) return addr;
+    if (*s == '$' || *s == 'L') s++;
+    char *end;
+    long value = strtol(s, &end, 16);
+    if (*s == '\0' || *end != '\0' || value < 0 || value > 0xFFFF) return -1;
+    return value;
+}
+
+// label+offset of the code at addr
+const char *where(uint16_t addr) {
+    static char name[32];
+    int low = 0, high = listing.nb_symbols - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (listing.symbols[middle].addr <= addr) low  = middle + 1;
+        else                                      high = middle - 1;
+    }
+    if (high < 0) return "";
+    const Symbol *s = &listing.symbols[high];
+    if (s->addr == addr) return s->name;
+    snprintf(name, sizeof name, "%s+%d", s->name, addr - s->addr);
+    return name;
+}
+
+void print_info(const char *name) {
+    printf("%s: %d lines, %d bytes, %d conflicts, %d symbols, %d xrefs, %d comments\n", name,
+           listing.nb_lines, listing.nb_bytes, listing.nb_conflicts, listing.nb_symbols,
+           listing.nb_xrefs, listing.nb_comments);
+    for (int i = 0; i < listing.nb_relocations; i++) {
+        const Relocation *r = &listing.relocations[i];
+        printf("%04X-%04X moved to %04X-%04X\n", r->from, r->from + r->size - 1, r->to, r->to + r->size - 1);
+    }
+}
+
+void print_bytes(int addr, int count) {
+    for (int line = addr & ~15; line < addr + count && line < 0x10000; line += 16) {
+        printf("%04X ", line);
+        for (int a = line; a < line + 16; a++) {
+            if (a < addr || a >= addr + count) printf("   ");
+            else if (listing.loaded[a])        printf(" %02X", listing.image[a]);
+            else                               printf(" ..");
+        }
+        if (load_address(&listing, line) != line) printf("   ; loaded at %04X", load_address(&listing, line));
+        printf("\n");
+    }
+}
+
+void print_xrefs(int addr) {
+    const Xref *x;
+    int n = find_xrefs(&listing, addr, &x);
+    for (int i = 0; i < n; i++)
+        printf("%04X\t%s\t%s\n", x[i].from, xref_kind_name(x[i].kind), where(x[i].from));
+}
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-l listing] [-n] [info | bytes addr [count] | symbol addr... | comment addr... | xref addr...]\n", name);
+    fprintf(stderr, "  -l : listing (default: sargon3_disassembly.txt)\n");
+    fprintf(stderr, "  -n : parse the listing, without the cache\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *listing_name = "sargon3_disassembly.txt";
+    bool parse = false;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "-l") == 0 && arg+1 < argc) listing_name = argv[++arg];
+        else if (strcmp(argv[arg], "-n") == 0) parse = true;
+        else usage(argv[0]);
+    }
+    const char *command = arg < argc ? argv[arg++] : "info";
+    if (strcmp(command, "info") && strcmp(command, "bytes") && strcmp(command, "symbol")
+     && strcmp(command, "comment") && strcmp(command, "xref")) usage(argv[0]);
+    if (strcmp(command, "info") && arg == argc) usage(argv[0]);
+
+    int status = parse ? load_listing(&listing, listing_name) : open_listing(&listing, listing_name);
+    if (status != OK) {
+        fprintf(stderr, "%s not found\n", listing_name);
+        exit(1);
+    }
+
+    if (strcmp(command, "info") == 0) {
+        print_info(listing_name);
+        return 0;
+    }
+    int errors = 0;
+    for (; arg < argc; arg++) {
+        int addr = parse_addr(argv[arg]);
+        if (addr < 0) {
+            fprintf(stderr, "%s: unknown address\n", argv[arg]);
+            errors++;
+            continue;
+        }
+        if (strcmp(command, "bytes") == 0) {
+            int count = arg + 1 < argc ? strtol(argv[arg+1], NULL, 0) : 16;
+            print_bytes(addr, count > 0 ? count : 16);
+            break;
+        }
+        if (strcmp(command, "symbol") == 0) {
+            const char *name = symbol_name(&listing, addr);
+            printf("%04X\t%s\n", addr, name ? name : where(addr));
+        }
+        else if (strcmp(command, "comment") == 0) {
+            const char *comment = comment_at(&listing, addr);
+            printf("%04X\t%s\n", addr, comment ? comment : "");
+        }
+        else print_xrefs(addr);
+    }
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * Native search (search.h) on a position, to go on where the Openings Library stops.
+ *
+ * Without -g, the position is analysed with the time of a first move at the level, and one tab
+ * separated line is printed per iteration (depth, score in hundredths of pawns for the side to
+ * play, nodes, quiescence nodes, seconds, nodes per second, principal variation).
+ * With -g moves, the game goes on from the position for this number of moves, each side with
+ * the clock of the level (the bank and the moves left are printed after each move).
+ * -t gives a fixed time per move instead of the level, -d a maximum depth.
+ * -c checks the legal moves of the test positions, which the generator of the book gets wrong.
+ *
+ *   cc -O2 -o sargon_search sargon_search.c search.c sargon.c book_file.c trace.c
+ *   sargon_search [-b|-r] [-l level] [-t seconds] [-d depth] [-m megabytes] [-g moves] [fen]
+ *   sargon_search -c
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sargon.h"
+#include "search.h"
+
+#define INITIAL_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+typedef struct { const char *name, *fen; int nb_legal; } Test_position;
+
+Test_position test_positions[] = {
+    { "initial",           INITIAL_FEN, 20 },
+    { "checkmate",         "rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3", 0 },
+    { "en_passant_escape", "8/8/1N5Q/4k3/3Pp3/2P5/8/5R1K b - d3 0 1", 1 },   // exd3 only
+};
+
+// SAN of the moves from the position of the game, played on copies
+void print_line(Game *g, const Move *line, int length) {
+    Decoder d = *g->d;
+    Game copy = *g;
+    copy.d = &d;
+    for (int i = 0; i < length; i++) {
+        char san[10];
+        search_moves(&d, copy.turn, copy.last);     // san_move() looks among the generated moves
+        san_move(&d, line[i], san);
+        printf("%s%s", i ? " " : "", san);
+        play_move(&copy, line[i]);
+    }
+}
+
+void report_iteration(Search *s) {
+    double seconds = elapsed_time(s);
+    printf("%d\t%d\t%ld\t%ld\t%.3f\t%.0f\t", s->depth, s->score, s->nodes, s->quiescence_nodes,
+           seconds, seconds > 0 ? s->nodes / seconds : 0);
+    print_line(s->game, s->pv, s->pv_length);
+    printf("\n");
+    fflush(stdout);
+}
+
+// the number of legal moves of every test position, ERROR if one of them is wrong
+int check_positions(Decoder *d) {
+    int status = OK;
+    for (int i = 0; i < (int)(sizeof test_positions / sizeof *test_positions); i++) {
+        Test_position *t = &test_positions[i];
+        static Game game;
+        Moves moves;
+        if (init_game(&game, d, t->fen) != OK) {
+            fprintf(stderr, "bad position %s\n", t->name);
+            exit(1);
+        }
+        int nb_legal = legal_moves(&game, moves);
+        printf("%s\t%d\t%s\n", t->name, nb_legal, nb_legal == t->nb_legal ? "ok" : "FAILED");
+        if (nb_legal != t->nb_legal) status = ERROR;
+    }
+    return status;
+}
+
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-b|-r] [-l level] [-t seconds] [-d depth] [-m megabytes] [-g moves] [fen]\n", name);
+    fprintf(stderr, "       %s [-b|-r] -c\n", name);
+    fprintf(stderr, "  -l : level of Sargon, 1 to 8, for the time of the moves (default: 1)\n");
+    fprintf(stderr, "  -t : fixed time per move instead\n");
+    fprintf(stderr, "  -d : maximum depth\n");
+    fprintf(stderr, "  -m : size of the transposition table (default: 64 MB)\n");
+    fprintf(stderr, "  -g : play this number of moves from the position\n");
+    fprintf(stderr, "  -c : check the legal moves of the test positions\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int level = 1, max_depth = 0, megabytes = 64, nb_game_moves = 0;
+    double fixed_time = 0;
+    bool use_bitboards = BITBOARDS, checking = false;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if      (strcmp(argv[arg], "-l") == 0 && arg+1 < argc) level = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-t") == 0 && arg+1 < argc) fixed_time = atof(argv[++arg]);
+        else if (strcmp(argv[arg], "-d") == 0 && arg+1 < argc) max_depth = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-m") == 0 && arg+1 < argc) megabytes = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-g") == 0 && arg+1 < argc) nb_game_moves = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-c") == 0) checking = true;
+        else if (strcmp(argv[arg], "-b") == 0) use_bitboards = true;
+        else if (strcmp(argv[arg], "-r") == 0) use_bitboards = false;
+        else usage(argv[0]);
+    }
+    if (level < 1 || level > NB_LEVELS || argc - arg > (checking ? 0 : 1)) usage(argv[0]);
+    const char *fen = arg < argc ? argv[arg] : INITIAL_FEN;
+
+    init_tables();
+    static Decoder d;
+    init_decoder(&d);
+    d.use_bitboards = use_bitboards;
+    if (checking) return check_positions(&d) == OK ? 0 : 1;
+    static Game game;
+    if (init_game(&game, &d, fen) != OK) {
+        fprintf(stderr, "bad position %s\n", fen);
+        exit(1);
+    }
+    static Tt tt;
+    if (init_tt(&tt, megabytes > 0 ? megabytes : 1) != OK) {
+        fprintf(stderr, "not enough memory for the transposition table\n");
+        exit(1);
+    }
+    static Search search;
+    search.game = &game;
+    search.tt = &tt;
+    search.max_depth = max_depth;
+
+    Clock clocks[2];            // white, black
+    init_clock(&clocks[0], level);
+    init_clock(&clocks[1], level);
+
+    if (nb_game_moves == 0) {
+        Moves moves;
+        if (legal_moves(&game, moves) == 0) {
+            printf("%s\n", is_check(&d, game.turn) ? "checkmate" : "stalemate");
+            return 0;
+        }
+        if (fixed_time > 0) search.soft_limit = search.hard_limit = fixed_time;
+        else if (max_depth == 0) set_time_limits(&search, &clocks[0]);
+        search.report = report_iteration;
+        printf("#depth\tscore\tnodes\tquiescence\tseconds\tnodes_per_second\tpv\n");
+        think(&search);
+        return 0;
+    }
+
+    printf("#ply\tmove\tscore\tdepth\tnodes\tseconds\tbank\tmoves_left\n");
+    for (int ply = 0; ply < 2 * nb_game_moves; ply++) {
+        Moves moves;
+        if (legal_moves(&game, moves) == 0) {
+            printf("%s\n", is_check(&d, game.turn) ? (game.turn == WHITE ? "0-1" : "1-0") : "1/2-1/2");
+            break;
+        }
+        Clock *c = &clocks[game.turn == WHITE ? 0 : 1];
+        if (fixed_time > 0) search.soft_limit = search.hard_limit = fixed_time;
+        else if (max_depth == 0) set_time_limits(&search, c);
+        think(&search);
+        double seconds = elapsed_time(&search);
+        spend_time(c, seconds);
+
+        char san[10];
+        search_moves(&d, game.turn, game.last);
+        san_move(&d, search.best, san);
+        printf("%d\t%s\t%d\t%d\t%ld\t%.3f\t%.1f\t%d\n", ply + 1, san, search.score, search.depth,
+               search.nodes, seconds, c->bank, c->moves_left);
+        fflush(stdout);
+        play_move(&game, search.best);
+    }
+    free_tt(&tt);
+    return 0;
+}
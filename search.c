@@ -0,0 +1,499 @@
+/*
+ * Alpha-beta search on the move generator of sargon.c, see search.h
+ *
+ * The generator gives pseudo-legal moves (the king may be left in check, and the promotions are
+ * registered 4 times): the repeated moves are skipped, and a move is only searched if the king
+ * isn't threatened after it, as is_check() tells from the accessibility tables.
+ * The moves are tried in the order of the generator (takes of the most valuable pieces first),
+ * after the move of the transposition table and the two killer moves of the ply.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "search.h"
+#include "trace.h"
+
+// $6148/$6158: time credits in seconds, $6256: number of moves for this time, for levels 1 to 8
+const int level_seconds[NB_LEVELS+1] = { 0, 300, 900, 1800, 3600, 3300, 6600, 10800, 24000 };
+const int level_moves[NB_LEVELS+1]   = { 0,  60,  60,   60,   60,   30,   40,    30,    40 };
+
+static uint64_t piece_keys[2][6][64], castle_keys[16], en_passant_keys[8], turn_key;
+static int castle_mask[64];
+
+enum Bounds { UPPER_BOUND, LOWER_BOUND, EXACT };
+
+static bool same_move(Move m1, Move m2) { return m1.from == m2.from && m1.to == m2.to; }
+
+/*
+ * Game
+ */
+
+static uint64_t next_random(uint64_t *seed) {     // splitmix64
+    uint64_t z = (*seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ z >> 30) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ z >> 27) * 0x94D049BB133111EBULL;
+    return z ^ z >> 31;
+}
+
+static void init_keys(void) {
+    static bool done;
+    if (done) return;
+    uint64_t seed = 0x5A4C0E3ULL;
+    for (int col = 0; col < 2; col++)
+        for (int type = PAWN; type <= KING; type++)
+            for (int pos = 0; pos < 64; pos++) piece_keys[col][type][pos] = next_random(&seed);
+    for (int i = 0; i < 16; i++) castle_keys[i] = next_random(&seed);
+    for (int i = 0; i < 8; i++) en_passant_keys[i] = next_random(&seed);
+    turn_key = next_random(&seed);
+
+    for (int pos = 0; pos < 64; pos++) castle_mask[pos] = 15;
+    castle_mask[000] = ~WHITE_LONG;
+    castle_mask[007] = ~WHITE_SHORT;
+    castle_mask[004] = ~(WHITE_SHORT | WHITE_LONG);
+    castle_mask[070] = ~BLACK_LONG;
+    castle_mask[077] = ~BLACK_SHORT;
+    castle_mask[074] = ~(BLACK_SHORT | BLACK_LONG);
+    done = true;
+}
+
+// the last move was a pawn moving two squares, next to a pawn which may take it en-passant
+// (else the position is the same as after another move order, and so is its key)
+static bool is_pawn_entry(Game *g) {
+    Decoder *d = g->d;
+    Move last = g->last;
+    if (abs(last.to - last.from) != 16 || d->board[last.to] == EMPTY || d->piece_type[d->board[last.to]] != PAWN)
+        return false;
+    for (int dx = -1; dx <= 1; dx += 2) {
+        int x = last.to % 8 + dx;
+        int pce = x >= 0 && x <= 7 ? d->board[last.to + dx] : EMPTY;
+        if (pce != EMPTY && (pce & BLACK) == g->turn && d->piece_type[pce] == PAWN) return true;
+    }
+    return false;
+}
+
+static uint64_t position_key(Game *g) {
+    Decoder *d = g->d;
+    uint64_t key = castle_keys[g->castles];
+    for (int pce = 0; pce < 32; pce++)
+        if (d->piece_location[pce] != EMPTY)
+            key ^= piece_keys[pce >> 4][d->piece_type[pce]][d->piece_location[pce]];
+    if (g->turn == BLACK) key ^= turn_key;
+    if (is_pawn_entry(g)) key ^= en_passant_keys[g->last.to % 8];
+    return key;
+}
+
+int init_game(Game *g, Decoder *d, const char *fen) {
+    init_keys();
+    char placement[100], side[4], castles[8] = "-";
+    if (init_fen(d, fen, &g->turn, &g->last) != OK) return ERROR;
+    sscanf(fen, "%99s %3s %7s", placement, side, castles);
+    g->d = d;
+    g->castles = 0;
+    // the castles of the FEN, if the king and the rook are still there (the generator needs the rook numbers of init_fen)
+    if (strchr(castles, 'K') && d->piece_location[WHITE+ROOK2] == 007 && d->piece_location[WHITE+KING1] == 004) g->castles |= WHITE_SHORT;
+    if (strchr(castles, 'Q') && d->piece_location[WHITE+ROOK1] == 000 && d->piece_location[WHITE+KING1] == 004) g->castles |= WHITE_LONG;
+    if (strchr(castles, 'k') && d->piece_location[BLACK+ROOK2] == 077 && d->piece_location[BLACK+KING1] == 074) g->castles |= BLACK_SHORT;
+    if (strchr(castles, 'q') && d->piece_location[BLACK+ROOK1] == 070 && d->piece_location[BLACK+KING1] == 074) g->castles |= BLACK_LONG;
+    g->key = position_key(g);
+    g->history[0] = g->key;
+    g->nb_history = 1;
+    return OK;
+}
+
+Played make_move(Game *g, Move m) {
+    Decoder *d = g->d;
+    Played played = { .last = g->last, .castles = g->castles, .key = g->key };
+    int pce = d->board[m.from];
+    int col = pce >> 4;
+    int type = d->piece_type[pce];
+    uint64_t key = g->key ^ turn_key ^ castle_keys[g->castles];
+    if (is_pawn_entry(g)) key ^= en_passant_keys[g->last.to % 8];
+
+    played.undo = do_move(d, m);
+    Undo *u = &played.undo;
+    key ^= piece_keys[col][type][m.from] ^ piece_keys[col][d->piece_type[pce]][m.to];
+    if (u->taken != EMPTY) key ^= piece_keys[col ^ 1][d->piece_type[u->taken]][u->taken_location];
+    if (u->rook_from != EMPTY) key ^= piece_keys[col][ROOK][u->rook_from] ^ piece_keys[col][ROOK][u->rook_to];
+
+    g->castles &= castle_mask[m.from] & castle_mask[m.to];
+    g->last = m;
+    g->turn ^= BLACK;
+    key ^= castle_keys[g->castles];
+    if (is_pawn_entry(g)) key ^= en_passant_keys[m.to % 8];
+    g->key = key;
+    g->history[g->nb_history++] = key;
+    return played;
+}
+
+void unmake_move(Game *g, Played *played) {
+    undo_move(g->d, played->undo);
+    g->last = played->last;
+    g->castles = played->castles;
+    g->key = played->key;
+    g->turn ^= BLACK;
+    g->nb_history--;
+}
+
+// only the last 100 positions can be repeated (fifty moves without take), the search adds at most MAX_PLY
+void play_move(Game *g, Move m) {
+    if (g->nb_history >= 512) {
+        memmove(g->history, g->history + g->nb_history - 100, 100 * sizeof *g->history);
+        g->nb_history = 100;
+    }
+    make_move(g, m);
+}
+
+static bool is_castle_allowed(Game *g, Move m) {
+    Decoder *d = g->d;
+    if (d->piece_type[d->board[m.from]] != KING || abs(m.to - m.from) != 2) return true;
+    int side = m.to > m.from ? WHITE_SHORT : WHITE_LONG;
+    return g->castles & (g->turn == WHITE ? side : side << 2);
+}
+
+// search_moves() doesn't take en-passant when in check (search_moves_under_check), which the book
+// generator must keep for the order of its moves: the pawn that just checked may be taken that way
+static int add_en_passant(Game *g, Move *moves, int nb_moves) {
+    Decoder *d = g->d;
+    if (!is_pawn_entry(g) || !is_check(d, g->turn)) return nb_moves;
+    int to = (g->last.from + g->last.to) / 2;
+    for (int dx = -1; dx <= 1; dx += 2) {
+        int x = g->last.to % 8 + dx;
+        int pce = x >= 0 && x <= 7 ? d->board[g->last.to + dx] : EMPTY;
+        if (pce != EMPTY && (pce & BLACK) == g->turn && d->piece_type[pce] == PAWN)
+            moves[nb_moves++] = (Move){ g->last.to + dx, to };
+    }
+    return nb_moves;
+}
+
+// moves of the generator, without the repeated promotions and the castles which aren't possible
+// anymore, with the en-passant takes when in check
+static int generate(Game *g, Move *moves) {
+    Decoder *d = g->d;
+    search_moves(d, g->turn, g->last);
+    int nb_moves = 0;
+    for (int i = 0; i < d->nb_moves; i++) {
+        Move m = d->moves[i];
+        if (nb_moves > 0 && same_move(m, moves[nb_moves-1])) continue;
+        if (!is_castle_allowed(g, m)) continue;
+        moves[nb_moves++] = m;
+    }
+    return add_en_passant(g, moves, nb_moves);
+}
+
+int legal_moves(Game *g, Moves moves) {
+    Moves generated;
+    int nb_generated = generate(g, generated), nb_moves = 0;
+    for (int i = 0; i < nb_generated; i++) {
+        Played played = make_move(g, generated[i]);
+        if (!is_check(g->d, g->turn ^ BLACK)) moves[nb_moves++] = generated[i];
+        unmake_move(g, &played);
+    }
+    return nb_moves;
+}
+
+static bool is_take(Decoder *d, Move m) {
+    if (d->board[m.to] != EMPTY) return true;
+    return d->piece_type[d->board[m.from]] == PAWN && (m.to - m.from) % 8 != 0;  // en-passant
+}
+
+static bool is_promotion(Decoder *d, Move m) {
+    return d->piece_type[d->board[m.from]] == PAWN && (m.to >= 070 || m.to < 010);
+}
+
+static bool is_repetition(Game *g) {
+    for (int i = g->nb_history - 3; i >= 0 && i >= g->nb_history - 100; i -= 2)
+        if (g->history[i] == g->key) return true;
+    return false;
+}
+
+// evaluation() of sargon.c, kept up to date by the moves, in hundredths of pawns
+int evaluate(Game *g) {
+    int score = evaluation(g->d) * 100 / 256;
+    return g->turn == WHITE ? score : -score;
+}
+
+/*
+ * Transposition table
+ *
+ * data: from (6 bits), to (6), score + 32768 (16), depth (8), bound (2), age (8)
+ */
+
+int init_tt(Tt *tt, int megabytes) {
+    uint64_t nb_entries = 1;
+    while (nb_entries * 2 * sizeof(Tt_entry) <= (uint64_t)megabytes << 20) nb_entries *= 2;
+    tt->entries = calloc(nb_entries, sizeof *tt->entries);
+    tt->mask = nb_entries - 1;
+    tt->age = 0;
+    return tt->entries ? OK : ERROR;
+}
+
+void clear_tt(Tt *tt) {
+    memset(tt->entries, 0, (tt->mask + 1) * sizeof *tt->entries);
+}
+
+void free_tt(Tt *tt) {
+    free(tt->entries);
+    tt->entries = NULL;
+}
+
+// the mates are stored from the position, not from the root
+static int score_to_tt(int score, int ply) {
+    return score >= MATE - MAX_PLY ? score + ply : score <= -MATE + MAX_PLY ? score - ply : score;
+}
+
+static int score_from_tt(int score, int ply) {
+    return score >= MATE - MAX_PLY ? score - ply : score <= -MATE + MAX_PLY ? score + ply : score;
+}
+
+static bool probe_tt(Tt *tt, uint64_t key, Move *move, int *score, int *depth, int *bound) {
+    Tt_entry *e = &tt->entries[key & tt->mask];
+    uint64_t data = __atomic_load_n(&e->data, __ATOMIC_RELAXED);
+    if ((__atomic_load_n(&e->key, __ATOMIC_RELAXED) ^ data) != key) return false;
+    move->from = data & 63;
+    move->to   = data >> 6 & 63;
+    *score = (int)(data >> 12 & 0xFFFF) - 32768;
+    *depth = data >> 28 & 0xFF;
+    *bound = data >> 36 & 3;
+    return true;
+}
+
+// an entry of an older search, or found at a lower depth, is replaced
+static void store_tt(Tt *tt, uint64_t key, Move move, int score, int depth, int bound) {
+    Tt_entry *e = &tt->entries[key & tt->mask];
+    uint64_t old = __atomic_load_n(&e->data, __ATOMIC_RELAXED);
+    if ((__atomic_load_n(&e->key, __ATOMIC_RELAXED) ^ old) != key && (old >> 38 & 0xFF) == tt->age
+     && (int)(old >> 28 & 0xFF) > depth) return;
+    uint64_t data = (uint64_t)move.from | (uint64_t)move.to << 6 | (uint64_t)(score + 32768) << 12
+                  | (uint64_t)depth << 28 | (uint64_t)bound << 36 | (uint64_t)tt->age << 38;
+    __atomic_store_n(&e->key, key ^ data, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->data, data, __ATOMIC_RELAXED);
+}
+
+/*
+ * Time, as LA33E: the time credit of the level is added when the number of moves left is back to 0,
+ * and the move gets a tenth of what is left in the bank once 10 moves are kept in reserve
+ * (or with the time of the missing moves when there are less than 10 moves left).
+ * The "seconds" of Sargon are units of 256 generated moves of the Apple II; here they are seconds.
+ */
+
+void init_clock(Clock *c, int level) {
+    c->level = level < 0 ? 0 : level > NB_LEVELS ? NB_LEVELS : level;
+    c->bank = 0;
+    c->moves_left = 0;
+}
+
+double move_time(Clock *c) {
+    if (c->level == 0) return 0;
+    if (c->moves_left <= 0) {
+        c->bank += level_seconds[c->level];
+        c->moves_left = level_moves[c->level];
+    }
+    double per_move = (double)level_seconds[c->level] / level_moves[c->level];
+    double seconds = (c->bank - (c->moves_left - 10) * per_move) / 10;
+    return seconds > 0.05 ? seconds : 0.05;
+}
+
+void spend_time(Clock *c, double seconds) {
+    c->bank -= seconds;
+    c->moves_left--;
+}
+
+void set_time_limits(Search *s, Clock *c) {
+    double seconds = move_time(c);
+    s->soft_limit = seconds / 2;
+    s->hard_limit = seconds * 2.5;
+}
+
+double elapsed_time(const Search *s) {
+    return trace_now() - s->start;
+}
+
+/*
+ * Search
+ */
+
+static void check_time(Search *s) {
+    if ((s->nodes & 1023) == 0 && s->hard_limit > 0 && elapsed_time(s) >= s->hard_limit) s->stop = true;
+}
+
+// the move of the table first, then the killer moves, then the order of the generator
+static void order_moves(Search *s, Move *moves, int nb_moves, Move first, int ply) {
+    Move *killers = s->killers[ply];
+    int next = 0;
+    for (int k = 0; k < 3; k++) {
+        Move m = k == 0 ? first : killers[k-1];
+        if (m.from == m.to) continue;
+        for (int i = next; i < nb_moves; i++)
+            if (same_move(moves[i], m)) {
+                memmove(moves + next + 1, moves + next, (i - next) * sizeof *moves);
+                moves[next++] = m;
+                break;
+            }
+    }
+}
+
+static int quiescence(Search *s, int alpha, int beta, int ply) {
+    Game *g = s->game;
+    Decoder *d = g->d;
+    s->nodes++;
+    s->quiescence_nodes++;
+    check_time(s);
+    if (ply >= MAX_PLY - 1) return evaluate(g);
+
+    bool in_check = is_check(d, g->turn);
+    int best = -MATE + ply;
+    if (!in_check) {            // stand pat, except when every escape must be searched
+        best = evaluate(g);
+        if (best >= beta) return best;
+        if (best > alpha) alpha = best;
+    }
+
+    Moves moves;
+    int nb_moves = generate(g, moves);
+    for (int i = 0; i < nb_moves; i++) {
+        if (!in_check && !is_take(d, moves[i]) && !is_promotion(d, moves[i])) continue;
+        Played played = make_move(g, moves[i]);
+        if (is_check(d, g->turn ^ BLACK)) {
+            unmake_move(g, &played);
+            continue;
+        }
+        int score = -quiescence(s, -beta, -alpha, ply + 1);
+        unmake_move(g, &played);
+        if (s->stop) return 0;
+        if (score > best) {
+            best = score;
+            if (score > alpha) alpha = score;
+            if (score >= beta) break;
+        }
+    }
+    return best;
+}
+
+static bool has_pieces(Game *g) {
+    for (int pce = g->turn + KNIGHT1; pce <= g->turn + QUEEN1; pce++)
+        if (g->d->piece_location[pce] != EMPTY) return true;
+    for (int pce = g->turn + PAWN1; pce <= g->turn + PAWN8; pce++)
+        if (g->d->piece_location[pce] != EMPTY && g->d->piece_type[pce] != PAWN) return true;
+    return false;
+}
+
+static int alpha_beta(Search *s, int depth, int alpha, int beta, int ply, bool null_move) {
+    Game *g = s->game;
+    Decoder *d = g->d;
+    s->line_length[ply] = 0;
+    if (ply > 0 && is_repetition(g)) return 0;
+    bool in_check = is_check(d, g->turn);
+    if (in_check) depth++;
+    if (depth <= 0) return quiescence(s, alpha, beta, ply);
+    if (ply >= MAX_PLY - 1) return evaluate(g);
+    s->nodes++;
+    check_time(s);
+
+    Move tt_move = { 0, 0 };
+    int tt_score, tt_depth, tt_bound;
+    if (probe_tt(s->tt, g->key, &tt_move, &tt_score, &tt_depth, &tt_bound) && ply > 0 && tt_depth >= depth) {
+        tt_score = score_from_tt(tt_score, ply);
+        if (tt_bound == EXACT
+         || (tt_bound == LOWER_BOUND && tt_score >= beta)
+         || (tt_bound == UPPER_BOUND && tt_score <= alpha)) return tt_score;
+    }
+
+    // null move: if passing is still too good for the other side, this position is
+    if (null_move && !in_check && depth >= 3 && beta < MATE - MAX_PLY && has_pieces(g) && evaluate(g) >= beta) {
+        Move last = g->last;
+        uint64_t key = g->key;
+        if (is_pawn_entry(g)) g->key ^= en_passant_keys[last.to % 8];
+        g->key ^= turn_key;
+        g->last.from = g->last.to = d->piece_location[g->turn + KING1];
+        g->turn ^= BLACK;
+        g->history[g->nb_history++] = g->key;
+        int score = -alpha_beta(s, depth - 3, -beta, -beta + 1, ply + 1, false);
+        g->nb_history--;
+        g->turn ^= BLACK;
+        g->last = last;
+        g->key = key;
+        if (s->stop) return 0;
+        if (score >= beta) return score >= MATE - MAX_PLY ? beta : score;
+    }
+
+    Moves moves;
+    int nb_moves = generate(g, moves);
+    order_moves(s, moves, nb_moves, tt_move, ply);
+
+    int best = -MATE, nb_legal = 0, old_alpha = alpha;
+    Move best_move = { 0, 0 };
+    for (int i = 0; i < nb_moves; i++) {
+        Move m = moves[i];
+        bool quiet = !is_take(d, m) && !is_promotion(d, m);
+        Played played = make_move(g, m);
+        if (is_check(d, g->turn ^ BLACK)) {
+            unmake_move(g, &played);
+            continue;
+        }
+        nb_legal++;
+        int score;
+        if (nb_legal == 1) score = -alpha_beta(s, depth - 1, -beta, -alpha, ply + 1, true);
+        else {                  // the first move is expected to be the best one
+            score = -alpha_beta(s, depth - 1, -alpha - 1, -alpha, ply + 1, true);
+            if (score > alpha && score < beta) score = -alpha_beta(s, depth - 1, -beta, -alpha, ply + 1, true);
+        }
+        unmake_move(g, &played);
+        if (s->stop) return 0;
+
+        if (score > best) {
+            best = score;
+            best_move = m;
+            if (score > alpha) {
+                alpha = score;
+                s->lines[ply][0] = m;
+                memcpy(s->lines[ply] + 1, s->lines[ply+1], s->line_length[ply+1] * sizeof(Move));
+                s->line_length[ply] = s->line_length[ply+1] + 1;
+            }
+            if (score >= beta) {
+                if (quiet && !same_move(m, s->killers[ply][0])) {
+                    s->killers[ply][1] = s->killers[ply][0];
+                    s->killers[ply][0] = m;
+                }
+                break;
+            }
+        }
+    }
+    if (nb_legal == 0) return in_check ? -MATE + ply : 0;
+
+    int bound = best >= beta ? LOWER_BOUND : best > old_alpha ? EXACT : UPPER_BOUND;
+    store_tt(s->tt, g->key, best_move, score_to_tt(best, ply), depth, bound);
+    return best;
+}
+
+int think(Search *s) {
+    Game *g = s->game;
+    s->start = trace_now();
+    s->stop = false;
+    s->nodes = s->quiescence_nodes = 0;
+    s->depth = s->score = s->pv_length = 0;
+    s->best = (Move){ 0, 0 };
+    s->tt->age++;
+    memset(s->killers, 0, sizeof s->killers);
+
+    Moves moves;
+    int nb_moves = legal_moves(g, moves);
+    if (nb_moves == 0) {
+        s->score = is_check(g->d, g->turn) ? -MATE : 0;
+        return s->score;
+    }
+    s->best = moves[0];         // something to play, even if the first iteration doesn't end
+
+    int max_depth = s->max_depth > 0 && s->max_depth < MAX_PLY - 1 ? s->max_depth : MAX_PLY - 1;
+    for (int depth = 1; depth <= max_depth; depth++) {
+        int score = alpha_beta(s, depth, -MATE - 1, MATE + 1, 0, false);
+        if (s->stop) break;
+        s->depth = depth;
+        s->score = score;
+        s->best = s->lines[0][0];
+        s->pv_length = s->line_length[0];
+        memcpy(s->pv, s->lines[0], s->pv_length * sizeof(Move));
+        if (s->report) s->report(s);
+        if (s->soft_limit > 0 && elapsed_time(s) >= s->soft_limit) break;
+        if (abs(score) >= MATE - MAX_PLY || (nb_moves == 1 && s->soft_limit > 0)) break;
+    }
+    return s->score;
+}
@@ -0,0 +1,106 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+/*
+ * Alpha-beta search on the move generator of sargon.c, to go on after the Openings Library:
+ * iterative deepening, a transposition table, and a quiescence search of the takes and
+ * promotions at the leaves (what Sargon does while $8F is set).
+ *
+ * The time of a move comes from the levels of Sargon (LA33E): the time credit of the level
+ * ($6148/$6158) for its number of moves ($6256), kept in a bank like $1167/$1168 with the
+ * number of moves left like $1169. No new iteration is started after half the time of the
+ * move, and the search is stopped at 2.5 times this time, like $DC/$DD and $DE/$DF.
+ *
+ * The search doesn't change the Decoder context once it is done (every move is undone).
+ */
+
+#include "sargon.h"
+
+#define MAX_PLY   64
+#define MATE      30000         // minus the number of plies to the mate
+#define NB_LEVELS 8
+
+enum Castles { WHITE_SHORT = 1, WHITE_LONG = 2, BLACK_SHORT = 4, BLACK_LONG = 8 };
+
+// two words, the key is stored xored with the data, so that an entry written by two threads
+// at the same time doesn't match anymore (no lock)
+typedef struct {
+    uint64_t key, data;
+} Tt_entry;
+
+typedef struct {
+    Tt_entry *entries;
+    uint64_t  mask;             // number of entries - 1, a power of two
+    uint8_t   age;              // of the current search, entries of older searches are replaced first
+} Tt;
+
+typedef struct {
+    int    level;               // 1-8, 0 for no time control
+    double bank;                // seconds left for moves_left moves ($1167/$1168)
+    int    moves_left;          // $1169, a new time credit is added when it is back to 0
+} Clock;
+
+// a position of the game: the Decoder board, and what the generator doesn't keep
+typedef struct {
+    Decoder *d;
+    int      turn;
+    Move     last;
+    int      castles;           // enum Castles still possible
+    uint64_t key;
+    uint64_t history[1024];     // keys of the positions of the game and of the search, for the repetitions
+    int      nb_history;
+} Game;
+
+// what make_move() changed, for unmake_move()
+typedef struct {
+    Undo     undo;
+    Move     last;
+    int      castles;
+    uint64_t key;
+} Played;
+
+typedef struct Search Search;
+struct Search {
+    Game    *game;
+    Tt      *tt;
+    double   soft_limit, hard_limit;    // seconds, 0 for none
+    int      max_depth;
+    bool     stop;
+    double   start;
+    long     nodes, quiescence_nodes;
+    Move     killers[MAX_PLY][2];
+    Move     lines[MAX_PLY][MAX_PLY];   // principal variation found at each ply
+    int      line_length[MAX_PLY];
+
+    // result of the last complete iteration
+    int      depth, score;
+    Move     best;
+    Move     pv[MAX_PLY];
+    int      pv_length;
+    void   (*report)(Search *s);        // called after each iteration if set
+    void    *user;
+};
+
+extern const int level_seconds[NB_LEVELS+1];    // time credits of $6148/$6158
+extern const int level_moves[NB_LEVELS+1];      // number of moves of $6256
+
+int  init_tt(Tt *tt, int megabytes);    // OK, or ERROR if it can't be allocated
+void clear_tt(Tt *tt);
+void free_tt(Tt *tt);
+
+int  init_game(Game *g, Decoder *d, const char *fen);  // OK, or ERROR if not a valid position
+void play_move(Game *g, Move m);        // the move stays played
+Played make_move(Game *g, Move m);      // the move is played until unmake_move(), g->key follows
+void unmake_move(Game *g, Played *played);
+int  legal_moves(Game *g, Moves moves); // number of legal moves, in the order of the generator
+int  evaluate(Game *g);                 // for the side to play
+
+void   init_clock(Clock *c, int level);
+double move_time(Clock *c);             // time target of the next move, as LA33E
+void   spend_time(Clock *c, double seconds);   // after the move, as L9156
+void   set_time_limits(Search *s, Clock *c);
+
+int  think(Search *s);                  // score of s->best, iterative deepening within the limits
+double elapsed_time(const Search *s);   // seconds since think() started
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * Succinct Openings Library, see succinct.h
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "succinct.h"
+
+#define ERROR 1
+#define OK    0
+
+#define BLOCK_BITS   512        // of the rank directories, 8 words
+#define BLOCK_WORDS  (BLOCK_BITS / 64)
+#define SAMPLE_RATE  256        // of the select samples
+#define HEADER_SIZE  16
+#define MOVES_PER_WORD 10       // 6 bit move indexes
+#define LINK_SIZE    8
+
+// broadword comparisons (Vigna, "Broadword implementation of rank/select queries"): 8 fields
+// of 8 bits, 7 fields of 9 bits
+#define ONES_STEP_8  0x0101010101010101ULL
+#define MSBS_STEP_8  (0x80 * ONES_STEP_8)
+#define ONES_STEP_9  (1ULL << 0 | 1ULL << 9 | 1ULL << 18 | 1ULL << 27 | 1ULL << 36 | 1ULL << 45 | 1ULL << 54)
+#define MSBS_STEP_9  (0x100 * ONES_STEP_9)
+#define ULEQ_STEP_9(x, y) ((((((y) | MSBS_STEP_9) - ((x) & ~MSBS_STEP_9)) | ((x) ^ (y))) ^ ((x) & ~(y))) & MSBS_STEP_9)
+#define WORD_BITS_9  (64ULL << 0 | 128ULL << 9 | 192ULL << 18 | 256ULL << 27 | 320ULL << 36 | 384ULL << 45 | 448ULL << 54)
+
+static uint8_t select_in_byte[8][256];  // position of the kth set bit of a byte
+
+// ones up to every byte of a word
+static inline uint64_t byte_counts(uint64_t w) {
+    uint64_t s = w - (w >> 1 & 0x5555555555555555ULL);
+    s = (s & 0x3333333333333333ULL) + (s >> 2 & 0x3333333333333333ULL);
+    return ((s + (s >> 4)) & 0x0F0F0F0F0F0F0F0FULL) * ONES_STEP_8;
+}
+
+// popcount without the instruction of the recent processors (plain -O2)
+static inline int popcount(uint64_t w) {
+    return byte_counts(w) >> 56;
+}
+
+typedef struct {                // offsets of the parts in the file, in bytes
+    long louds, select1_samples, select0_samples;
+    long moves, recommended, links, link_names, end;
+} Layout;
+
+static long words(long nb_bits)  { return (nb_bits + 63) / 64; }
+static long blocks(long nb_bits) { return (nb_bits + BLOCK_BITS - 1) / BLOCK_BITS; }
+static long padded(long nb_bytes) { return (nb_bytes + 7) & ~7L; }
+
+// bits and rank directory
+static long vector_size(long nb_bits) {
+    return 8 * words(nb_bits) + padded(4 * (blocks(nb_bits) + 1)) + 8 * blocks(nb_bits);
+}
+
+static Layout layout(uint32_t nb_nodes, uint32_t nb_links) {
+    long nb_bits = 2 * (long)nb_nodes + 1;
+    Layout l;
+    l.louds           = HEADER_SIZE;
+    l.select1_samples = l.louds + vector_size(nb_bits);
+    l.select0_samples = l.select1_samples + padded(4 * ((nb_nodes + SAMPLE_RATE - 1) / SAMPLE_RATE));
+    l.moves           = l.select0_samples + padded(4 * ((nb_nodes + SAMPLE_RATE) / SAMPLE_RATE));
+    l.recommended     = l.moves + 8 * (((long)nb_nodes + MOVES_PER_WORD - 1) / MOVES_PER_WORD);
+    l.links           = l.recommended + 8 * words(nb_nodes);
+    l.link_names      = l.links + vector_size(nb_nodes);
+    l.end             = l.link_names + (long)LINK_SIZE * nb_links;
+    return l;
+}
+
+long succinct_size(uint32_t nb_nodes, uint32_t nb_links) {
+    return layout(nb_nodes, nb_links).end;
+}
+
+/*
+ * Writing
+ */
+
+static void set_bit(uint64_t *bits, long i) {
+    bits[i / 64] |= 1ULL << i % 64;
+}
+
+static void put(FILE *f, uint64_t value, int size) {
+    for (int i = 0; i < size; i++) fputc(value >> 8 * i & 0xFF, f);
+}
+
+static void pad(FILE *f) {
+    while (ftell(f) % 8) fputc(0, f);
+}
+
+// the bits and their rank directory
+static void put_vector(FILE *f, const uint64_t *bits, long nb_bits) {
+    for (long i = 0; i < words(nb_bits); i++) put(f, bits[i], 8);
+    uint32_t ones = 0;
+    for (long i = 0; i < words(nb_bits); i++) {
+        if (i % BLOCK_WORDS == 0) put(f, ones, 4);
+        ones += popcount(bits[i]);
+    }
+    put(f, ones, 4);
+    pad(f);
+    for (long block = 0; block < blocks(nb_bits); block++) {
+        uint64_t counts = 0;
+        int in_block = 0;
+        for (int j = 1; j < BLOCK_WORDS; j++) {
+            long i = block * BLOCK_WORDS + j - 1;
+            if (i < words(nb_bits)) in_block += popcount(bits[i]);
+            counts |= (uint64_t)in_block << 9 * (j - 1);
+        }
+        put(f, counts, 8);
+    }
+}
+
+// block of every SAMPLE_RATEth bit equal to value
+static void put_samples(FILE *f, const uint64_t *bits, long nb_bits, int value) {
+    long count = 0;
+    for (long i = 0; i < nb_bits; i++)
+        if ((int)(bits[i / 64] >> i % 64 & 1) == value && count++ % SAMPLE_RATE == 0) put(f, i / BLOCK_BITS, 4);
+    pad(f);
+}
+
+int save_succinct(const char *name, const Succinct_node *nodes, uint32_t nb_nodes) {
+    long nb_bits = 2 * (long)nb_nodes + 1;
+    long nb_move_words = ((long)nb_nodes + MOVES_PER_WORD - 1) / MOVES_PER_WORD;
+    uint64_t *louds       = calloc(words(nb_bits), 8);
+    uint64_t *moves       = calloc(nb_move_words + 1, 8);
+    uint64_t *recommended = calloc(words(nb_nodes) + 1, 8);
+    uint64_t *links       = calloc(words(nb_nodes) + 1, 8);
+    uint32_t nb_links = 0;
+
+    long bit = 0;
+    set_bit(louds, bit++);      // "10": the root is the variation of a super root
+    bit++;
+    for (uint32_t i = 0; i < nb_nodes; i++) {
+        const Succinct_node *n = &nodes[i];
+        for (int j = 0; j < n->nb_variations; j++) set_bit(louds, bit++);
+        bit++;
+        moves[i / MOVES_PER_WORD] |= (uint64_t)(n->move_indx & 0x3F) << 6 * (i % MOVES_PER_WORD);
+        if (n->recommended) set_bit(recommended, i);
+        if (n->link[0]) { set_bit(links, i); nb_links++; }
+    }
+
+    int status = ERROR;
+    FILE *f = fopen(name, "wb");
+    if (f && bit == nb_bits) {
+        fwrite("SLB1", 1, 4, f);
+        put(f, nb_nodes, 4);
+        put(f, nb_links, 4);
+        put(f, 0, 4);
+        put_vector(f, louds, nb_bits);
+        put_samples(f, louds, nb_bits, 1);
+        put_samples(f, louds, nb_bits, 0);
+        for (long i = 0; i < nb_move_words; i++) put(f, moves[i], 8);
+        for (long i = 0; i < words(nb_nodes); i++) put(f, recommended[i], 8);
+        put_vector(f, links, nb_nodes);
+        for (uint32_t i = 0; i < nb_nodes; i++)
+            if (nodes[i].link[0]) {
+                for (int j = 0; j < 4; j++) fputc(nodes[i].link[j], f);
+                put(f, 0, 1);
+                put(f, nodes[i].missing, 1);
+                put(f, 0, 2);
+            }
+        status = ftell(f) == succinct_size(nb_nodes, nb_links) ? OK : ERROR;
+    }
+    if (f && fclose(f) != 0) status = ERROR;
+    free(louds);
+    free(moves);
+    free(recommended);
+    free(links);
+    return status;
+}
+
+/*
+ * Reading, in the mapped file
+ */
+
+static inline uint64_t word_at(const uint64_t *w, long i) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(w[i]);
+#else
+    return w[i];
+#endif
+}
+
+static inline uint32_t count_at(const uint32_t *c, long i) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(c[i]);
+#else
+    return c[i];
+#endif
+}
+
+static Bit_vector vector_at(const uint8_t *data, long nb_bits) {
+    Bit_vector v = { (const uint64_t *)data, NULL, NULL, nb_bits, blocks(nb_bits) };
+    v.ranks  = (const uint32_t *)(data + 8 * words(nb_bits));
+    v.counts = (const uint64_t *)(data + 8 * words(nb_bits) + padded(4 * (v.nb_blocks + 1)));
+    return v;
+}
+
+static void init_select_table(void) {
+    for (int byte = 0; byte < 256; byte++)
+        for (int bit = 0, k = 0; bit < 8; bit++)
+            if (byte >> bit & 1) select_in_byte[k++][byte] = bit;
+}
+
+int open_succinct(Succinct_book *b, const char *name) {
+    if (!select_in_byte[1][3]) init_select_table();
+    if (map_book(&b->file, name) != OK) return ERROR;
+    const uint8_t *data = b->file.data;
+    if (b->file.size < HEADER_SIZE || memcmp(data, "SLB1", 4) != 0) {
+        unmap_book(&b->file);
+        return ERROR;
+    }
+    b->nb_nodes = data[4] | data[5] << 8 | data[6] << 16 | (uint32_t)data[7] << 24;
+    b->nb_links = data[8] | data[9] << 8 | data[10] << 16 | (uint32_t)data[11] << 24;
+    Layout l = layout(b->nb_nodes, b->nb_links);
+    if (b->nb_nodes == 0 || b->nb_nodes > 0x7FFFFFFF || (long)b->file.size != l.end) {
+        unmap_book(&b->file);
+        return ERROR;
+    }
+    b->louds           = vector_at(data + l.louds, 2 * (long)b->nb_nodes + 1);
+    b->select1_samples = (const uint32_t *)(data + l.select1_samples);
+    b->select0_samples = (const uint32_t *)(data + l.select0_samples);
+    b->moves           = (const uint64_t *)(data + l.moves);
+    b->recommended     = (const uint64_t *)(data + l.recommended);
+    b->links           = vector_at(data + l.links, b->nb_nodes);
+    b->link_names      = data + l.link_names;
+    return OK;
+}
+
+void close_succinct(Succinct_book *b) {
+    unmap_book(&b->file);
+}
+
+static inline bool bit_at(const uint64_t *bits, long i) {
+    return word_at(bits, i / 64) >> i % 64 & 1;
+}
+
+// ones before the jth word of a block
+static inline int in_block(const Bit_vector *v, long block, int j) {
+    return j ? word_at(v->counts, block) >> 9 * (j - 1) & 0x1FF : 0;
+}
+
+// ones before bit i
+static long rank1(const Bit_vector *v, long i) {
+    long ones = count_at(v->ranks, i / BLOCK_BITS) + in_block(v, i / BLOCK_BITS, i / 64 % BLOCK_WORDS);
+    if (i % 64) ones += popcount(word_at(v->bits, i / 64) << (64 - i % 64));
+    return ones;
+}
+
+// position of the kth set bit of a word (k < its popcount): the ones up to every byte are
+// counted at once, the byte holding it is the number of counts not above k, then a table
+static int select_in_word(uint64_t w, int k) {
+    uint64_t s = byte_counts(w);
+    uint64_t below = ((k * ONES_STEP_8 | MSBS_STEP_8) - s) & MSBS_STEP_8;
+    int place = ((below >> 7) * ONES_STEP_8 >> 56) * 8;
+    return place + select_in_byte[k - (s << 8 >> place & 0xFF)][w >> place & 0xFF];
+}
+
+// bits equal to value before a block
+static inline long before_block(const Bit_vector *v, long block, int value) {
+    long ones = count_at(v->ranks, block);
+    return value ? ones : block * BLOCK_BITS - ones;
+}
+
+// position of the kth bit equal to value (from 0): from the sampled block to the block holding
+// it, then to the word with the counts of the block, compared all at once, then to the bit
+static long select_bit(const Succinct_book *b, long k, int value) {
+    const Bit_vector *v = &b->louds;
+    long block = count_at(value ? b->select1_samples : b->select0_samples, k / SAMPLE_RATE);
+    while (block + 1 < v->nb_blocks && before_block(v, block + 1, value) <= k) block++;
+    k -= before_block(v, block, value);
+    uint64_t counts = word_at(v->counts, block);
+    if (!value) counts = WORD_BITS_9 - counts;
+    int j = (ULEQ_STEP_9(counts, k * ONES_STEP_9) >> 8) * ONES_STEP_9 >> 54 & 7;
+    if (j) k -= counts >> 9 * (j - 1) & 0x1FF;
+    uint64_t bits = word_at(v->bits, block * BLOCK_WORDS + j);
+    return (block * BLOCK_WORDS + j) * 64 + select_in_word(value ? bits : ~bits, k);
+}
+
+int nb_variations(const Succinct_book *b, uint32_t node) {
+    long start = select_bit(b, node, 0) + 1;
+    int count = 0;
+    for (long w = start / 64, shift = start % 64; ; w++, shift = 0) {
+        uint64_t zeros = ~word_at(b->louds.bits, w) >> shift;
+        if (zeros) return count + __builtin_ctzll(zeros);
+        count += 64 - shift;
+    }
+}
+
+uint32_t first_variation(const Succinct_book *b, uint32_t node) {
+    return select_bit(b, node, 0) - node;
+}
+
+uint32_t next_variation(const Succinct_book *b, uint32_t node) {
+    return bit_at(b->louds.bits, select_bit(b, node, 1) + 1) ? node + 1 : 0;
+}
+
+uint32_t parent_node(const Succinct_book *b, uint32_t node) {
+    long pos = select_bit(b, node, 1);
+    return pos - rank1(&b->louds, pos) - 1;
+}
+
+int node_move_indx(const Succinct_book *b, uint32_t node) {
+    return word_at(b->moves, node / MOVES_PER_WORD) >> 6 * (node % MOVES_PER_WORD) & 0x3F;
+}
+
+bool is_recommended(const Succinct_book *b, uint32_t node) {
+    return bit_at(b->recommended, node);
+}
+
+const char *node_link(const Succinct_book *b, uint32_t node, bool *missing) {
+    if (!bit_at(b->links.bits, node)) return NULL;
+    const uint8_t *link = b->link_names + LINK_SIZE * rank1(&b->links, node);
+    if (missing) *missing = link[5];
+    return (const char *)link;
+}
@@ -0,0 +1,75 @@
+#ifndef SUCCINCT_H
+#define SUCCINCT_H
+
+/*
+ * Succinct Openings Library: the tree of B000 with the variations of the ECO files in place of
+ * their C5 entries (as book_rebuild writes it), stored so that it is navigated in constant time
+ * in the mapped file instead of being scanned like the Sargon format:
+ *
+ * - the shape of the tree as a LOUDS bit vector: the nodes are numbered in breadth first order
+ *   (0 is the initial position, the others the moves of the book) and every node writes its
+ *   number of variations in unary (1...1 0), after a leading "10" for the root. The variations
+ *   of a node are thus consecutive numbers: the first one is select0(node) - node, the parent
+ *   of a node is rank0(select1(node)) - 1.
+ * - the move indexes (in the generator order, as in the book) in a packed array of 6 bits,
+ *   10 per 64 bit word. 0 is the end of a book (END_NODE).
+ * - the recommended moves (C0 prefix) in a bit vector.
+ * - the nodes whose variations go on in an ECO file in a bit vector, with the names of these
+ *   files in the order of the nodes (rank1 of the bit vector). A file (or a line in it) that was
+ *   missing when the library was compiled is marked, its variations are left out.
+ *
+ * Every bit vector has a rank directory: the ones before each block of 512 bits, and before each
+ * of the 7 last words of the block (9 bits each, packed in a word), so that a rank costs one
+ * popcount, and a select goes from a sampled block to the word without counting bits.
+ *
+ * File, 64 bit little endian words, every part starting on a word:
+ *   "SLB1", number of nodes (4), of links (4), 0 (4)
+ *   LOUDS bits (2 * nodes + 1) and their rank directory, block of every 256th one, of every
+ *   256th zero (4 each), move indexes, recommended bits, link bits and their rank directory,
+ *   names of the links (4 characters, 0, missing (1), 0 (2))
+ *   rank directory: ones before every block (4 each, one more for the end), then the ones
+ *   before the words of every block (8 each)
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "book_file.h"
+
+typedef struct {
+    const uint64_t *bits;
+    const uint32_t *ranks;      // ones before every block
+    const uint64_t *counts;     // ones before the words of every block, from its start
+    long            nb_bits, nb_blocks;
+} Bit_vector;
+
+typedef struct {
+    Book_file  file;            // mapped, read only
+    uint32_t   nb_nodes, nb_links;
+    Bit_vector louds, links;
+    const uint32_t *select1_samples, *select0_samples;
+    const uint64_t *moves, *recommended;
+    const uint8_t  *link_names;
+} Succinct_book;
+
+typedef struct {                // a node of the tree given to save_succinct(), in breadth first order
+    uint8_t nb_variations;
+    uint8_t move_indx;          // 0 for the root and the ends of the books
+    bool    recommended;
+    char    link[5];            // ECO file the variations go on in, "" if none
+    bool    missing;            // this ECO file, or the line in it, wasn't found
+} Succinct_node;
+
+int  save_succinct(const char *name, const Succinct_node *nodes, uint32_t nb_nodes);  // OK, or ERROR if it can't be written
+long succinct_size(uint32_t nb_nodes, uint32_t nb_links);  // of the file, in bytes
+int  open_succinct(Succinct_book *b, const char *name);    // OK, or ERROR if it isn't a succinct book
+void close_succinct(Succinct_book *b);
+
+int      nb_variations(const Succinct_book *b, uint32_t node);
+uint32_t first_variation(const Succinct_book *b, uint32_t node);   // if it has variations
+uint32_t next_variation(const Succinct_book *b, uint32_t node);    // its next sibling, 0 if it is the last one
+uint32_t parent_node(const Succinct_book *b, uint32_t node);       // not for the root
+int      node_move_indx(const Succinct_book *b, uint32_t node);
+bool     is_recommended(const Succinct_book *b, uint32_t node);
+const char *node_link(const Succinct_book *b, uint32_t node, bool *missing);   // ECO file name, or NULL
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Chrome trace files, see trace.h
+ */
+#include <stdio.h>
+#include "trace.h"
+
+#define ERROR 1
+#define OK    0
+
+double trace_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int open_trace(Trace *t, const char *name) {
+    t->start = trace_now();
+    t->nb_events = 0;
+    t->file = fopen(name, "w");
+    if (!t->file) return ERROR;
+    fprintf(t->file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    return OK;
+}
+
+// the names are file names, which may hold quotes or backslashes
+static void put_string(FILE *file, const char *s) {
+    putc('"', file);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') putc('\\', file);
+        if ((unsigned char)*s >= ' ') putc(*s, file);
+    }
+    putc('"', file);
+}
+
+// the events of the threads are written under the lock of the stream
+void trace_event(Trace *t, const char *name, const char *category, int thread, double start, double end, const char *args) {
+    if (!t->file) return;
+    flockfile(t->file);
+    fprintf(t->file, "%s\n{\"name\":", t->nb_events++ ? "," : "");
+    put_string(t->file, name);
+    fprintf(t->file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{%s}}",
+            category, thread, (start - t->start) * 1e6, (end - start) * 1e6, args ? args : "");
+    funlockfile(t->file);
+}
+
+int close_trace(Trace *t) {
+    if (!t->file) return OK;
+    fprintf(t->file, "\n]}\n");
+    int status = ferror(t->file) ? ERROR : OK;
+    if (fclose(t->file) != 0) status = ERROR;
+    t->file = NULL;
+    return status;
+}
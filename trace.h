@@ -0,0 +1,49 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Instrumentation of the decoder and of the tools.
+ *
+ * With -DSTATS=1, the hot paths (move generation, threats, do_move(), book reads) count their
+ * calls and the ticks spent in them; otherwise these counters are compiled out and cost nothing.
+ * The tools time their phases (load, decode, print...) in any build, and can write them as a
+ * timeline in the Chrome trace format (chrome://tracing, Perfetto): one complete event ("X")
+ * per phase, on the thread that ran it, with its counters as arguments.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifndef STATS
+#define STATS 0
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// cheap clock for the hot paths: the time stamp counter where there is one, nanoseconds otherwise
+static inline uint64_t stats_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+typedef struct {
+    FILE  *file;                // NULL if no trace is written
+    double start;               // trace_now() at open_trace()
+    int    nb_events;
+} Trace;
+
+double trace_now(void);         // seconds, monotonic
+int    open_trace(Trace *t, const char *name);     // OK, or ERROR if the file can't be written
+void   trace_event(Trace *t, const char *name, const char *category, int thread, double start, double end,
+                   const char *args);  // args: the members of a JSON object, or NULL; thread safe
+int    close_trace(Trace *t);   // OK, or ERROR if the file couldn't be written
+
+#endif